@@ -19,11 +19,26 @@ MeshInitializer::MeshInitializer() {}
  * @return A half-edge representation of the provided mesh.
  */
 Mesh MeshInitializer::constructHalfEdgeMesh(const OBJFile& loadedOBJFile) {
-  int numVertices = loadedOBJFile.vertexCoords.size();
-  int numFaces = loadedOBJFile.faceValences.size();
+  return constructHalfEdgeMesh(loadedOBJFile.vertexCoords,
+                               loadedOBJFile.faceCoordInd);
+}
+
+/**
+ * @brief MeshInitializer::constructHalfEdgeMesh Constructs a half-edge mesh
+ * from vertex positions and faces. The j-th half-edge of face f starts at
+ * vertex faceCoordInd[f][j].
+ * @param vertexCoords The vertex positions.
+ * @param faceCoordInd For each face, the indices of its vertices.
+ * @return A half-edge representation of the provided mesh.
+ */
+Mesh MeshInitializer::constructHalfEdgeMesh(
+    const QVector<QVector3D>& vertexCoords,
+    const QVector<QVector<int>>& faceCoordInd) {
+  int numVertices = vertexCoords.size();
+  int numFaces = faceCoordInd.size();
   int numHalfEdges = 0;
   for (int f = 0; f < numFaces; f++) {
-    numHalfEdges += loadedOBJFile.faceValences[f];
+    numHalfEdges += faceCoordInd[f].size();
   }
 
   Mesh mesh;
@@ -32,8 +47,8 @@ Mesh MeshInitializer::constructHalfEdgeMesh(const OBJFile& loadedOBJFile) {
   mesh.halfEdges.resize(numHalfEdges);
   mesh.halfEdges.reserve(2 * numHalfEdges);
 
-  initGeometry(mesh, numVertices, loadedOBJFile.vertexCoords);
-  initTopology(mesh, numFaces, loadedOBJFile.faceCoordInd);
+  initGeometry(mesh, numVertices, vertexCoords);
+  initTopology(mesh, numFaces, faceCoordInd);
   return mesh;
 }
 
@@ -80,7 +95,7 @@ void MeshInitializer::initTopology(Mesh& mesh, int numFaces,
       h++;
     }
   }
-  mesh.edgeCount = edgeList.size();
+  mesh.edgeCount = edgeHalfEdges.size();
 }
 
 /**
@@ -149,20 +164,22 @@ QPair<int, int> createUndirectedEdge(int v1, int v2) {
 void MeshInitializer::setTwins(Mesh& mesh, int h, int vertIdx1, int vertIdx2) {
   QPair<int, int> currentEdge = createUndirectedEdge(vertIdx1, vertIdx2);
 
-  int edgeIdx = edgeList.indexOf(currentEdge);
+  int edgeIdx = edgeMap.value(currentEdge, -1);
   // edge does not exist yet
   if (edgeIdx == -1) {
-    // same as doing this after appending and adding -1
-    edgeIndices.append(edgeList.size());
-    mesh.halfEdges[h].edgeIndex = edgeList.size();
-    edgeList.append(currentEdge);
+    mesh.halfEdges[h].edgeIndex = edgeHalfEdges.size();
+    edgeMap.insert(currentEdge, edgeHalfEdges.size());
+    edgeHalfEdges.append(h);
   } else {
-    edgeIndices.append(edgeIdx);
     mesh.halfEdges[h].edgeIndex = edgeIdx;
     // edge already existed, meaning there is a twin somewhere earlier in the
     // list of edges
-    HalfEdge* twinEdge = &mesh.halfEdges[edgeIndices.indexOf(edgeIdx)];
+    HalfEdge* twinEdge = &mesh.halfEdges[edgeHalfEdges[edgeIdx]];
     mesh.halfEdges[h].twin = twinEdge;
-    twinEdge->twin = &mesh.halfEdges[h];
+    // on edges shared by more than two faces, prefer a twin running the other
+    // way, so that the order of the faces does not decide the orientation
+    if (twinEdge->twin == nullptr || twinEdge->origin->index == vertIdx2) {
+      twinEdge->twin = &mesh.halfEdges[h];
+    }
   }
 }
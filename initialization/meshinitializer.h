@@ -1,6 +1,8 @@
 #ifndef MESH_INITIALIZER_H
 #define MESH_INITIALIZER_H
 
+#include <QHash>
+
 #include "../mesh/mesh.h"
 #include "objfile.h"
 
@@ -11,6 +13,8 @@ class MeshInitializer {
  public:
   MeshInitializer();
   Mesh constructHalfEdgeMesh(const OBJFile& loadedOBJFile);
+  Mesh constructHalfEdgeMesh(const QVector<QVector3D>& vertexCoords,
+                             const QVector<QVector<int>>& faceCoordInd);
 
  private:
   void initGeometry(Mesh& mesh, int numVertices,
@@ -21,8 +25,9 @@ class MeshInitializer {
                    const QVector<int>& faceIndices, int i);
   void setTwins(Mesh& mesh, int h, int vertIdx1, int vertIdx2);
 
-  QList<QPair<int, int>> edgeList;
-  QVector<int> edgeIndices;
+  // The index of every undirected edge, and the first half-edge added on it
+  QHash<QPair<int, int>, int> edgeMap;
+  QVector<int> edgeHalfEdges;
 };
 
 #endif  // MESH_INITIALIZER_H
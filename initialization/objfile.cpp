@@ -4,6 +4,7 @@
 #include <QFile>
 #include <QMatrix4x4>
 
+#include "util/trace.h"
 #include "util/util.h"
 
 #define DESIRED_SCALE 2.0
@@ -39,7 +40,7 @@ OBJFile::OBJFile(const QString& fileName) {
       } else if (descriptor == "f") {
         handleFace(values);
       } else {
-        qDebug() << " * Line contents ignored," << currentLine;
+        TRACE(TRACE_DEBUG, TRACE_IO, " * Line contents ignored, %s", qPrintable(currentLine));
       }
     }
     newModel.close();
@@ -5,6 +5,8 @@
 #include <QLoggingCategory>
 #include <QOpenGLVersionFunctionsFactory>
 
+#include "util/trace.h"
+
 /**
  * @brief MainView::MainView
  * @param Parent
@@ -64,7 +66,7 @@ void MainView::initializeGL() {
  * @param newHeight The new height of the window in pixels.
  */
 void MainView::resizeGL(int newWidth, int newHeight) {
-    qDebug() << ".. resizeGL";
+    TRACE(TRACE_DEBUG, TRACE_RENDER, ".. resizeGL %dx%d", newWidth, newHeight);
 
     settings.dispRatio = float(newWidth) / float(newHeight);
 
@@ -76,7 +78,7 @@ void MainView::resizeGL(int newWidth, int newHeight) {
 
 /**
  * @brief MainView::updateMatrices Updates the matrices used for the model
- * transforms.
+ * transforms and emits viewChanged.
  */
 void MainView::updateMatrices() {
     settings.modelViewMatrix.setToIdentity();
@@ -87,8 +89,10 @@ void MainView::updateMatrices() {
     settings.normalMatrix = settings.modelViewMatrix.normalMatrix();
 
     settings.uniformUpdateRequired = true;
+    viewRefinementRequired = true;
 
     update();
+    emit viewChanged();
 }
 
 /**
@@ -101,6 +105,44 @@ void MainView::updateBuffers(Mesh& mesh) {
     update();
 }
 
+/**
+ * @brief MainView::setViewDependentRefiner Draws the mesh of the provided
+ * refiner, refined for the current view, instead of the buffers provided by
+ * updateBuffers.
+ * @param refiner The refiner, or nullptr to stop view-dependent refinement.
+ */
+void MainView::setViewDependentRefiner(ViewDependentRefiner* refiner) {
+    viewRefiner = refiner;
+    invalidateViewDependentMesh();
+}
+
+/**
+ * @brief MainView::invalidateViewDependentMesh Uploads the view-dependent mesh
+ * again on the next draw, e.g. after the shading settings changed.
+ */
+void MainView::invalidateViewDependentMesh() {
+    viewRefinementRequired = true;
+    viewBuffersRequired = true;
+    update();
+}
+
+/**
+ * @brief MainView::updateViewDependentMesh Refines the mesh for the current
+ * matrices and uploads it if the refinement changed.
+ */
+void MainView::updateViewDependentMesh() {
+    int viewportHeight = int(height() * devicePixelRatio());
+    bool changed = viewRefinementRequired &&
+                   viewRefiner->update(settings.modelViewMatrix, settings.projectionMatrix, viewportHeight);
+    if (changed || viewBuffersRequired) {
+        Mesh& mesh = viewRefiner->getMesh();
+        mesh.extractAttributes();
+        meshRenderer.updateBuffers(mesh);
+    }
+    viewRefinementRequired = false;
+    viewBuffersRequired = false;
+}
+
 /**
  * @brief MainView::paintGL Draw call.
  */
@@ -115,6 +157,9 @@ void MainView::paintGL() {
     }
 
     if (settings.modelLoaded) {
+        if (viewRefiner != nullptr) {
+            updateViewDependentMesh();
+        }
         meshRenderer.draw();
     }
 }
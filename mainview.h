@@ -9,6 +9,7 @@
 
 #include "mesh/mesh.h"
 #include "renderers/meshrenderer.h"
+#include "subdivision/viewdependentrefiner.h"
 
 /**
  * @brief The MainView class represents the main view of the UI. It handles and
@@ -24,6 +25,8 @@ class MainView : public QOpenGLWidget, protected QOpenGLFunctions_4_1_Core {
   void updateMatrices();
   void updateUniforms();
   void updateBuffers(Mesh& mesh);
+  void setViewDependentRefiner(ViewDependentRefiner* refiner);
+  void invalidateViewDependentMesh();
 
  protected:
   void initializeGL() override;
@@ -37,6 +40,7 @@ class MainView : public QOpenGLWidget, protected QOpenGLFunctions_4_1_Core {
 
  private:
   QVector2D toNormalizedScreenCoordinates(float x, float y);
+  void updateViewDependentMesh();
 
   QOpenGLDebugLogger debugLogger;
 
@@ -48,10 +52,19 @@ class MainView : public QOpenGLWidget, protected QOpenGLFunctions_4_1_Core {
 
   MeshRenderer meshRenderer;
 
+  // Refines the mesh for the current view, owned by MainWindow
+  ViewDependentRefiner* viewRefiner = nullptr;
+  bool viewRefinementRequired = false;
+  bool viewBuffersRequired = false;
+
   Settings settings;
 
   // we make mainwindow a friend so it can access settings
   friend class MainWindow;
+ signals:
+  // Emitted whenever the model-view or projection matrix changed
+  void viewChanged();
+
  private slots:
   void onMessageLogged(QOpenGLDebugMessage Message);
 };
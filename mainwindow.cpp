@@ -1,19 +1,30 @@
 #include "mainwindow.h"
 
+#include <math.h>
+
 #include "initialization/meshinitializer.h"
 #include "initialization/objfile.h"
+#include "mesh/meshvalidator.h"
+#include "subdivision/adaptiveloopsubdivider.h"
 #include "subdivision/loopsubdivider.h"
+#include "subdivision/looptopologygenerator.h"
+#include "subdivision/sqrt3subdivider.h"
 #include "ui_mainwindow.h"
+#include "util/trace.h"
+#include "util/util.h"
 #include <QRadioButton>
 #include <QButtonGroup>
+#include <QDebug>
 
 /**
  * @brief MainWindow::MainWindow Creates a new Main Window UI.
  * @param parent Qt parent widget.
  */
 MainWindow::MainWindow(QWidget* parent)
-    : QMainWindow(parent), ui(new Ui::MainWindow) {
+    : QMainWindow(parent), ui(new Ui::MainWindow), subdivider(new LoopSubdivider()), viewRefiner(nullptr),
+      adaptiveLevel(-1), refining(false), meshGeneration(0), meshRadius(0.0), meshEdgeLength(0.0) {
     ui->setupUi(this);
+    refinementPool.setMaxThreadCount(1);
 
     // Initialize value
     ui->MainDisplay->settings.isoFrequency = 1 + ui->IsoSpinBox->maximum() - ui->IsoSpinBox->value();
@@ -40,13 +51,20 @@ MainWindow::MainWindow(QWidget* parent)
     // Connect the button group signal to a slot
     connect(buttonGroup, SIGNAL(buttonClicked(QAbstractButton*)), this, SLOT(on_AveragingBox_clicked(QAbstractButton*)));
 
+    // Pick the level again whenever the camera moves
+    connect(ui->MainDisplay, SIGNAL(viewChanged()), this, SLOT(onViewChanged()));
+    connect(ui->MainDisplay, SIGNAL(frameSwapped()), this, SLOT(onFrameSwapped()));
+
 }
 
 /**
  * @brief MainWindow::~MainWindow Deconstructs the main window.
  */
 MainWindow::~MainWindow() {
+    waitForRefinement();
     delete ui;
+    delete subdivider;
+    delete viewRefiner;
 
     meshes.clear();
     meshes.squeeze();
@@ -54,18 +72,28 @@ MainWindow::~MainWindow() {
 
 /**
  * @brief MainWindow::importOBJ Imports an obj file and adds the constructed
- * half-edge to the collection of meshes.
+ * half-edge to the collection of meshes. The connectivity is validated first;
+ * meshes with defects are still loaded but subdivided with the checked
+ * neighbourhood gathers.
  * @param fileName Path of the .obj file.
  */
 void MainWindow::importOBJ(const QString& fileName) {
     OBJFile newModel = OBJFile(fileName);
+    waitForRefinement();
+    meshGeneration++;
     meshes.clear();
     meshes.squeeze();
+    adaptiveLevel = -1;
 
     if (newModel.loadedSuccessfully()) {
         MeshInitializer meshInitializer;
         meshes.append(meshInitializer.constructHalfEdgeMesh(newModel));
+        validateMesh(meshes[0]);
         meshes[0].setBaseMesh(true);
+        computeMeshBounds();
+        if (ui->MainDisplay->settings.limitSurface) {
+            subdivider->evaluateLimit(meshes[0]);
+        }
         ui->MainDisplay->updateBuffers(meshes[0]);
         ui->MainDisplay->settings.modelLoaded = true;
     } else {
@@ -75,9 +103,276 @@ void MainWindow::importOBJ(const QString& fileName) {
     ui->MeshGroupBox->setEnabled(ui->MainDisplay->settings.modelLoaded);
     ui->IsoGroupBox->setEnabled(ui->MainDisplay->settings.modelLoaded);
     ui->SubdivSteps->setValue(0);
+    resetViewRefiner();
+    onViewChanged();
     ui->MainDisplay->update();
 }
 
+/**
+ * @brief MainWindow::validateMesh Validates the connectivity of the provided
+ * mesh and reports any defect.
+ * @param mesh The mesh to validate.
+ */
+void MainWindow::validateMesh(Mesh& mesh) {
+    MeshValidator validator;
+    int defects = validator.validate(mesh);
+    for (const QString& defect : MeshValidator::describe(defects)) {
+        qDebug() << "Invalid mesh topology:" << defect;
+    }
+}
+
+/**
+ * @brief MainWindow::requiredAttributes Determines which attributes the
+ * current settings display, so that only those are subdivided.
+ * @return The RefinementAttribute flags needed to draw the current mesh.
+ */
+int MainWindow::requiredAttributes() const {
+    const Settings& settings = ui->MainDisplay->settings;
+    int attributes = REFINE_GEOMETRY;
+    if (settings.subdivisionShading || settings.blendNormals) {
+        attributes |= refinementFlag(settings.currentSubdivShadingAvgMethod);
+    }
+    if (settings.blendNormals || settings.currentShader == BLEND_WEIGHTS) {
+        attributes |= REFINE_BLEND_WEIGHTS;
+    }
+    return attributes;
+}
+
+/**
+ * @brief MainWindow::ensureAttributes Computes the attributes the current
+ * settings need but that were skipped when the levels up to and including the
+ * provided level were subdivided. Walks from the base level, since every level
+ * is refined from the one before it.
+ * @param level The subdivision level that is about to be displayed.
+ */
+void MainWindow::ensureAttributes(int level) {
+    int attributes = requiredAttributes();
+    for (int k = 1; k <= level; k++) {
+        int missing = attributes & ~meshes[k].refinedAttributes;
+        if (missing) {
+            waitForRefinement();
+            restoreConnectivity(k - 1);
+            restoreConnectivity(k);
+            subdivider->refineAttributes(meshes[k - 1], meshes[k], missing);
+        }
+    }
+}
+
+/**
+ * @brief MainWindow::restoreConnectivity Regenerates the half-edges and faces
+ * of a level whose connectivity was released, see releaseCachedLevels.
+ * @param level The subdivision level.
+ */
+void MainWindow::restoreConnectivity(int level) {
+    if (!meshes[level].hasConnectivity()) {
+        waitForRefinement();
+        LoopTopologyGenerator(meshes[0], level).restore(meshes[level]);
+    }
+}
+
+/**
+ * @brief MainWindow::releaseCachedLevels In the implicit topology mode, only
+ * keeps the vertex data of the cached levels. The base mesh and the displayed
+ * level keep their connectivity. The topology generator only knows the Loop
+ * connectivity, so the sqrt(3) levels are always kept whole. The finest level
+ * is kept whole while the next level is subdivided from it in the background.
+ */
+void MainWindow::releaseCachedLevels() {
+    const Settings& settings = ui->MainDisplay->settings;
+    if (!settings.implicitTopology || settings.sqrt3Subdivision) {
+        return;
+    }
+    int level = ui->SubdivSteps->value();
+    int finest = refining ? meshes.size() - 1 : meshes.size();
+    for (int k = 1; k < meshes.size(); k++) {
+        if (k != level && k != finest && meshes[k].hasConnectivity()) {
+            meshes[k].releaseConnectivity();
+        }
+    }
+}
+
+/**
+ * @brief MainWindow::resetViewRefiner Replaces the view-dependent refiner by
+ * one for the current base mesh, or removes it if view-dependent refinement is
+ * off. The refiner caches the positions of the base mesh it was made for.
+ */
+void MainWindow::resetViewRefiner() {
+    ui->MainDisplay->setViewDependentRefiner(nullptr);
+    delete viewRefiner;
+    viewRefiner = nullptr;
+    if (ui->MainDisplay->settings.viewDependent && ui->MainDisplay->settings.modelLoaded) {
+        viewRefiner = new ViewDependentRefiner(meshes[0]);
+        ui->MainDisplay->setViewDependentRefiner(viewRefiner);
+    }
+}
+
+/**
+ * @brief MainWindow::computeMeshBounds Computes the bounding sphere and the
+ * mean edge length of the base mesh, from which the automatic level mode
+ * estimates the length of the edges on screen.
+ */
+void MainWindow::computeMeshBounds() {
+    Mesh& mesh = meshes[0];
+    const QVector<Vertex>& vertices = mesh.getVertices();
+    const QVector<HalfEdge>& halfEdges = mesh.getHalfEdges();
+    QVector3D minCoords = vertices.isEmpty() ? QVector3D() : vertices[0].coords;
+    QVector3D maxCoords = minCoords;
+    for (const Vertex& vertex : vertices) {
+        for (int i = 0; i < 3; ++i) {
+            minCoords[i] = qMin(minCoords[i], vertex.coords[i]);
+            maxCoords[i] = qMax(maxCoords[i], vertex.coords[i]);
+        }
+    }
+    meshCenter = (minCoords + maxCoords) / 2.0;
+    meshRadius = (maxCoords - minCoords).length() / 2.0;
+
+    float totalLength = 0.0;
+    int numEdges = 0;
+    for (int h : mesh.getEdgeHalfEdges()) {
+        if (h >= 0) {
+            totalLength += (halfEdges[h].next->origin->coords - halfEdges[h].origin->coords).length();
+            numEdges++;
+        }
+    }
+    meshEdgeLength = numEdges > 0 ? totalLength / numEdges : 0.0;
+}
+
+/**
+ * @brief MainWindow::screenSpaceLevel Estimates the coarsest level whose edges
+ * are at most Settings::autoLevelPixels long on screen, at the point of the
+ * mesh closest to the camera. Every Loop step halves the edges, every sqrt(3)
+ * step divides them by sqrt(3). Close up, the level is limited so that the
+ * mesh has no more faces than the viewport can show at that edge length.
+ * @return The level, at most the maximum of the steps box.
+ */
+int MainWindow::screenSpaceLevel() {
+    const Settings& settings = ui->MainDisplay->settings;
+    float ratio = ui->MainDisplay->devicePixelRatio();
+    int viewportWidth = int(ui->MainDisplay->width() * ratio);
+    int viewportHeight = int(ui->MainDisplay->height() * ratio);
+    float pixels = projectedLength(settings.modelViewMatrix, settings.projectionMatrix, viewportHeight,
+                                   meshCenter, meshRadius, meshEdgeLength);
+    float maxFaces = 2.0 * viewportWidth * viewportHeight / (settings.autoLevelPixels * settings.autoLevelPixels);
+
+    float factor = settings.sqrt3Subdivision ? sqrtf(3.0) : 2.0;
+    float faces = meshes[0].numFaces();
+    int level = 0;
+    while (level < ui->SubdivSteps->maximum() && pixels > settings.autoLevelPixels &&
+           faces * factor * factor <= maxFaces) {
+        pixels /= factor;
+        faces *= factor * factor;
+        level++;
+    }
+    return level;
+}
+
+/**
+ * @brief MainWindow::startRefinement Subdivides the finest cached level in the
+ * background. The finest level is completed first, so that neither the worker
+ * nor the viewer modifies it while the worker reads its copy.
+ */
+void MainWindow::startRefinement() {
+    int level = meshes.size() - 1;
+    ensureAttributes(level);
+    restoreConnectivity(level);
+    if (ui->MainDisplay->settings.limitSurface && !meshes[level].hasLimitSurface()) {
+        subdivider->evaluateLimit(meshes[level]);
+    }
+    meshes[level].extractAttributes();
+    meshes[level].getEdgeHalfEdges();
+
+    Mesh controlMesh = meshes[level];
+    const Subdivider* levelSubdivider = subdivider;
+    int attributes = requiredAttributes();
+    int generation = meshGeneration;
+    refining = true;
+    refinementPool.start([this, controlMesh, levelSubdivider, attributes, level, generation]() mutable {
+        // Moved rather than copied, so that no array of the new level is still
+        // shared with this thread once the viewer receives it
+        Mesh newMesh = levelSubdivider->subdivide(controlMesh, attributes);
+        QMetaObject::invokeMethod(
+            this,
+            [this, newMesh = std::move(newMesh), level, generation]() mutable {
+                finishRefinement(newMesh, level + 1, generation);
+            },
+            Qt::QueuedConnection);
+    });
+}
+
+/**
+ * @brief MainWindow::finishRefinement Adds a level that was subdivided in the
+ * background, unless the cached levels were replaced in the meantime, and
+ * picks the level for the current view again.
+ * @param mesh The subdivided mesh.
+ * @param level The level of the mesh.
+ * @param generation The value of meshGeneration when the refinement started.
+ */
+void MainWindow::finishRefinement(Mesh& mesh, int level, int generation) {
+    refining = false;
+    if (generation == meshGeneration && level == meshes.size()) {
+        // A copy would share its arrays with mesh, and the first non-const
+        // access would detach them while the pointers of the half-edges still
+        // point into the arrays of mesh, which are freed with the lambda
+        meshes.append(std::move(mesh));
+        validateMesh(meshes[level]);
+    }
+    onViewChanged();
+}
+
+/**
+ * @brief MainWindow::waitForRefinement Blocks until the background refinement,
+ * if any, is done, before the cached levels are modified. Its result is
+ * delivered to finishRefinement afterwards.
+ */
+void MainWindow::waitForRefinement() {
+    if (refining) {
+        refinementPool.waitForDone();
+    }
+}
+
+/**
+ * @brief MainWindow::onFrameSwapped Prints the trace messages recorded while
+ * the frame was drawn. The OpenMP workers are idle between frames, but the
+ * background refinement may still be recording, and entries it overwrites
+ * during a flush come out garbled. Its messages are printed after the first
+ * frame once it finished.
+ */
+void MainWindow::onFrameSwapped() {
+    if (!refining) {
+        TRACE_FLUSH();
+    }
+}
+
+/**
+ * @brief MainWindow::updateMeshBuffers Uploads the mesh of the selected level,
+ * refining any attribute it is still missing first. With view-dependent
+ * refinement, the refined mesh is uploaded again instead. With adaptive
+ * refinement, the base mesh is refined adaptively up to the selected level.
+ */
+void MainWindow::updateMeshBuffers() {
+    if (viewRefiner != nullptr) {
+        ui->MainDisplay->invalidateViewDependentMesh();
+        return;
+    }
+    int level = ui->SubdivSteps->value();
+    if (ui->MainDisplay->settings.adaptive) {
+        if (adaptiveLevel != level) {
+            adaptiveMesh = AdaptiveLoopSubdivider(level).subdivide(meshes[0]);
+            validateMesh(adaptiveMesh);
+            adaptiveLevel = level;
+        }
+        ui->MainDisplay->updateBuffers(adaptiveMesh);
+        return;
+    }
+    ensureAttributes(level);
+    restoreConnectivity(level);
+    if (ui->MainDisplay->settings.limitSurface && !meshes[level].hasLimitSurface()) {
+        subdivider->evaluateLimit(meshes[level]);
+    }
+    ui->MainDisplay->updateBuffers(meshes[level]);
+    releaseCachedLevels();
+}
+
 // Don't worry about adding documentation for the UI-related functions.
 
 void MainWindow::on_LoadOBJ_pressed() {
@@ -92,12 +387,15 @@ void MainWindow::on_MeshPresetComboBox_currentTextChanged(
 }
 
 void MainWindow::on_SubdivSteps_valueChanged(int value) {
-    Subdivider* subdivider = new LoopSubdivider();
-    for (int k = meshes.size() - 1; k < value; k++) {
-        meshes.append(subdivider->subdivide(meshes[k]));
+    waitForRefinement();
+    int attributes = requiredAttributes();
+    // Adaptive refinement does not need the uniform levels
+    for (int k = meshes.size() - 1; k < value && !ui->MainDisplay->settings.adaptive; k++) {
+        restoreConnectivity(k);
+        meshes.append(subdivider->subdivide(meshes[k], attributes));
+        validateMesh(meshes[k + 1]);
     }
-    ui->MainDisplay->updateBuffers(meshes[value]);
-    delete subdivider;
+    updateMeshBuffers();
 }
 
 void MainWindow::on_SubdivisionShadingCheckBox_toggled(bool checked) {
@@ -111,7 +409,7 @@ void MainWindow::on_SubdivisionShadingCheckBox_toggled(bool checked) {
 
     ui->SubdivisionShadingBox->setEnabled(checked);
 
-    ui->MainDisplay->updateBuffers(meshes[ui->SubdivSteps->value()]);
+    updateMeshBuffers();
     ui->MainDisplay->update();
 }
 
@@ -200,6 +498,9 @@ void MainWindow::on_ShadingRadioBlendWeights_toggled(bool checked) {
     if (checked) {
         ui->MainDisplay->settings.currentShader = BLEND_WEIGHTS;
         ui->MainDisplay->settings.uniformUpdateRequired = true;
+        if (ui->MainDisplay->settings.modelLoaded) {
+            updateMeshBuffers();
+        }
     } else {
         if (ui->ShadingRadioPhong->isChecked()) {
             ui->MainDisplay->settings.currentShader = PHONG;
@@ -227,13 +528,13 @@ void MainWindow::on_AveragingBox_clicked(QAbstractButton *button)
     {
         ui->MainDisplay->settings.currentSubdivShadingAvgMethod = SPHERICAL;
     }
-    ui->MainDisplay->updateBuffers(meshes[ui->SubdivSteps->value()]);
+    updateMeshBuffers();
     ui->MainDisplay->update();
 }
 
 void MainWindow::on_blendNormalsBox_toggled(bool checked) {
     ui->MainDisplay->settings.blendNormals = checked;
-    ui->MainDisplay->updateBuffers(meshes[ui->SubdivSteps->value()]);
+    updateMeshBuffers();
     ui->MainDisplay->update();
 }
 
@@ -246,12 +547,107 @@ void MainWindow::on_butterflyBox_toggled(bool checked) {
         ui->MainDisplay->settings.currentSubdivShadingAvgMethod = (ui->LinearAveragingRadioButton->isChecked()) ? LINEAR : SPHERICAL;
     }
 
-    ui->MainDisplay->updateBuffers(meshes[ui->SubdivSteps->value()]);
+    updateMeshBuffers();
+    ui->MainDisplay->update();
+}
+
+void MainWindow::on_limitSurfaceBox_toggled(bool checked) {
+    ui->MainDisplay->settings.limitSurface = checked;
+    updateMeshBuffers();
+    ui->MainDisplay->update();
+}
+
+void MainWindow::on_implicitTopologyBox_toggled(bool checked) {
+    ui->MainDisplay->settings.implicitTopology = checked;
+    if (ui->MainDisplay->settings.modelLoaded) {
+        releaseCachedLevels();
+    }
+}
+
+void MainWindow::on_sqrt3Box_toggled(bool checked) {
+    ui->MainDisplay->settings.sqrt3Subdivision = checked;
+    ui->viewDependentBox->setEnabled(!checked);
+    ui->adaptiveBox->setEnabled(!checked);
+    waitForRefinement();
+    delete subdivider;
+    if (checked) {
+        subdivider = new Sqrt3Subdivider();
+    } else {
+        subdivider = new LoopSubdivider();
+    }
+
+    if (ui->MainDisplay->settings.modelLoaded) {
+        // The cached levels and the limit surface of the base mesh belong to
+        // the other scheme
+        meshGeneration++;
+        meshes.resize(1);
+        meshes[0].invalidateLimit();
+        if (ui->MainDisplay->settings.limitSurface) {
+            subdivider->evaluateLimit(meshes[0]);
+        }
+        on_SubdivSteps_valueChanged(ui->SubdivSteps->value());
+        ui->MainDisplay->update();
+    }
+}
+
+void MainWindow::on_viewDependentBox_toggled(bool checked) {
+    ui->MainDisplay->settings.viewDependent = checked;
+    // The refiner always uses Loop subdivision and picks its own levels
+    ui->SubdivSteps->setEnabled(!checked && !ui->MainDisplay->settings.autoLevel);
+    ui->sqrt3Box->setEnabled(!checked);
+    ui->adaptiveBox->setEnabled(!checked);
+    resetViewRefiner();
+    if (!checked && ui->MainDisplay->settings.modelLoaded) {
+        updateMeshBuffers();
+        onViewChanged();
+    }
+    ui->MainDisplay->update();
+}
+
+void MainWindow::on_adaptiveBox_toggled(bool checked) {
+    ui->MainDisplay->settings.adaptive = checked;
+    // The adaptive subdivider always uses Loop subdivision
+    ui->sqrt3Box->setEnabled(!checked);
+    ui->viewDependentBox->setEnabled(!checked);
+    if (!checked) {
+        adaptiveMesh = Mesh();
+        adaptiveLevel = -1;
+    }
+    if (ui->MainDisplay->settings.modelLoaded) {
+        on_SubdivSteps_valueChanged(ui->SubdivSteps->value());
+    }
     ui->MainDisplay->update();
 }
 
+void MainWindow::on_autoLevelBox_toggled(bool checked) {
+    ui->MainDisplay->settings.autoLevel = checked;
+    ui->SubdivSteps->setEnabled(!checked && !ui->MainDisplay->settings.viewDependent);
+    onViewChanged();
+}
+
 void MainWindow::on_IsoSpinBox_valueChanged(int value) {
     ui->MainDisplay->settings.isoFrequency = 1 + ui->IsoSpinBox->maximum() - value;
     ui->MainDisplay->settings.uniformUpdateRequired = true;
     ui->MainDisplay->update();
 }
+
+void MainWindow::onViewChanged() {
+    const Settings& settings = ui->MainDisplay->settings;
+    if (!settings.autoLevel || !settings.modelLoaded || viewRefiner != nullptr) {
+        return;
+    }
+
+    // Show the coarsest level that is fine enough, or the finest cached level
+    // while the levels up to it are subdivided in the background. Adaptive
+    // refinement starts from the base mesh, so it needs no cached levels.
+    int target = screenSpaceLevel();
+    int level = settings.adaptive ? target : qMin(target, int(meshes.size()) - 1);
+    if (target > level && !refining) {
+        startRefinement();
+    }
+    if (level != ui->SubdivSteps->value()) {
+        QSignalBlocker blocker(ui->SubdivSteps);
+        ui->SubdivSteps->setValue(level);
+        updateMeshBuffers();
+    }
+}
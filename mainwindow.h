@@ -3,9 +3,11 @@
 
 #include <QFileDialog>
 #include <QMainWindow>
+#include <QThreadPool>
 
 #include "mesh/mesh.h"
 #include "subdivision/subdivider.h"
+#include "subdivision/viewdependentrefiner.h"
 #include "ui_mainwindow.h"
 
 namespace Ui {
@@ -35,14 +37,51 @@ class MainWindow : public QMainWindow {
   void on_AveragingBox_clicked(QAbstractButton *button);
   void on_blendNormalsBox_toggled(bool checked);
   void on_butterflyBox_toggled(bool checked);
+  void on_limitSurfaceBox_toggled(bool checked);
+  void on_implicitTopologyBox_toggled(bool checked);
+  void on_sqrt3Box_toggled(bool checked);
+  void on_viewDependentBox_toggled(bool checked);
+  void on_adaptiveBox_toggled(bool checked);
+  void on_autoLevelBox_toggled(bool checked);
   void on_IsoSpinBox_valueChanged(int value);
+  void onViewChanged();
+  void onFrameSwapped();
 
  private:
   void importOBJ(const QString &fileName);
+  void validateMesh(Mesh &mesh);
+  int requiredAttributes() const;
+  void ensureAttributes(int level);
+  void updateMeshBuffers();
+  void restoreConnectivity(int level);
+  void releaseCachedLevels();
+  void resetViewRefiner();
+  void computeMeshBounds();
+  int screenSpaceLevel();
+  void startRefinement();
+  void finishRefinement(Mesh &mesh, int level, int generation);
+  void waitForRefinement();
 
   Ui::MainWindow *ui;
   Subdivider *subdivider;
+  ViewDependentRefiner *viewRefiner;
   QVector<Mesh> meshes;
+  // The adaptively refined base mesh and the level it was refined to, -1 if
+  // it has to be refined again
+  Mesh adaptiveMesh;
+  int adaptiveLevel;
+
+  // Subdivides the next level in the background in the automatic level mode
+  QThreadPool refinementPool;
+  bool refining;
+  // Changes whenever the cached levels are discarded, so that results of
+  // background refinement for the old levels are dropped
+  int meshGeneration;
+
+  // Bounding sphere and mean edge length of the base mesh
+  QVector3D meshCenter;
+  float meshRadius;
+  float meshEdgeLength;
 };
 
 #endif  // MAINWINDOW_H
@@ -1,9 +1,13 @@
 #include "mesh.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <math.h>
 
+#include <algorithm>
+
 #include <QDebug>
+#include <QVarLengthArray>
 
 /**
  * @brief Mesh::Mesh Initializes an empty mesh.
@@ -39,75 +43,458 @@ void Mesh::setBaseMesh(bool value) {
 
         // Set the blend weights
         computeBaseBlendWeights();
+
+        refinedAttributes = REFINE_ALL;
     }
 }
 
+/**
+ * @brief cornerNormal Computes the contribution of the face corner at the
+ * origin of the provided half-edge to the normal of that vertex.
+ * @param edge The half-edge whose origin is the corner.
+ * @return The angle-weighted face normal.
+ */
+static QVector3D cornerNormal(const HalfEdge& edge) {
+    QVector3D pPrev = edge.prev->origin->coords;
+    QVector3D pCur = edge.origin->coords;
+    QVector3D pNext = edge.next->origin->coords;
+
+    QVector3D edgeA = (pPrev - pCur);
+    QVector3D edgeB = (pNext - pCur);
+
+    double edgeLengths = edgeA.length() * edgeB.length();
+    double edgeDot = QVector3D::dotProduct(edgeA, edgeB) / edgeLengths;
+    double angle = sqrt(1 - edgeDot * edgeDot);
+
+    return (angle * edge.face->normal) / edgeLengths;
+}
+
+/**
+ * @brief vertexNormal Sums the corner normals around a vertex.
+ * @param vertex The vertex, which must have an outgoing half-edge.
+ * @param validated Whether the connectivity passed MeshValidator.
+ * @param maxSteps Bound on the ring walks of unvalidated meshes.
+ * @return The unit vertex normal.
+ */
+static QVector3D vertexNormal(const Vertex& vertex, bool validated, int maxSteps) {
+    // Start at the outgoing boundary half-edge, if any, so that walking
+    // the corners in prev->twin order reaches all of them
+    HalfEdge* start = vertex.out;
+    int steps = 0;
+    if (validated) {
+        start = vertex.isBoundaryVertex() ? vertex.nextBoundaryHalfEdge() : vertex.out;
+    } else {
+        while (start->twin != nullptr && start->twin->next != vertex.out && ++steps < maxSteps) {
+            start = start->twin->next;
+        }
+        start = start->twin == nullptr ? start : vertex.out;
+    }
+
+    QVector3D normal;
+    HalfEdge* edge = start;
+    steps = 0;
+    do {
+        normal += cornerNormal(*edge);
+        edge = edge->prev->twin;
+    } while (edge != nullptr && edge != start && ++steps < maxSteps);
+
+    return normal.normalized();
+}
+
 /**
  * @brief Mesh::computeBaseNormals Computes the face and vertex normals with an
- * angle-weighted average of incident faces normals.
+ * angle-weighted average of incident faces normals. Every vertex gathers the
+ * corners around it, so the vertices can be processed in parallel and the
+ * result does not depend on the number of threads.
  */
 void Mesh::computeBaseNormals() {
+    Face* faceData = faces.data();
+    Vertex* vertexData = vertices.data();
+
+    #pragma omp parallel for
     for (int f = 0; f < numFaces(); f++) {
-        faces[f].recalculateNormal();
+        faceData[f].recalculateNormal();
+    }
+
+    vertexNormals.resize(numVerts());
+    QVector3D* normals = vertexNormals.data();
+
+    // Unvalidated meshes may have rings that do not close, so the walks are
+    // bounded by the number of half-edges
+    int maxSteps = numHalfEdges();
+
+    #pragma omp parallel for
+    for (int v = 0; v < numVerts(); ++v) {
+        const Vertex& vertex = vertexData[v];
+        normals[v] = vertex.out == nullptr ? QVector3D() : vertexNormal(vertex, validated, maxSteps);
     }
 
-    vertexNormals.clear();
-    vertexNormals.fill({0, 0, 0}, numVerts());
+    baseNormalsDirty = false;
+    invalidateBlendedNormals(REFINE_BLEND_WEIGHTS);
+}
+
+/**
+ * @brief Mesh::updateGeometry Updates the arrays derived from the vertex
+ * positions after some of the vertices moved, at a cost proportional to the
+ * number of moved vertices rather than the size of the mesh. The normals of
+ * the faces around the moved vertices and the base normals of the vertices of
+ * those faces are recomputed, as are the vertex coordinates buffer and the
+ * blended normals, as far as they are up to date. A base mesh copies its new
+ * base normals to its subdivided normals, like setBaseMesh. The connectivity
+ * is left untouched; the limit surface is updated by LoopSubdivider::updateLimit.
+ * @param moved The vertices that moved, sorted ascending.
+ * @return The vertices whose base normal changed, sorted ascending.
+ */
+QVector<int> Mesh::updateGeometry(const QVector<int>& moved) {
+    assert(hasConnectivity());
+    const QVector<Vertex>& constVertices = vertices;
+    int maxSteps = numHalfEdges();
 
-    // normal computation
-    for (int h = 0; h < numHalfEdges(); ++h) {
-        HalfEdge* edge = &halfEdges[h];
-        QVector3D pPrev = edge->prev->origin->coords;
-        QVector3D pCur = edge->origin->coords;
-        QVector3D pNext = edge->next->origin->coords;
+    QVector<int> movedFaces;
+    QVector<int> changed = moved;
+    for (const HalfEdge* edge : outgoingHalfEdges(moved)) {
+        movedFaces.append(edge->faceIdx());
+        for (HalfEdge* corner = edge->next; corner != edge; corner = corner->next) {
+            changed.append(corner->origin->index);
+        }
+    }
+    std::sort(movedFaces.begin(), movedFaces.end());
+    movedFaces.erase(std::unique(movedFaces.begin(), movedFaces.end()), movedFaces.end());
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
 
-        QVector3D edgeA = (pPrev - pCur);
-        QVector3D edgeB = (pNext - pCur);
+    if (baseNormalsDirty) {
+        computeBaseNormals();
+    } else {
+        Face* faceData = faces.data();
+        QVector3D* normals = vertexNormals.data();
+        const int* faceIndices = movedFaces.constData();
+        const int* vertexIndices = changed.constData();
 
-        double edgeLengths = edgeA.length() * edgeB.length();
-        double edgeDot = QVector3D::dotProduct(edgeA, edgeB) / edgeLengths;
-        double angle = sqrt(1 - edgeDot * edgeDot);
+        #pragma omp parallel for
+        for (int i = 0; i < movedFaces.size(); i++) {
+            faceData[faceIndices[i]].recalculateNormal();
+        }
 
-        vertexNormals[edge->origin->index] +=
-            (angle * edge->face->normal) / edgeLengths;
+        #pragma omp parallel for
+        for (int i = 0; i < changed.size(); i++) {
+            const Vertex& vertex = constVertices[vertexIndices[i]];
+            normals[vertex.index] = vertex.out == nullptr ? QVector3D() : vertexNormal(vertex, validated, maxSteps);
+        }
     }
 
+    if (isBaseMesh) {
+        for (int subdivType = LINEAR; subdivType <= BUTTERFLY; ++subdivType) {
+            SubdivisionShaderType type = static_cast<SubdivisionShaderType>(subdivType);
+            if (!vertexNormalsSubdivided.contains(type)) {
+                continue;
+            }
+            QVector<QVector3D>& subdivided = vertexNormalsSubdivided[type];
+            for (int v : changed) {
+                subdivided[v] = vertexNormals[v];
+            }
+        }
+    }
+
+    if (!buffersDirty) {
+        for (int v : moved) {
+            vertexCoords[v] = constVertices[v].coords;
+        }
+    }
+
+    updateBlendedNormals(changed);
+    return changed;
+}
+
+/**
+ * @brief Mesh::outgoingHalfEdges Lists the half-edges that originate from any
+ * of the given vertices. The fans of a validated mesh reach every half-edge of
+ * a vertex, so they are walked, see Vertex::outgoingHalfEdges. A vertex of any
+ * other mesh may have several fans, for example around a non-manifold edge, so
+ * then all the half-edges are scanned instead.
+ * @param sortedVertices The vertices, sorted ascending.
+ * @return The half-edges that originate from the vertices.
+ */
+QVector<const HalfEdge*> Mesh::outgoingHalfEdges(const QVector<int>& sortedVertices) {
+    const QVector<Vertex>& constVertices = vertices;
+    const QVector<HalfEdge>& constHalfEdges = halfEdges;
+    QVector<const HalfEdge*> edges;
+    if (validated) {
+        int maxSteps = numHalfEdges();
+        for (int v : sortedVertices) {
+            QVarLengthArray<HalfEdge*, 16> fan;
+            constVertices[v].outgoingHalfEdges(fan, maxSteps);
+            for (HalfEdge* edge : fan) {
+                edges.append(edge);
+            }
+        }
+    } else {
+        for (const HalfEdge& edge : constHalfEdges) {
+            if (std::binary_search(sortedVertices.constBegin(), sortedVertices.constEnd(), edge.origin->index)) {
+                edges.append(&edge);
+            }
+        }
+    }
+    return edges;
+}
+
+/**
+ * @brief Mesh::invalidateGeometry Marks every array derived from the vertex
+ * positions or the connectivity as stale, so that it is recomputed the next
+ * time it is requested. Call this after modifying the vertices or faces.
+ */
+void Mesh::invalidateGeometry() {
+    baseNormalsDirty = true;
+    buffersDirty = true;
+    edgeHalfEdgesDirty = true;
+    limitDirty = true;
+    invalidateBlendedNormals(REFINE_BLEND_WEIGHTS);
+}
+
+/**
+ * @brief Mesh::releaseConnectivity Frees the half-edges and faces, keeping the
+ * vertex positions and every per-vertex attribute. The vertices lose their
+ * outgoing half-edge. Subdivided Loop meshes can get their connectivity back
+ * with LoopTopologyGenerator::restore.
+ */
+void Mesh::releaseConnectivity() {
+    halfEdges = QVector<HalfEdge>();
+    faces = QVector<Face>();
+    edgeHalfEdges = QVector<int>();
+    polyIndices = QVector<unsigned int>();
+    vertexCoords = QVector<QVector3D>();
+
+    Vertex* vertexData = vertices.data();
+    #pragma omp parallel for
     for (int v = 0; v < numVerts(); ++v) {
-        vertexNormals[v].normalize();
+        vertexData[v].out = nullptr;
     }
+
+    buffersDirty = true;
+    edgeHalfEdgesDirty = true;
+    connectivityReleased = true;
 }
 
-void Mesh::computeBaseBlendWeights() {
-    QVector<Vertex> vertices = getVertices();
+/**
+ * @brief Mesh::invalidateBlendedNormals Marks the blended normals that depend
+ * on the provided attributes as stale.
+ * @param attributes RefinementAttribute flags of the attributes that changed.
+ * Since every blended normal depends on the blend weights, REFINE_BLEND_WEIGHTS
+ * invalidates all of them.
+ */
+void Mesh::invalidateBlendedNormals(int attributes) {
+    if (attributes & REFINE_BLEND_WEIGHTS) {
+        attributes |= REFINE_LINEAR | REFINE_SPHERICAL | REFINE_BUTTERFLY;
+    }
+    blendedNormalsDirty |= attributes & (REFINE_LINEAR | REFINE_SPHERICAL | REFINE_BUTTERFLY);
+}
 
-    vertexBlendWeights.clear();
-    vertexBlendWeights.fill(0.0, numVerts());
+/**
+ * @brief Mesh::updateBlendedNormals Recomputes the blended normals of the
+ * provided vertices, after their base normals, subdivided normals or blend
+ * weights changed. Blended normals that are stale anyway are skipped.
+ * @param changed The vertices to update.
+ */
+void Mesh::updateBlendedNormals(const QVector<int>& changed) {
+    for (int subdivType = LINEAR; subdivType <= BUTTERFLY; ++subdivType) {
+        SubdivisionShaderType type = static_cast<SubdivisionShaderType>(subdivType);
+        if ((blendedNormalsDirty & refinementFlag(type)) || !blendedNormals.contains(type)) {
+            continue;
+        }
+        QVector<QVector3D>& blended = blendedNormals[type];
+        const QVector<QVector3D>& subdivided = vertexNormalsSubdivided[type];
+        for (int v : changed) {
+            float weight = blendWeights.weight(v);
+            blended[v] = weight == 0.0f ? vertexNormals[v] : weight * subdivided[v] + (1.0 - weight) * vertexNormals[v];
+        }
+    }
+}
 
+/**
+ * @brief Mesh::computeBaseBlendWeights Gives the extraordinary vertices (the
+ * ones with a valence other than 6) a blend weight of 1 and all others 0.
+ */
+void Mesh::computeBaseBlendWeights() {
+    SparseVertexWeights weights;
     for (int v = 0; v < numVerts(); ++v) {
         if (vertices[v].valence != 6) {
-            vertexBlendWeights[v] = 1.0;
+            weights.indices.append(v);
+            weights.values.append(1.0);
+        }
+    }
+
+    setSparseBlendWeights(weights);
+}
+
+/**
+ * @brief SparseVertexWeights::weight Looks up the weight of a vertex.
+ * @param v The index of the vertex.
+ * @return The weight, 0 if the vertex is not in the support.
+ */
+float SparseVertexWeights::weight(int v) const {
+    auto it = std::lower_bound(indices.constBegin(), indices.constEnd(), v);
+    if (it == indices.constEnd() || *it != v) {
+        return 0.0;
+    }
+    return values[it - indices.constBegin()];
+}
+
+/**
+ * @brief Mesh::setSparseBlendWeights Replaces the blend weights.
+ * @param blendWeights The non-zero blend weights, sorted by vertex index.
+ */
+void Mesh::setSparseBlendWeights(const SparseVertexWeights& blendWeights) {
+    this->blendWeights = blendWeights;
+    denseBlendWeightsDirty = true;
+    invalidateBlendedNormals(REFINE_BLEND_WEIGHTS);
+}
+
+/**
+ * @brief Mesh::updateBlendWeights Replaces the blend weights of some of the
+ * vertices, keeping all others. The dense weights are patched if they are up
+ * to date. The blended normals are not updated, see updateBlendedNormals.
+ * @param changed The vertices whose weight is replaced, sorted ascending.
+ * @param weights The new weights of those vertices.
+ */
+void Mesh::updateBlendWeights(const QVector<int>& changed, const QVector<float>& weights) {
+    // Merge the two sorted lists, dropping the weights that became 0
+    SparseVertexWeights merged;
+    int i = 0;
+    int j = 0;
+    while (i < blendWeights.indices.size() || j < changed.size()) {
+        int current = i < blendWeights.indices.size() ? blendWeights.indices[i] : INT_MAX;
+        if (j < changed.size() && changed[j] <= current) {
+            if (weights[j] != 0.0f) {
+                merged.indices.append(changed[j]);
+                merged.values.append(weights[j]);
+            }
+            i += changed[j] == current ? 1 : 0;
+            j++;
+        } else {
+            merged.indices.append(current);
+            merged.values.append(blendWeights.values[i]);
+            i++;
+        }
+    }
+    blendWeights = merged;
+
+    if (!denseBlendWeightsDirty && vertexBlendWeights.size() == numVerts()) {
+        for (int k = 0; k < changed.size(); ++k) {
+            vertexBlendWeights[changed[k]] = weights[k];
+        }
+    }
+}
+
+/**
+ * @brief Mesh::setBlendWeights Replaces the blend weights by the non-zero
+ * entries of the provided per-vertex weights.
+ * @param blendWeights One weight per vertex.
+ */
+void Mesh::setBlendWeights(QVector<float>& blendWeights) {
+    SparseVertexWeights weights;
+    for (int v = 0; v < blendWeights.size(); ++v) {
+        if (blendWeights[v] != 0.0f) {
+            weights.indices.append(v);
+            weights.values.append(blendWeights[v]);
+        }
+    }
+
+    setSparseBlendWeights(weights);
+}
+
+/**
+ * @brief Mesh::getBlendWeights Retrieves one blend weight per vertex, e.g. to
+ * upload to the GPU. Expanded from the sparse weights when they changed.
+ * @return The blend weights.
+ */
+QVector<float>& Mesh::getBlendWeights() {
+    if (denseBlendWeightsDirty || vertexBlendWeights.size() != numVerts()) {
+        vertexBlendWeights.fill(0.0, numVerts());
+        for (int i = 0; i < blendWeights.indices.size(); ++i) {
+            vertexBlendWeights[blendWeights.indices[i]] = blendWeights.values[i];
         }
+        denseBlendWeightsDirty = false;
     }
+    return vertexBlendWeights;
 }
 
+/**
+ * @brief Mesh::getBlendedVertexNormals Retrieves the subdivided normals of the
+ * provided type blended with the base normals. The result is cached until the
+ * normals or blend weights it was computed from change. Only the vertices in
+ * the support of the blend weights are blended, all others keep their base
+ * normal.
+ * @param subdivType The averaging method of the subdivided normals.
+ * @return The blended normals.
+ */
 QVector<QVector3D>& Mesh::getBlendedVertexNormals(SubdivisionShaderType subdivType) {
-    blendedNormals.clear();
-    blendedNormals.fill({0.0, 0.0, 0.0}, numVerts());
+    if (baseNormalsDirty) {
+        computeBaseNormals();
+    }
 
-    for (int v = 0; v < numVerts(); ++v) {
-        blendedNormals[v] = vertexBlendWeights[v] * vertexNormalsSubdivided[subdivType][v]
-                            + (1.0 - vertexBlendWeights[v]) * vertexNormals[v];
+    QVector<QVector3D>& blended = blendedNormals[subdivType];
+    int flag = refinementFlag(subdivType);
+    if (!(blendedNormalsDirty & flag)) {
+        return blended;
+    }
+
+    QVector<QVector3D>& subdivided = vertexNormalsSubdivided[subdivType];
+    blended = vertexNormals;
+    for (int i = 0; i < blendWeights.indices.size(); ++i) {
+        int v = blendWeights.indices[i];
+        float weight = blendWeights.values[i];
+        blended[v] = weight * subdivided[v] + (1.0 - weight) * vertexNormals[v];
+    }
+
+    blendedNormalsDirty &= ~flag;
+    return blended;
+}
+
+/**
+ * @brief Mesh::sphericalIterationHistogram Summarizes how many iterations the
+ * spherical averaging needed when this mesh was subdivided.
+ * @return Entry i holds the number of vertices that took i iterations. Empty
+ * if the SPHERICAL normals of this mesh were not subdivided.
+ */
+QVector<int> Mesh::sphericalIterationHistogram() const {
+    QVector<int> histogram;
+    for (int v = 0; v < sphericalIterations.size(); ++v) {
+        int iterations = sphericalIterations[v];
+        if (iterations >= histogram.size()) {
+            histogram.resize(iterations + 1);
+        }
+        histogram[iterations]++;
     }
+    return histogram;
+}
 
-    return blendedNormals;
+/**
+ * @brief Mesh::setVertexAttribute Adds or replaces a custom per-vertex
+ * attribute that is refined along with the geometry.
+ * @param name Name of the attribute.
+ * @param channels Number of interleaved channels per vertex.
+ * @param values The values, numVerts() * channels of them.
+ */
+void Mesh::setVertexAttribute(const QString& name, int channels,
+                              const QVector<float>& values) {
+    assert(values.size() == numVerts() * channels);
+    VertexAttribute& attribute = vertexAttributes[name];
+    attribute.channels = channels;
+    attribute.values = values;
 }
 
 /**
  * @brief Mesh::extractAttributes Extracts the normals, vertex coordinates and
- * indices into easy-to-access buffers.
+ * indices into easy-to-access buffers. Buffers that are still up to date are
+ * kept, see invalidateGeometry.
  */
 void Mesh::extractAttributes() {
-    computeBaseNormals();
+    if (baseNormalsDirty) {
+        computeBaseNormals();
+    }
+    if (!buffersDirty) {
+        return;
+    }
 
     vertexCoords.clear();
     vertexCoords.reserve(vertices.size());
@@ -124,6 +511,28 @@ void Mesh::extractAttributes() {
             currentEdge = currentEdge->next;
         }
     }
+
+    buffersDirty = false;
+}
+
+/**
+ * @brief Mesh::getEdgeHalfEdges Retrieves, for every edge, the half-edge the
+ * per-edge passes of subdivision evaluate it from: the last half-edge h with
+ * h > twinIdx(). Knowing it up front lets those passes loop over the edges in
+ * parallel, even on non-manifold edges shared by more than two half-edges.
+ * @return The half-edge index of every edge.
+ */
+const QVector<int>& Mesh::getEdgeHalfEdges() {
+    if (edgeHalfEdgesDirty || edgeHalfEdges.size() != numEdges()) {
+        edgeHalfEdges.fill(-1, numEdges());
+        for (int h = 0; h < numHalfEdges(); ++h) {
+            if (h > halfEdges[h].twinIdx()) {
+                edgeHalfEdges[halfEdges[h].edgeIndex] = h;
+            }
+        }
+        edgeHalfEdgesDirty = false;
+    }
+    return edgeHalfEdges;
 }
 
 /**
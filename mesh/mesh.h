@@ -3,12 +3,35 @@
 
 #include <QVector>
 #include <QMap>
+#include <QString>
 #include <QVector3D>
 #include "subdivisionshadertypes.h"
 #include "face.h"
 #include "halfedge.h"
 #include "vertex.h"
 
+/**
+ * @brief The VertexAttribute struct holds a custom per-vertex attribute (UVs,
+ * colours, ...) that is carried through subdivision. Channels are interleaved:
+ * channel c of vertex v lives at values[v * channels + c].
+ */
+struct VertexAttribute {
+  int channels = 1;
+  QVector<float> values;
+};
+
+/**
+ * @brief The SparseVertexWeights struct stores a per-vertex scalar that is zero
+ * almost everywhere, as the vertices where it is non-zero (sorted ascending)
+ * and the corresponding values.
+ */
+struct SparseVertexWeights {
+  QVector<int> indices;
+  QVector<float> values;
+
+  float weight(int v) const;
+};
+
 /**
  * @brief The Mesh class Representation of a mesh using the half-edge data
  * structure.
@@ -16,6 +39,10 @@
 class Mesh {
  public:
   Mesh();
+  Mesh(const Mesh& other) = default;
+  Mesh(Mesh&& other) = default;
+  Mesh& operator=(const Mesh& other) = default;
+  Mesh& operator=(Mesh&& other) = default;
   ~Mesh();
 
   inline QVector<Vertex>& getVertices() { return vertices; }
@@ -25,15 +52,37 @@ class Mesh {
   inline QVector<QVector3D>& getVertexCoords() { return vertexCoords; }
   inline QVector<QVector3D>& getVertexNorms() { return vertexNormals; }
   inline QVector<QVector3D>& getVertexSubdivNormals(SubdivisionShaderType type) { return vertexNormalsSubdivided[type]; }
-  inline QVector<float>& getBlendWeights() { return vertexBlendWeights; }
+  QVector<float>& getBlendWeights();
+  inline const SparseVertexWeights& getSparseBlendWeights() const { return blendWeights; }
+  inline QVector<int>& getSphericalIterations() { return sphericalIterations; }
+  QVector<int> sphericalIterationHistogram() const;
   inline QVector<unsigned int>& getPolyIndices() { return polyIndices; }
+  inline QVector<QVector3D>& getLimitCoords() { return limitCoords; }
+  inline QVector<QVector3D>& getLimitNormals() { return limitNormals; }
+  inline bool hasLimitSurface() const { return !limitDirty; }
+  inline void invalidateLimit() { limitDirty = true; }
+  const QVector<int>& getEdgeHalfEdges();
 
-  inline void setSubdividedNormals(SubdivisionShaderType type, QVector<QVector3D>& newNormals) { vertexNormalsSubdivided[type] = newNormals; }
-  inline void setBlendWeights(QVector<float>& blendWeights) { vertexBlendWeights = blendWeights; }
+  inline void setSubdividedNormals(SubdivisionShaderType type, QVector<QVector3D>& newNormals) {
+    vertexNormalsSubdivided[type] = newNormals;
+    invalidateBlendedNormals(refinementFlag(type));
+  }
+  void setBlendWeights(QVector<float>& blendWeights);
+  void setSparseBlendWeights(const SparseVertexWeights& blendWeights);
+  void updateBlendWeights(const QVector<int>& changed, const QVector<float>& weights);
+  inline QMap<QString, VertexAttribute>& getVertexAttributes() { return vertexAttributes; }
+  void setVertexAttribute(const QString& name, int channels, const QVector<float>& values);
   QVector<QVector3D>& getBlendedVertexNormals(SubdivisionShaderType type);
+  void updateBlendedNormals(const QVector<int>& changed);
 
   void extractAttributes();
   void computeBaseNormals();
+  void invalidateGeometry();
+  QVector<int> updateGeometry(const QVector<int>& moved);
+  QVector<const HalfEdge*> outgoingHalfEdges(const QVector<int>& sortedVertices);
+  void releaseConnectivity();
+  inline bool hasConnectivity() const { return !connectivityReleased; }
+  void invalidateBlendedNormals(int attributes);
 
   int numVerts();
   int numHalfEdges();
@@ -44,13 +93,43 @@ class Mesh {
   void setBaseMesh(bool value);
   void computeBaseBlendWeights();
 
+  // Set by MeshValidator once the connectivity has been checked. Must be reset
+  // whenever the connectivity changes.
+  bool validated = false;
+
+  // RefinementAttribute flags of the attributes this mesh holds
+  int refinedAttributes = 0;
+  inline bool hasAttributes(int attributes) const { return (refinedAttributes & attributes) == attributes; }
+
  private:
   QVector<QVector3D> vertexCoords;
   QVector<QVector3D> vertexNormals;
   QMap<SubdivisionShaderType, QVector<QVector3D>> vertexNormalsSubdivided;
-  QVector<QVector3D> blendedNormals;
+  QMap<SubdivisionShaderType, QVector<QVector3D>> blendedNormals;
+  // Blend weights are only non-zero around extraordinary vertices, so only
+  // that support is stored. The dense array is only built for rendering.
+  SparseVertexWeights blendWeights;
   QVector<float> vertexBlendWeights;
+  bool denseBlendWeightsDirty = true;
+  // Number of spherical averaging iterations each vertex point took
+  QVector<int> sphericalIterations;
   QVector<unsigned int> polyIndices;
+  QMap<QString, VertexAttribute> vertexAttributes;
+  // Limit positions and normals of the vertices, see LoopSubdivider::evaluateLimit
+  QVector<QVector3D> limitCoords;
+  QVector<QVector3D> limitNormals;
+
+  // Derived arrays are only recomputed once the data they depend on changed
+  bool baseNormalsDirty = true;
+  bool buffersDirty = true;
+  bool edgeHalfEdgesDirty = true;
+  bool limitDirty = true;
+  // Set while the half-edges and faces are released, see releaseConnectivity
+  bool connectivityReleased = false;
+  // For every edge, the half-edge the per-edge passes evaluate it from
+  QVector<int> edgeHalfEdges;
+  // RefinementAttribute flags of the shading types whose blended normals are stale
+  int blendedNormalsDirty = REFINE_LINEAR | REFINE_SPHERICAL | REFINE_BUTTERFLY;
 
   QVector<Vertex> vertices;
   QVector<Face> faces;
@@ -62,7 +141,12 @@ class Mesh {
   // function calls.
   friend class MeshInitializer;
   friend class Subdivider;
+  friend class AdaptiveLoopSubdivider;
   friend class LoopSubdivider;
+  friend class Sqrt3Subdivider;
+  friend class LoopTopologyGenerator;
+  friend class MeshBatch;
+  friend class ViewDependentRefiner;
 };
 
 #endif  // MESH_H
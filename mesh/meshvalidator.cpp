@@ -0,0 +1,166 @@
+#include "meshvalidator.h"
+
+/**
+ * @brief MeshValidator::MeshValidator Creates a new mesh validator.
+ */
+MeshValidator::MeshValidator() {}
+
+/**
+ * @brief MeshValidator::validate Checks the connectivity of the provided mesh
+ * and marks it as validated if no defect was found. Every pass is a parallel
+ * loop over the half-edges or vertices, and every walk is bounded, so that
+ * broken meshes are reported instead of hanging the validator.
+ * @param mesh The mesh to check.
+ * @return The TopologyDefect flags of the defects found, 0 if there are none.
+ */
+int MeshValidator::validate(Mesh& mesh) const {
+    const QVector<Vertex>& vertices = mesh.getVertices();
+    const QVector<HalfEdge>& halfEdges = mesh.getHalfEdges();
+    const QVector<Face>& faces = mesh.getFaces();
+    const Vertex* vertexData = vertices.constData();
+    const HalfEdge* halfEdgeData = halfEdges.constData();
+    const Face* faceData = faces.constData();
+    int numVerts = mesh.numVerts();
+    int numHalfEdges = mesh.numHalfEdges();
+    int numFaces = mesh.numFaces();
+    int numEdges = mesh.numEdges();
+
+    auto ownsVertex = [&](const Vertex* vertex) {
+        return vertex != nullptr && vertex >= vertexData && vertex < vertexData + numVerts;
+    };
+    auto ownsHalfEdge = [&](const HalfEdge* edge) {
+        return edge != nullptr && edge >= halfEdgeData && edge < halfEdgeData + numHalfEdges;
+    };
+    auto ownsFace = [&](const Face* face) {
+        return face != nullptr && face >= faceData && face < faceData + numFaces;
+    };
+
+    mesh.validated = false;
+    int defects = 0;
+
+    // Pointers and indexing of every half-edge
+    #pragma omp parallel for reduction(|:defects)
+    for (int h = 0; h < numHalfEdges; h++) {
+        const HalfEdge& edge = halfEdgeData[h];
+        if (!ownsVertex(edge.origin) || !ownsHalfEdge(edge.next) || !ownsHalfEdge(edge.prev) ||
+            !ownsFace(edge.face) || (edge.twin != nullptr && !ownsHalfEdge(edge.twin)) ||
+            edge.edgeIndex < 0 || edge.edgeIndex >= numEdges) {
+            defects |= DEFECT_DANGLING;
+            continue;
+        }
+        if (edge.index != h || edge.next->index != edge.nextIdx() || edge.prev->index != edge.prevIdx() ||
+            edge.face - faceData != edge.faceIdx() || edge.next->prev != &edge) {
+            defects |= DEFECT_INDEXING;
+        }
+    }
+
+    #pragma omp parallel for reduction(|:defects)
+    for (int v = 0; v < numVerts; v++) {
+        const Vertex& vertex = vertexData[v];
+        if (!ownsHalfEdge(vertex.out) || vertex.out->origin != &vertex || vertex.index != v) {
+            defects |= DEFECT_DANGLING;
+        }
+    }
+
+    // The walks below follow the pointers, which is only safe once they are
+    // known to stay inside the mesh
+    if (defects & (DEFECT_DANGLING | DEFECT_INDEXING)) {
+        return defects;
+    }
+
+    // Twins, and the number of half-edges per edge and per origin
+    QVector<int> edgeUses(numEdges, 0);
+    QVector<int> outgoing(numVerts, 0);
+    int* edgeUseData = edgeUses.data();
+    int* outgoingData = outgoing.data();
+
+    #pragma omp parallel for reduction(|:defects)
+    for (int h = 0; h < numHalfEdges; h++) {
+        const HalfEdge& edge = halfEdgeData[h];
+        if (edge.twin != nullptr) {
+            if (edge.twin == &edge || edge.twin->twin != &edge || edge.twin->edgeIndex != edge.edgeIndex) {
+                defects |= DEFECT_TWIN_ASYMMETRIC;
+            } else if (edge.twin->origin != edge.next->origin) {
+                defects |= DEFECT_ORIENTATION;
+            }
+        }
+        #pragma omp atomic
+        edgeUseData[edge.edgeIndex]++;
+        #pragma omp atomic
+        outgoingData[edge.origin->index]++;
+    }
+
+    #pragma omp parallel for reduction(|:defects)
+    for (int h = 0; h < numHalfEdges; h++) {
+        const HalfEdge& edge = halfEdgeData[h];
+        int uses = edgeUseData[edge.edgeIndex];
+        if (uses > 2 || (edge.twin == nullptr && uses != 1)) {
+            defects |= DEFECT_NON_MANIFOLD_EDGE;
+        }
+    }
+
+    // Every outgoing half-edge has to be reached from out, in a single fan
+    #pragma omp parallel for reduction(|:defects)
+    for (int v = 0; v < numVerts; v++) {
+        const Vertex& vertex = vertexData[v];
+        int maxSteps = outgoingData[v];
+
+        // Walk in prev->twin order until the fan closes or ends
+        int fan = 0;
+        const HalfEdge* edge = vertex.out;
+        do {
+            fan++;
+            edge = edge->prev->twin;
+        } while (edge != nullptr && edge != vertex.out && fan <= maxSteps);
+
+        bool boundary = edge == nullptr;
+        if (boundary) {
+            // Continue in twin->next order from out to the other end
+            edge = vertex.out->twin == nullptr ? nullptr : vertex.out->twin->next;
+            while (edge != nullptr && fan <= maxSteps) {
+                fan++;
+                edge = edge->twin == nullptr ? nullptr : edge->twin->next;
+            }
+        }
+
+        if (fan != maxSteps || (!boundary && edge != vertex.out)) {
+            defects |= DEFECT_NON_MANIFOLD_VERTEX;
+        } else if (!boundary && vertex.valence != fan) {
+            defects |= DEFECT_VALENCE;
+        }
+    }
+
+    mesh.validated = defects == 0;
+    return defects;
+}
+
+/**
+ * @brief MeshValidator::describe Describes the provided defects.
+ * @param defects TopologyDefect flags.
+ * @return One line per defect.
+ */
+QStringList MeshValidator::describe(int defects) {
+    QStringList lines;
+    if (defects & DEFECT_DANGLING) {
+        lines << "Half-edge or vertex pointers are missing or point outside the mesh";
+    }
+    if (defects & DEFECT_INDEXING) {
+        lines << "Half-edges do not follow the triangle indexing rules";
+    }
+    if (defects & DEFECT_TWIN_ASYMMETRIC) {
+        lines << "Twins do not point back to each other";
+    }
+    if (defects & DEFECT_ORIENTATION) {
+        lines << "Adjacent faces are inconsistently oriented";
+    }
+    if (defects & DEFECT_NON_MANIFOLD_EDGE) {
+        lines << "Edges are shared by more than two faces";
+    }
+    if (defects & DEFECT_NON_MANIFOLD_VERTEX) {
+        lines << "Vertex rings do not close or consist of several fans";
+    }
+    if (defects & DEFECT_VALENCE) {
+        lines << "Stored valences of interior vertices differ from their rings";
+    }
+    return lines;
+}
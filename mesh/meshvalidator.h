@@ -0,0 +1,41 @@
+#ifndef MESH_VALIDATOR_H
+#define MESH_VALIDATOR_H
+
+#include <QStringList>
+
+#include "mesh.h"
+
+/**
+ * @brief Flags of the topological defects MeshValidator detects.
+ */
+enum TopologyDefect {
+  // A next, prev, origin or face pointer is missing or points outside the mesh
+  DEFECT_DANGLING = 1 << 0,
+  // The half-edges do not follow the triangle indexing rules (h / 3, h % 3)
+  DEFECT_INDEXING = 1 << 1,
+  // A twin does not point back, or lies on another edge
+  DEFECT_TWIN_ASYMMETRIC = 1 << 2,
+  // Twins run in the same direction
+  DEFECT_ORIENTATION = 1 << 3,
+  // An edge has more than two half-edges
+  DEFECT_NON_MANIFOLD_EDGE = 1 << 4,
+  // The one-ring of a vertex does not close, or it has several fans
+  DEFECT_NON_MANIFOLD_VERTEX = 1 << 5,
+  // The stored valence of an interior vertex differs from its one-ring
+  DEFECT_VALENCE = 1 << 6,
+};
+
+/**
+ * @brief The MeshValidator class checks the half-edge connectivity of a mesh.
+ * Meshes that pass are marked as validated, which lets the subdivider gather
+ * neighbourhoods without bounds or null checks.
+ */
+class MeshValidator {
+ public:
+  MeshValidator();
+  int validate(Mesh& mesh) const;
+
+  static QStringList describe(int defects);
+};
+
+#endif  // MESH_VALIDATOR_H
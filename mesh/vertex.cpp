@@ -86,6 +86,36 @@ bool Vertex::isBoundaryVertex() const {
   return false;
 }
 
+/**
+ * @brief Vertex::outgoingHalfEdges Lists the half-edges that originate from
+ * this vertex, in counterclockwise order following the prev->twin loop. On the
+ * boundary the list starts at the outgoing boundary half-edge, so that the
+ * incoming boundary half-edge is the previous half-edge of the last one. Both
+ * walks are bounded, so they terminate on rings that do not close.
+ * @param edges The list the half-edges are appended to.
+ * @param maxSteps Upper bound on the number of steps of each walk.
+ */
+void Vertex::outgoingHalfEdges(QVarLengthArray<HalfEdge*, 16>& edges, int maxSteps) const {
+  if (out == nullptr) {
+    return;
+  }
+  HalfEdge* start = out;
+  int steps = 0;
+  while (start->twin != nullptr && start->twin->next != out && ++steps < maxSteps) {
+    start = start->twin->next;
+  }
+  if (start->twin != nullptr) {
+    start = out;
+  }
+
+  HalfEdge* edge = start;
+  steps = 0;
+  do {
+    edges.append(edge);
+    edge = edge->prev->twin;
+  } while (edge != nullptr && edge != start && ++steps < maxSteps);
+}
+
 /**
  * @brief Vertex::recalculateValence Recalculates the valence of this vertex.
  */
@@ -1,6 +1,7 @@
 #ifndef VERTEX
 #define VERTEX
 
+#include <QVarLengthArray>
 #include <QVector3D>
 
 // Forward declaration
@@ -17,6 +18,7 @@ class Vertex {
   HalfEdge* nextBoundaryHalfEdge() const;
   HalfEdge* prevBoundaryHalfEdge() const;
   bool isBoundaryVertex() const;
+  void outgoingHalfEdges(QVarLengthArray<HalfEdge*, 16>& edges, int maxSteps) const;
   void recalculateValence();
   void debugInfo() const;
 
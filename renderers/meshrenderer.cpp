@@ -64,9 +64,10 @@ void MeshRenderer::initBuffers() {
  * @param mesh The mesh to update the buffer contents with.
  */
 void MeshRenderer::updateBuffers(Mesh& mesh) {
-    QVector<QVector3D>& vertexCoords = mesh.getVertexCoords();
+    QVector<QVector3D>& vertexCoords = settings->limitSurface ? mesh.getLimitCoords() : mesh.getVertexCoords();
+    QVector<QVector3D>& baseNormals = settings->limitSurface ? mesh.getLimitNormals() : mesh.getVertexNorms();
     QVector<QVector3D>& vertexNormals = settings->blendNormals ? mesh.getBlendedVertexNormals(settings->currentSubdivShadingAvgMethod) :
-                                            (settings->subdivisionShading ? mesh.getVertexSubdivNormals(settings->currentSubdivShadingAvgMethod) : mesh.getVertexNorms());
+                                            (settings->subdivisionShading ? mesh.getVertexSubdivNormals(settings->currentSubdivShadingAvgMethod) : baseNormals);
     QVector<float>& vertexBlendWeights = mesh.getBlendWeights();
     QVector<unsigned int>& polyIndices = mesh.getPolyIndices();
 
@@ -79,7 +80,7 @@ void MeshRenderer::updateBuffers(Mesh& mesh) {
                      vertexNormals.data(), GL_STATIC_DRAW);
 
     gl->glBindBuffer(GL_ARRAY_BUFFER, meshBlendWeightsBO);
-    gl->glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vertexNormals.size(),
+    gl->glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vertexBlendWeights.size(),
                      vertexBlendWeights.data(), GL_STATIC_DRAW);
 
     gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshIndexBO);
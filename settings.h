@@ -29,6 +29,23 @@ typedef struct Settings {
   bool subdivisionShading = false;
   bool blendNormals = false;
   bool butterflySubdivision = false;
+  // Draw the limit positions and normals of the current level
+  bool limitSurface = false;
+  // Only keep the vertices of the levels that are not displayed, their
+  // connectivity is regenerated from the base mesh when needed
+  bool implicitTopology = false;
+  // Subdivide with sqrt(3) subdivision instead of Loop subdivision
+  bool sqrt3Subdivision = false;
+  // Refine the base mesh where the current view needs it instead of drawing
+  // a uniform level
+  bool viewDependent = false;
+  // Only refine the faces that are too far from the limit surface, up to the
+  // level set by the user, see AdaptiveLoopSubdivider
+  bool adaptive = false;
+  // Pick the coarsest level whose edges are at most this many pixels long on
+  // screen instead of the level set by the user
+  bool autoLevel = false;
+  float autoLevelPixels = 4.0f;
   int isoFrequency;
 } Settings;
 
@@ -0,0 +1,422 @@
+#include "adaptiveloopsubdivider.h"
+
+#include <math.h>
+
+#include "initialization/meshinitializer.h"
+#include "loopsubdivider.h"
+#include "mesh/meshvalidator.h"
+
+/**
+ * @brief AdaptiveLoopSubdivider::AdaptiveLoopSubdivider Creates a new adaptive
+ * subdivider with the default tolerances.
+ * @param maxLevel The level the finest faces are refined to.
+ */
+AdaptiveLoopSubdivider::AdaptiveLoopSubdivider(int maxLevel) : maxLevel(maxLevel) {}
+
+/**
+ * @brief AdaptiveLoopSubdivider::setMaxLevel Sets the level the finest faces
+ * are refined to.
+ * @param maxLevel The maximum level.
+ */
+void AdaptiveLoopSubdivider::setMaxLevel(int maxLevel) {
+    this->maxLevel = maxLevel;
+}
+
+/**
+ * @brief AdaptiveLoopSubdivider::setTolerance Configures when a face is
+ * refined further.
+ * @param distanceTolerance Maximum distance between a face and the limit
+ * surface, relative to the diagonal of the bounding box of the base mesh. Zero
+ * uses the largest error uniform subdivision to the maximum level leaves.
+ */
+void AdaptiveLoopSubdivider::setTolerance(float distanceTolerance) {
+    this->distanceTolerance = distanceTolerance;
+}
+
+/**
+ * @brief faceError Estimates how far a face lies from the limit surface over
+ * it.
+ * @param coords The limit positions of the level of the face.
+ * @param nextCoords The limit positions of the next level.
+ * @param corners The three corners of the face.
+ * @param edgePoints The edge points of the three edges on the next level.
+ * @return The largest distance between the limit position of an edge point and
+ * the midpoint of its edge.
+ */
+static float faceError(const QVector3D* coords, const QVector3D* nextCoords, const int* corners,
+                       const int* edgePoints) {
+    float error = 0.0;
+    for (int c = 0; c < 3; ++c) {
+        QVector3D midpoint = 0.5 * (coords[corners[c]] + coords[corners[(c + 1) % 3]]);
+        error = qMax(error, (nextCoords[edgePoints[c]] - midpoint).length());
+    }
+    return error;
+}
+
+/**
+ * @brief AdaptiveLoopSubdivider::copyConnectivity Gives a submesh the twins and
+ * edges of the level it was cut from, and the outgoing half-edges and valences
+ * of the vertices whose faces it all contains. MeshInitializer pairs the
+ * half-edges of edges shared by more than two faces in the order it meets
+ * them, while LoopSubdivider derives them from the level above, so
+ * non-manifold parts would otherwise be subdivided differently than by uniform
+ * subdivision.
+ * @param level The level the submesh was cut from.
+ * @param submeshFaces For every face of the level, its index in the submesh or
+ * -1. The faces keep their order and the order of their corners.
+ * @param submeshVertices For every vertex of the submesh, its index in the
+ * level.
+ * @param complete For every vertex of the level, whether the submesh contains
+ * all faces around it.
+ * @param submesh The submesh.
+ */
+void AdaptiveLoopSubdivider::copyConnectivity(Mesh& level, const QVector<int>& submeshFaces,
+                                              const QVector<int>& submeshVertices,
+                                              const QVector<bool>& complete, Mesh& submesh) const {
+    const QVector<HalfEdge>& halfEdges = level.getHalfEdges();
+    const QVector<Vertex>& vertices = level.getVertices();
+    auto submeshHalfEdge = [&](const HalfEdge* edge) -> HalfEdge* {
+        if (edge == nullptr || submeshFaces[edge->faceIdx()] < 0) {
+            return nullptr;
+        }
+        return &submesh.halfEdges[3 * submeshFaces[edge->faceIdx()] + edge->index % 3];
+    };
+
+    QVector<int> edgeIndices(level.numEdges(), -1);
+    int numEdges = 0;
+    for (int f = 0; f < level.numFaces(); ++f) {
+        int s = submeshFaces[f];
+        if (s < 0) {
+            continue;
+        }
+        for (int c = 0; c < 3; ++c) {
+            const HalfEdge& edge = halfEdges[3 * f + c];
+            if (edgeIndices[edge.edgeIndex] < 0) {
+                edgeIndices[edge.edgeIndex] = numEdges++;
+            }
+            submesh.halfEdges[3 * s + c].twin = submeshHalfEdge(edge.twin);
+            submesh.halfEdges[3 * s + c].edgeIndex = edgeIndices[edge.edgeIndex];
+        }
+    }
+    submesh.edgeCount = numEdges;
+    submesh.edgeHalfEdgesDirty = true;
+    for (int i = 0; i < submeshVertices.size(); ++i) {
+        const Vertex& vertex = vertices[submeshVertices[i]];
+        if (complete[vertex.index]) {
+            submesh.vertices[i].out = submeshHalfEdge(vertex.out);
+            submesh.vertices[i].valence = vertex.valence;
+        }
+    }
+}
+
+/**
+ * @brief AdaptiveLoopSubdivider::triangulateLeaf Splits a face that is not
+ * refined at the edge points its refined neighbours put on the shared edges.
+ * @param corners The three corners of the face.
+ * @param edgePoints For every edge, from corner i to corner i + 1, the edge
+ * point on it or -1.
+ * @param faces The faces the triangles are appended to.
+ */
+void AdaptiveLoopSubdivider::triangulateLeaf(const int* corners, const int* edgePoints,
+                                             QVector<QVector<int>>& faces) {
+    int numEdgePoints = 0;
+    int first = 0;
+    for (int i = 0; i < 3; ++i) {
+        if (edgePoints[i] >= 0) {
+            numEdgePoints++;
+        }
+    }
+    // Rotate the face so that the edge points start at edge 0
+    for (int i = 0; i < 3; ++i) {
+        if (edgePoints[i] >= 0 && (numEdgePoints == 3 || edgePoints[(i + 2) % 3] < 0)) {
+            first = i;
+            break;
+        }
+    }
+    int v0 = corners[first];
+    int v1 = corners[(first + 1) % 3];
+    int v2 = corners[(first + 2) % 3];
+    int m0 = edgePoints[first];
+    int m1 = edgePoints[(first + 1) % 3];
+    int m2 = edgePoints[(first + 2) % 3];
+
+    switch (numEdgePoints) {
+        case 0:
+            faces.append({v0, v1, v2});
+            break;
+        case 1:
+            faces.append({v0, m0, v2});
+            faces.append({m0, v1, v2});
+            break;
+        case 2:
+            faces.append({m0, v1, m1});
+            faces.append({v0, m0, m1});
+            faces.append({v0, m1, v2});
+            break;
+        default:
+            faces.append({v0, m0, m2});
+            faces.append({v1, m1, m0});
+            faces.append({v2, m2, m1});
+            faces.append({m0, m1, m2});
+            break;
+    }
+}
+
+/**
+ * @brief AdaptiveLoopSubdivider::subdivide Adaptively subdivides the provided
+ * triangle mesh. Level by level, the active faces and the faces sharing a
+ * vertex with them are subdivided, the active faces that exceed the tolerance
+ * are marked, and the faces that are not refined any further are written to
+ * the result. The children of the marked faces are active on the next level.
+ * @param baseMesh The mesh to subdivide. Its blend weights mark the
+ * extraordinary vertices.
+ * @return The adaptively subdivided mesh, with its vertices on the limit
+ * surface. Its limit coordinates and limit normals are set as well, and the
+ * limit normals double as its subdivided normals of every shading type.
+ */
+Mesh AdaptiveLoopSubdivider::subdivide(Mesh& baseMesh) const {
+    LoopSubdivider loopSubdivider;
+
+    const QVector<Vertex>& baseVertices = baseMesh.getVertices();
+    QVector3D minCoords = baseVertices.isEmpty() ? QVector3D() : baseVertices[0].coords;
+    QVector3D maxCoords = minCoords;
+    for (const Vertex& vertex : baseVertices) {
+        for (int i = 0; i < 3; ++i) {
+            minCoords[i] = qMin(minCoords[i], vertex.coords[i]);
+            maxCoords[i] = qMax(maxCoords[i], vertex.coords[i]);
+        }
+    }
+    float diagonal = (maxCoords - minCoords).length();
+
+    // The vertices of the result, placed on the limit surface
+    QVector<QVector3D> coords;
+    QVector<QVector3D> normals;
+    QVector<QVector<int>> faces;
+
+    // The current level holds the faces that are still active (the children
+    // of the refined faces of the level above), and the ring of faces around
+    // them. Ids are the indices of the vertices in the result.
+    Mesh level = baseMesh;
+    QVector<bool> active(baseMesh.numFaces(), true);
+    QVector<bool> extraordinary(baseMesh.numVerts(), false);
+    QVector<int> ids(baseMesh.numVerts(), -1);
+    for (int v : baseMesh.getSparseBlendWeights().indices) {
+        extraordinary[v] = true;
+    }
+    loopSubdivider.evaluateLimit(level);
+
+    auto assignIds = [&](Mesh& mesh, const QVector<bool>& activeFaces, QVector<int>& vertexIds) {
+        const QVector<HalfEdge>& halfEdges = mesh.getHalfEdges();
+        const QVector<QVector3D>& limitCoords = mesh.getLimitCoords();
+        const QVector<QVector3D>& limitNormals = mesh.getLimitNormals();
+        for (int h = 0; h < halfEdges.size(); ++h) {
+            int v = halfEdges[h].origin->index;
+            if (activeFaces[h / 3] && vertexIds[v] < 0) {
+                vertexIds[v] = coords.size();
+                coords.append(limitCoords[v]);
+                normals.append(limitNormals[v]);
+            }
+        }
+    };
+    assignIds(level, active, ids);
+
+    float distance = distanceTolerance * diagonal;
+    for (int l = 0;; ++l) {
+        const QVector<HalfEdge>& halfEdges = level.getHalfEdges();
+        int numFaces = level.numFaces();
+        const QVector3D* limitCoords = level.getLimitCoords().constData();
+        const bool* activeData = active.constData();
+        const bool* extraordinaryData = extraordinary.constData();
+
+        // The active faces and every face sharing a vertex with them form the
+        // submesh that is subdivided. Its edge points tell how far the active
+        // faces lie from the limit surface, and the children of the refined
+        // faces form the next level.
+        Mesh next;
+        Mesh submesh;
+        QVector<int> submeshFaces(numFaces, -1);
+        QVector<int> submeshVertices;
+        if (l < maxLevel) {
+            QVector<bool> touched(level.numVerts(), false);
+            for (int f = 0; f < numFaces; ++f) {
+                if (active[f]) {
+                    for (int c = 0; c < 3; ++c) {
+                        touched[halfEdges[3 * f + c].origin->index] = true;
+                    }
+                }
+            }
+
+            QVector<int> localIndices(level.numVerts(), -1);
+            QVector<QVector3D> submeshCoords;
+            QVector<QVector<int>> faceIndices;
+            for (int f = 0; f < numFaces; ++f) {
+                int corners[3];
+                bool touches = false;
+                for (int c = 0; c < 3; ++c) {
+                    corners[c] = halfEdges[3 * f + c].origin->index;
+                    touches |= touched[corners[c]];
+                }
+                if (!touches) {
+                    continue;
+                }
+                QVector<int> indices;
+                for (int c = 0; c < 3; ++c) {
+                    int v = corners[c];
+                    if (localIndices[v] < 0) {
+                        localIndices[v] = submeshVertices.size();
+                        submeshVertices.append(v);
+                        submeshCoords.append(level.getVertices()[v].coords);
+                    }
+                    indices.append(localIndices[v]);
+                }
+                submeshFaces[f] = faceIndices.size();
+                faceIndices.append(indices);
+            }
+
+            submesh = MeshInitializer().constructHalfEdgeMesh(submeshCoords, faceIndices);
+            copyConnectivity(level, submeshFaces, submeshVertices, touched, submesh);
+            MeshValidator().validate(submesh);
+            next = loopSubdivider.subdivide(submesh, REFINE_GEOMETRY);
+            loopSubdivider.evaluateLimit(next);
+        }
+        const QVector<HalfEdge>& submeshHalfEdges = submesh.getHalfEdges();
+        const int* submeshFacesData = submeshFaces.constData();
+        int numSubmeshVerts = submesh.numVerts();
+        const QVector3D* nextLimitCoords = next.getLimitCoords().constData();
+
+        // The distance between the limit positions of the edge points and the
+        // edges estimates how far each active face lies from the limit surface
+        QVector<float> errors(numFaces, 0.0);
+        float* errorsData = errors.data();
+        if (l < maxLevel) {
+            #pragma omp parallel for
+            for (int f = 0; f < numFaces; ++f) {
+                if (!activeData[f]) {
+                    continue;
+                }
+                int s = submeshFacesData[f];
+                int corners[3];
+                int edgePoints[3];
+                for (int c = 0; c < 3; ++c) {
+                    corners[c] = halfEdges[3 * f + c].origin->index;
+                    edgePoints[c] = numSubmeshVerts + submeshHalfEdges[3 * s + c].edgeIndex;
+                }
+                errorsData[f] = faceError(limitCoords, nextLimitCoords, corners, edgePoints);
+            }
+        }
+
+        // Without a tolerance, the largest error on the base mesh is scaled
+        // down to the one uniform subdivision to the maximum level leaves
+        if (l == 0 && distanceTolerance <= 0) {
+            float maxError = 0.0;
+            for (float error : errors) {
+                maxError = qMax(maxError, error);
+            }
+            distance = maxError / powf(4.0, maxLevel);
+        }
+
+        // Refine the active faces that exceed the tolerance or touch an
+        // extraordinary vertex, as long as all faces sharing an edge with them
+        // are active as well. Edges rather than twins are compared, so that
+        // all faces around a non-manifold edge are taken into account.
+        QVector<bool> coarseEdges(level.numEdges(), false);
+        for (int f = 0; f < numFaces; ++f) {
+            if (!active[f]) {
+                for (int c = 0; c < 3; ++c) {
+                    coarseEdges[halfEdges[3 * f + c].edgeIndex] = true;
+                }
+            }
+        }
+        const bool* coarseEdgeData = coarseEdges.constData();
+        QVector<bool> refined(numFaces, false);
+        bool* refinedData = refined.data();
+        if (l < maxLevel) {
+            #pragma omp parallel for
+            for (int f = 0; f < numFaces; ++f) {
+                if (!activeData[f]) {
+                    continue;
+                }
+                bool balanced = true;
+                bool feature = false;
+                for (int c = 0; c < 3; ++c) {
+                    const HalfEdge& edge = halfEdges[3 * f + c];
+                    balanced &= !coarseEdgeData[edge.edgeIndex];
+                    feature |= extraordinaryData[edge.origin->index];
+                }
+                refinedData[f] = balanced && (feature || errorsData[f] > distance);
+            }
+        }
+        bool anyRefined = refined.contains(true);
+
+        // Children of submesh face s are the corner faces 3s, 3s + 1 and
+        // 3s + 2 and the interior face 3F + s
+        QVector<bool> nextActive;
+        QVector<bool> nextExtraordinary;
+        QVector<int> nextIds;
+        if (anyRefined) {
+            nextActive.fill(false, next.numFaces());
+            for (int f = 0; f < numFaces; ++f) {
+                if (refined[f]) {
+                    int s = submeshFaces[f];
+                    nextActive[3 * s] = nextActive[3 * s + 1] = nextActive[3 * s + 2] = true;
+                    nextActive[3 * submesh.numFaces() + s] = true;
+                }
+            }
+
+            // Vertex points keep the vertex they refine, edge points are new
+            nextExtraordinary.fill(false, next.numVerts());
+            nextIds.fill(-1, next.numVerts());
+            for (int i = 0; i < submeshVertices.size(); ++i) {
+                nextExtraordinary[i] = extraordinary[submeshVertices[i]];
+                nextIds[i] = ids[submeshVertices[i]];
+            }
+            assignIds(next, nextActive, nextIds);
+        }
+
+        // The active faces that are not refined are final. Their edges shared
+        // with refined faces carry the edge points of the next level.
+        QVector<bool> splitEdges(level.numEdges(), false);
+        for (int f = 0; f < numFaces; ++f) {
+            if (refined[f]) {
+                for (int c = 0; c < 3; ++c) {
+                    splitEdges[halfEdges[3 * f + c].edgeIndex] = true;
+                }
+            }
+        }
+        for (int f = 0; f < numFaces; ++f) {
+            if (!active[f] || refined[f]) {
+                continue;
+            }
+            int corners[3];
+            int edgePoints[3];
+            for (int c = 0; c < 3; ++c) {
+                const HalfEdge& edge = halfEdges[3 * f + c];
+                corners[c] = ids[edge.origin->index];
+                edgePoints[c] = -1;
+                if (splitEdges[edge.edgeIndex]) {
+                    int edgeIndex = submeshHalfEdges[3 * submeshFaces[f] + c].edgeIndex;
+                    edgePoints[c] = nextIds[numSubmeshVerts + edgeIndex];
+                }
+            }
+            triangulateLeaf(corners, edgePoints, faces);
+        }
+
+        if (!anyRefined) {
+            break;
+        }
+        level = next;
+        active = nextActive;
+        extraordinary = nextExtraordinary;
+        ids = nextIds;
+    }
+
+    Mesh result = MeshInitializer().constructHalfEdgeMesh(coords, faces);
+    result.limitCoords = coords;
+    result.limitNormals = normals;
+    result.limitDirty = false;
+    // Subdivision shading converges to the limit normals
+    result.setSubdividedNormals(LINEAR, normals);
+    result.setSubdividedNormals(SPHERICAL, normals);
+    result.setSubdividedNormals(BUTTERFLY, normals);
+    return result;
+}
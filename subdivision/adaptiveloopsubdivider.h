@@ -0,0 +1,50 @@
+#ifndef ADAPTIVE_LOOP_SUBDIVIDER_H
+#define ADAPTIVE_LOOP_SUBDIVIDER_H
+
+#include <QVector>
+#include <QVector3D>
+
+#include "mesh/mesh.h"
+
+/**
+ * @brief The AdaptiveLoopSubdivider class performs feature-adaptive Loop
+ * subdivision: only the faces whose refinement changes the surface noticeably
+ * are subdivided, up to a maximum level. A face is refined while the limit
+ * positions of the edge points of the next level lie further from its edges
+ * than a distance, which grows with the curvature of the surface, or while it
+ * touches an extraordinary vertex (a vertex with a base blend weight, see
+ * Mesh::computeBaseBlendWeights). By default, the distance is the error that
+ * uniform subdivision to the maximum level leaves, so that the result is as
+ * close to the limit surface as that level.
+ *
+ * Every level subdivides the active faces and the ring of faces around them,
+ * with the connectivity of the level, so that their children get exactly the
+ * positions of uniform subdivision. A face is only refined further if the faces
+ * sharing its edges are active too, which keeps neighbouring faces within one
+ * level. The faces that border refined faces are split at the edge points of
+ * the shared edges (red-green refinement), so the result is watertight. Every
+ * vertex is placed on the limit surface, where the vertices of different levels
+ * agree.
+ */
+class AdaptiveLoopSubdivider {
+public:
+    AdaptiveLoopSubdivider(int maxLevel = 4);
+
+    void setMaxLevel(int maxLevel);
+    void setTolerance(float distanceTolerance);
+
+    Mesh subdivide(Mesh& baseMesh) const;
+
+    static void triangulateLeaf(const int* corners, const int* edgePoints, QVector<QVector<int>>& faces);
+
+private:
+    void copyConnectivity(Mesh& level, const QVector<int>& submeshFaces, const QVector<int>& submeshVertices,
+                          const QVector<bool>& complete, Mesh& submesh) const;
+
+    int maxLevel;
+    // Maximum distance between a face and the limit surface, relative to the
+    // diagonal of the bounding box. Zero derives it from the maximum level.
+    float distanceTolerance = 0.0;
+};
+
+#endif  // ADAPTIVE_LOOP_SUBDIVIDER_H
@@ -0,0 +1,41 @@
+#include "butterflystenciltable.h"
+
+/**
+ * @brief ButterflyStencilTable::ButterflyStencilTable Gathers the Butterfly
+ * stencil of every edge of the provided mesh, with tension parameter w = 1/16.
+ * @param mesh The mesh whose edges are refined with the table.
+ */
+ButterflyStencilTable::ButterflyStencilTable(Mesh& mesh) {
+    const QVector<HalfEdge>& halfEdges = mesh.getHalfEdges();
+    const QVector<int>& edgeHalfEdges = mesh.getEdgeHalfEdges();
+
+    indices.resize(mesh.numEdges() * size);
+    weights.resize(mesh.numEdges() * size);
+    int* edgeIndices = indices.data();
+    float* edgeWeights = weights.data();
+
+    #pragma omp parallel for
+    for (int e = 0; e < mesh.numEdges(); e++) {
+        EdgeNeighborhood neighborhood(halfEdges[edgeHalfEdges[e]]);
+        edgeStencil(neighborhood, edgeIndices + e * size, edgeWeights + e * size);
+    }
+}
+
+/**
+ * @brief ButterflyStencilTable::edgeStencil Fills in the stencil of a single
+ * edge, in the layout of the table.
+ * @param neighborhood The gathered neighbourhood of the edge.
+ * @param index Receives the size vertex indices.
+ * @param weight Receives the size weights.
+ */
+void ButterflyStencilTable::edgeStencil(const EdgeNeighborhood& neighborhood, int* index, float* weight) {
+    const float w = 1.0 / 16.0;
+    const float pointWeights[size] = {1.0 / 2.0, 1.0 / 2.0, 2.0 * w, 2.0 * w, -w, -w, -w, -w};
+
+    // Boundary edges only keep their endpoints, see EdgeNeighborhood
+    for (int i = 0; i < size; ++i) {
+        bool present = neighborhood.points[i] >= 0;
+        index[i] = present ? neighborhood.points[i] : neighborhood.points[0];
+        weight[i] = present ? pointWeights[i] : 0.0;
+    }
+}
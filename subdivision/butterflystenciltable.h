@@ -0,0 +1,55 @@
+#ifndef BUTTERFLY_STENCIL_TABLE_H
+#define BUTTERFLY_STENCIL_TABLE_H
+
+#include <QVector>
+
+#include "mesh/mesh.h"
+#include "neighborhood.h"
+
+/**
+ * @brief The ButterflyStencilTable class holds the eight-point (modified)
+ * Butterfly stencil of every edge of a mesh, gathered once so that refining an
+ * attribute becomes a plain weighted gather. The stencil of edge e occupies
+ * entries [e * size, (e + 1) * size) of indices and weights, in the order of
+ * EdgeNeighborhood::points. Missing points (boundary edges, absent wings) have
+ * weight 0 and refer to the first endpoint of the edge, so that applying the
+ * table needs no branches.
+ */
+class ButterflyStencilTable {
+public:
+    ButterflyStencilTable(Mesh& mesh);
+
+    static const int size = 8;
+
+    inline int numEdges() const { return indices.size() / size; }
+
+    static void edgeStencil(const EdgeNeighborhood& neighborhood, int* index, float* weight);
+
+    /**
+     * @brief apply Evaluates the stencil of every edge.
+     * @param values The per-vertex values of the mesh the table was built from.
+     * @param result Receives numEdges() values, one per edge.
+     */
+    template <typename T>
+    void apply(const QVector<T>& values, T* result) const {
+        const T* data = values.constData();
+        const int* edgeIndices = indices.constData();
+        const float* edgeWeights = weights.constData();
+
+        #pragma omp parallel for
+        for (int e = 0; e < numEdges(); ++e) {
+            const int* index = edgeIndices + e * size;
+            const float* weight = edgeWeights + e * size;
+            T value = weight[0] * data[index[0]];
+            for (int i = 1; i < size; ++i) {
+                value += weight[i] * data[index[i]];
+            }
+            result[e] = value;
+        }
+    }
+
+    QVector<int> indices;
+    QVector<float> weights;
+};
+
+#endif  // BUTTERFLY_STENCIL_TABLE_H
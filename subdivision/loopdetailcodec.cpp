@@ -0,0 +1,374 @@
+#include "loopdetailcodec.h"
+
+#include <QtAlgorithms>
+
+#include <cassert>
+#include <cstring>
+
+#include "loopsubdivider.h"
+#include "mesh/meshvalidator.h"
+
+// Quantized coordinates are clamped to this magnitude, so that every code fits
+// in the 57 bits BitReader can peek at once
+static const int maxQuantized = 1 << 30;
+
+/**
+ * @brief The BitWriter class appends bits to a byte array, most significant
+ * bit first.
+ */
+class BitWriter {
+public:
+    /**
+     * @brief write Appends the lowest bits of value.
+     */
+    void write(quint64 value, int bits) {
+        buffer = (buffer << bits) | value;
+        count += bits;
+        while (count >= 8) {
+            count -= 8;
+            bytes.append(char(buffer >> count));
+        }
+    }
+
+    /**
+     * @brief writeExpGolomb Appends the Exp-Golomb code of the provided order:
+     * x = value + 2^order written in n bits, preceded by n - order - 1 zeros.
+     */
+    void writeExpGolomb(quint32 value, int order) {
+        quint64 x = quint64(value) + (quint64(1) << order);
+        int bits = 64 - qCountLeadingZeroBits(x);
+        write(0, bits - order - 1);
+        write(x, bits);
+    }
+
+    /**
+     * @brief finish Pads the last byte with zeros.
+     */
+    QByteArray& finish() {
+        if (count > 0) {
+            bytes.append(char(buffer << (8 - count)));
+            count = 0;
+        }
+        return bytes;
+    }
+
+private:
+    QByteArray bytes;
+    quint64 buffer = 0;
+    int count = 0;
+};
+
+/**
+ * @brief The BitReader class reads the bits written by BitWriter. Reading past
+ * the end yields zeros and sets overrun.
+ */
+class BitReader {
+public:
+    BitReader(const uchar* data, int size) : data(data), size(size) {}
+
+    /**
+     * @brief readExpGolomb Reads a code written by BitWriter::writeExpGolomb.
+     */
+    quint32 readExpGolomb(int order) {
+        quint64 window = peek();
+        if (window == 0) {
+            overrun = true;
+            return 0;
+        }
+        int zeros = qCountLeadingZeroBits(window);
+        int bits = zeros + order + 1;
+        // Longer codes do not fit in the window, so only a malformed stream
+        // produces them
+        if (bits > 57) {
+            overrun = true;
+            return 0;
+        }
+        position += zeros;
+        quint64 x = peek() >> (64 - bits);
+        position += bits;
+        return quint32(x - (quint64(1) << order));
+    }
+
+    inline bool failed() const { return overrun || position > 8 * qint64(size); }
+
+private:
+    // The next 57 bits, aligned to the most significant bit
+    quint64 peek() const {
+        qint64 byte = position >> 3;
+        quint64 window = 0;
+        if (byte + 8 <= size) {
+            for (int i = 0; i < 8; ++i) {
+                window = (window << 8) | data[byte + i];
+            }
+        } else {
+            for (int i = 0; i < 8; ++i) {
+                window = (window << 8) | (byte + i < size ? data[byte + i] : 0);
+            }
+        }
+        return (window << (position & 7)) & ~quint64(0x7f);
+    }
+
+    const uchar* data;
+    int size;
+    qint64 position = 0;
+    bool overrun = false;
+};
+
+/**
+ * @brief zigzag Maps signed integers to unsigned ones, interleaving positive
+ * and negative values so that small magnitudes get short codes.
+ */
+static inline quint32 zigzag(int value) { return (quint32(value) << 1) ^ quint32(value >> 31); }
+
+static inline int unzigzag(quint32 value) { return int(value >> 1) ^ -int(value & 1); }
+
+static void appendWord(QByteArray& bytes, quint32 word) {
+    for (int i = 0; i < 4; ++i) {
+        bytes.append(char(word >> (8 * i)));
+    }
+}
+
+static quint32 readWord(const uchar* data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (quint32(data[3]) << 24);
+}
+
+/**
+ * @brief expGolombBits The length of the Exp-Golomb code of value.
+ */
+static inline int expGolombBits(quint32 value, int order) {
+    quint64 x = quint64(value) + (quint64(1) << order);
+    return 2 * (64 - qCountLeadingZeroBits(x)) - order - 1;
+}
+
+/**
+ * @brief LoopDetailCodec::LoopDetailCodec Subdivides the topology of the base
+ * mesh and builds the prolongation of every level.
+ * @param baseMesh The base mesh. Its positions are the coarsest level of every
+ * stream the codec encodes or decodes.
+ * @param levels The number of subdivision levels, at least 1.
+ */
+LoopDetailCodec::LoopDetailCodec(Mesh& baseMesh, int levels) {
+    const QVector<Vertex>& vertices = baseMesh.getVertices();
+    baseCoords.resize(vertices.size());
+    for (int v = 0; v < vertices.size(); ++v) {
+        baseCoords[v] = vertices[v].coords;
+    }
+
+    LoopSubdivider subdivider;
+    for (int level = 0; level < levels; ++level) {
+        Mesh& coarse = level == 0 ? baseMesh : mesh;
+        prolongations.append(LoopProlongation(coarse));
+        Mesh refined = subdivider.subdivide(coarse, REFINE_GEOMETRY);
+        MeshValidator().validate(refined);
+        mesh = refined;
+    }
+}
+
+/**
+ * @brief LoopDetailCodec::numVerts Retrieves the number of vertices of a level.
+ * @param level The level, 0 being the base mesh.
+ * @return The number of vertices.
+ */
+int LoopDetailCodec::numVerts(int level) const {
+    return level == 0 ? baseCoords.size() : prolongations[level - 1].numRows();
+}
+
+/**
+ * @brief LoopDetailCodec::predict Subdivides the positions of a level.
+ * @param level The level of the coarse positions.
+ * @param coarse The positions of the level.
+ * @param fine Set to the Loop subdivision of the positions.
+ */
+void LoopDetailCodec::predict(int level, const QVector<QVector3D>& coarse, QVector<QVector3D>& fine) const {
+    const LoopProlongation& prolongation = prolongations[level];
+    fine.resize(prolongation.numRows());
+    prolongation.apply(coarse, fine.data());
+}
+
+/**
+ * @brief LoopDetailCodec::encode Encodes the positions of every level.
+ *
+ * The stream holds a header (magic "LDC1", the number of base vertices, the
+ * number of levels and the step) followed by every level: its number of
+ * vertices, the Exp-Golomb order of the x, y and z details, the number of
+ * blocks and the end offset of every block, and then the blocks. A block holds
+ * the zigzag-mapped quantized details of blockSize vertices, x, y and z
+ * interleaved. All words are little-endian.
+ * @param levelCoords The positions of level k in entry k - 1, for every level.
+ * @param step The quantization step. Every decoded coordinate lies within half
+ * a step of the encoded one.
+ * @return The encoded stream.
+ */
+QByteArray LoopDetailCodec::encode(const QVector<QVector<QVector3D>>& levelCoords, float step) const {
+    assert(levelCoords.size() == numLevels() && step > 0);
+    QByteArray bytes("LDC1", 4);
+    appendWord(bytes, baseCoords.size());
+    appendWord(bytes, numLevels());
+    quint32 stepBits;
+    std::memcpy(&stepBits, &step, sizeof(float));
+    appendWord(bytes, stepBits);
+
+    QVector<QVector3D> coarse = baseCoords;
+    QVector<QVector3D> fine;
+    for (int level = 0; level < numLevels(); ++level) {
+        predict(level, coarse, fine);
+        int verts = fine.size();
+        assert(levelCoords[level].size() == verts);
+
+        // Quantize, and continue from the positions the decoder will see
+        QVector<quint32> symbols(3 * verts);
+        quint32* symbolData = symbols.data();
+        const QVector3D* target = levelCoords[level].constData();
+        QVector3D* fineData = fine.data();
+
+        #pragma omp parallel for
+        for (int v = 0; v < verts; ++v) {
+            QVector3D detail = (target[v] - fineData[v]) / step;
+            for (int c = 0; c < 3; ++c) {
+                int quantized = qRound(qBound(-float(maxQuantized), detail[c], float(maxQuantized)));
+                symbolData[3 * v + c] = zigzag(quantized);
+                fineData[v][c] += quantized * step;
+            }
+        }
+
+        // The order of every coordinate minimizes its total code length
+        int orders[3];
+        for (int c = 0; c < 3; ++c) {
+            qint64 bestBits = -1;
+            for (int order = 0; order <= maxOrder; ++order) {
+                qint64 bits = 0;
+                #pragma omp parallel for reduction(+ : bits)
+                for (int v = 0; v < verts; ++v) {
+                    bits += expGolombBits(symbolData[3 * v + c], order);
+                }
+                if (bestBits < 0 || bits < bestBits) {
+                    bestBits = bits;
+                    orders[c] = order;
+                }
+            }
+        }
+
+        int numBlocks = (verts + blockSize - 1) / blockSize;
+        QVector<QByteArray> blocks(numBlocks);
+        QByteArray* blockData = blocks.data();
+
+        #pragma omp parallel for
+        for (int b = 0; b < numBlocks; ++b) {
+            BitWriter writer;
+            for (int v = b * blockSize; v < qMin((b + 1) * blockSize, verts); ++v) {
+                for (int c = 0; c < 3; ++c) {
+                    writer.writeExpGolomb(symbolData[3 * v + c], orders[c]);
+                }
+            }
+            blockData[b] = writer.finish();
+        }
+
+        appendWord(bytes, verts);
+        appendWord(bytes, orders[0] | (orders[1] << 8) | (orders[2] << 16));
+        appendWord(bytes, numBlocks);
+        quint32 end = 0;
+        for (int b = 0; b < numBlocks; ++b) {
+            end += blocks[b].size();
+            appendWord(bytes, end);
+        }
+        for (int b = 0; b < numBlocks; ++b) {
+            bytes.append(blocks[b].constData(), blocks[b].size());
+        }
+
+        std::swap(coarse, fine);
+    }
+    return bytes;
+}
+
+/**
+ * @brief LoopDetailCodec::decode Reconstructs the positions of every level.
+ * @param data A stream produced by encode for the same base mesh and number of
+ * levels.
+ * @param levelCoords Set to the positions of level k in entry k - 1.
+ * @return False if the stream is malformed or does not match this codec.
+ */
+bool LoopDetailCodec::decode(const QByteArray& data, QVector<QVector<QVector3D>>& levelCoords) const {
+    const uchar* bytes = reinterpret_cast<const uchar*>(data.constData());
+    int size = data.size();
+    if (size < 16 || std::memcmp(bytes, "LDC1", 4) != 0 || readWord(bytes + 4) != quint32(baseCoords.size()) ||
+        readWord(bytes + 8) != quint32(numLevels())) {
+        return false;
+    }
+    float step;
+    quint32 stepBits = readWord(bytes + 12);
+    std::memcpy(&step, &stepBits, sizeof(float));
+
+    levelCoords.resize(numLevels());
+    int offset = 16;
+    for (int level = 0; level < numLevels(); ++level) {
+        const QVector<QVector3D>& coarse = level == 0 ? baseCoords : levelCoords[level - 1];
+        QVector<QVector3D>& fine = levelCoords[level];
+        int verts = numVerts(level + 1);
+        int numBlocks = (verts + blockSize - 1) / blockSize;
+        if (offset + 12 + 4 * numBlocks > size || readWord(bytes + offset) != quint32(verts) ||
+            readWord(bytes + offset + 8) != quint32(numBlocks)) {
+            return false;
+        }
+        quint32 orderWord = readWord(bytes + offset + 4);
+        int orders[3] = {int(orderWord & 0xff), int((orderWord >> 8) & 0xff), int((orderWord >> 16) & 0xff)};
+        if (orders[0] > maxOrder || orders[1] > maxOrder || orders[2] > maxOrder) {
+            return false;
+        }
+        const uchar* blockEnds = bytes + offset + 12;
+        const uchar* blockStart = blockEnds + 4 * numBlocks;
+        quint32 levelSize = numBlocks > 0 ? readWord(blockEnds + 4 * (numBlocks - 1)) : 0;
+        if (blockStart + levelSize > bytes + size) {
+            return false;
+        }
+
+        predict(level, coarse, fine);
+        QVector3D* fineData = fine.data();
+        bool failed = false;
+
+        #pragma omp parallel for reduction(|| : failed)
+        for (int b = 0; b < numBlocks; ++b) {
+            quint32 begin = b == 0 ? 0 : readWord(blockEnds + 4 * (b - 1));
+            quint32 end = readWord(blockEnds + 4 * b);
+            if (begin > end || end > levelSize) {
+                failed = true;
+                continue;
+            }
+            BitReader reader(blockStart + begin, end - begin);
+            for (int v = b * blockSize; v < qMin((b + 1) * blockSize, verts); ++v) {
+                for (int c = 0; c < 3; ++c) {
+                    fineData[v][c] += unzigzag(reader.readExpGolomb(orders[c])) * step;
+                }
+            }
+            failed = failed || reader.failed();
+        }
+        if (failed) {
+            return false;
+        }
+        offset = blockStart + levelSize - bytes;
+    }
+    return offset == size;
+}
+
+/**
+ * @brief LoopDetailCodec::decode Reconstructs the finest level of a stream into
+ * the mesh, see getMesh.
+ * @param data A stream produced by encode.
+ * @return False if the stream is malformed, in which case the mesh is left
+ * untouched.
+ */
+bool LoopDetailCodec::decode(const QByteArray& data) {
+    QVector<QVector<QVector3D>> levelCoords;
+    if (!decode(data, levelCoords)) {
+        return false;
+    }
+
+    Vertex* vertices = mesh.getVertices().data();
+    const QVector3D* coords = levelCoords.last().constData();
+
+    #pragma omp parallel for
+    for (int v = 0; v < mesh.numVerts(); v++) {
+        vertices[v].coords = coords[v];
+    }
+    mesh.invalidateGeometry();
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef LOOP_DETAIL_CODEC_H
+#define LOOP_DETAIL_CODEC_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QVector3D>
+
+#include "loopprolongation.h"
+#include "mesh/mesh.h"
+
+/**
+ * @brief The LoopDetailCodec class stores the levels of a multiresolution mesh
+ * (e.g. a sculpt) as the base mesh plus, for every level, the difference
+ * between its vertex positions and the Loop subdivision of the level above.
+ * These detail vectors are small wherever the surface is smooth. They are
+ * quantized to a uniform step and entropy coded with Exp-Golomb codes whose
+ * order is chosen per level and per coordinate. The predictions of the encoder
+ * are made from the quantized positions, exactly as the decoder makes them, so
+ * the error never exceeds half a step per coordinate, at any level.
+ *
+ * The Loop stencils of every level are built once, so that reconstructing a
+ * level is a parallel sparse matrix-vector product followed by the decoding of
+ * independent blocks of detail vectors.
+ */
+class LoopDetailCodec {
+public:
+    LoopDetailCodec(Mesh& baseMesh, int levels);
+
+    inline int numLevels() const { return prolongations.size(); }
+    int numVerts(int level) const;
+
+    /**
+     * @brief getMesh The mesh of the finest level, whose positions follow the
+     * last decoded stream.
+     */
+    inline Mesh& getMesh() { return mesh; }
+
+    QByteArray encode(const QVector<QVector<QVector3D>>& levelCoords, float step) const;
+    bool decode(const QByteArray& data, QVector<QVector<QVector3D>>& levelCoords) const;
+    bool decode(const QByteArray& data);
+
+private:
+    void predict(int level, const QVector<QVector3D>& coarse, QVector<QVector3D>& fine) const;
+
+    static const int blockSize = 4096;
+    static const int maxOrder = 24;
+
+    QVector<QVector3D> baseCoords;
+    QVector<LoopProlongation> prolongations;
+    Mesh mesh;
+};
+
+#endif  // LOOP_DETAIL_CODEC_H
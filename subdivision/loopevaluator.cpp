@@ -0,0 +1,1170 @@
+#include "loopevaluator.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+#include <QHash>
+#include <QSet>
+#include <QVarLengthArray>
+
+#include "loopsubdivider.h"
+
+/**
+ * Bezier control points of a regular patch (in 1/24), as combinations of the
+ * 12 control points in the order of LocalPatch::gather. Row (i, j) holds the
+ * point whose Bernstein polynomial has power i of 1 - s - t, power j of s and
+ * power 4 - i - j of t.
+ */
+static const float bezierMasks[15][12] = {
+    {2, 2, 12, 2, 0, 0, 0, 0, 0, 2, 2, 2},
+    {3, 4, 12, 1, 0, 0, 0, 0, 0, 3, 1, 0},
+    {4, 8, 8, 0, 0, 0, 0, 0, 0, 4, 0, 0},
+    {3, 12, 4, 0, 0, 0, 1, 0, 1, 3, 0, 0},
+    {2, 12, 2, 0, 0, 0, 2, 2, 2, 2, 0, 0},
+    {4, 3, 12, 3, 0, 0, 0, 0, 0, 1, 0, 1},
+    {6, 6, 10, 1, 0, 0, 0, 0, 0, 1, 0, 0},
+    {6, 10, 6, 0, 0, 0, 1, 0, 0, 1, 0, 0},
+    {4, 12, 3, 0, 0, 0, 3, 1, 0, 1, 0, 0},
+    {8, 4, 8, 4, 0, 0, 0, 0, 0, 0, 0, 0},
+    {10, 6, 6, 1, 0, 0, 1, 0, 0, 0, 0, 0},
+    {8, 8, 4, 0, 0, 0, 4, 0, 0, 0, 0, 0},
+    {12, 3, 4, 3, 1, 0, 1, 0, 0, 0, 0, 0},
+    {12, 4, 3, 1, 0, 1, 3, 0, 0, 0, 0, 0},
+    {12, 2, 2, 2, 2, 2, 2, 0, 0, 0, 0, 0},
+};
+
+/**
+ * @brief netIndex Position of Bezier control point (i, j) of the given degree
+ * in a triangular net stored row by row.
+ */
+static inline int netIndex(int degree, int i, int j) {
+    return i * (2 * degree + 3 - i) / 2 + j;
+}
+
+/**
+ * @brief evaluateRegular Evaluates a regular patch. The control points are
+ * converted to the quartic Bezier net of the box spline, which de Casteljau's
+ * algorithm reduces to a linear triangle that gives both the position and the
+ * tangents.
+ * @param control The 12 control points.
+ * @param s Parameter towards the second corner.
+ * @param t Parameter towards the third corner.
+ * @param position Set to the position.
+ * @param normal Set to the unit normal.
+ */
+static void evaluateRegular(const QVector3D* control, float s, float t,
+                            QVector3D& position, QVector3D& normal) {
+    QVector3D net[15];
+    for (int r = 0; r < 15; ++r) {
+        QVector3D point;
+        for (int c = 0; c < 12; ++c) {
+            point += bezierMasks[r][c] * control[c];
+        }
+        net[r] = point / 24.0;
+    }
+
+    float w = 1.0 - s - t;
+    QVector3D reduced[15];
+    for (int degree = 4; degree > 1; --degree) {
+        for (int i = 0; i < degree; ++i) {
+            for (int j = 0; j < degree - i; ++j) {
+                reduced[netIndex(degree - 1, i, j)] = w * net[netIndex(degree, i + 1, j)] +
+                                                      s * net[netIndex(degree, i, j + 1)] +
+                                                      t * net[netIndex(degree, i, j)];
+            }
+        }
+        std::copy(reduced, reduced + netIndex(degree - 1, degree, 0), net);
+    }
+
+    QVector3D q0 = net[netIndex(1, 1, 0)];
+    QVector3D q1 = net[netIndex(1, 0, 1)];
+    QVector3D q2 = net[netIndex(1, 0, 0)];
+    position = w * q0 + s * q1 + t * q2;
+    normal = QVector3D::crossProduct(q1 - q0, q2 - q0).normalized();
+}
+
+/**
+ * @brief The LocalPatch class is a small triangle mesh over local vertex
+ * numbers, used to derive how the control points of a patch subdivide. In the
+ * subdivided patch, the vertex point of vertex a keeps number a and the edge
+ * point of edge (a, b) gets number edgePoint(a, b). Edges on the boundary of
+ * the surface are marked as such; any other edge with a single triangle is
+ * where the patch was cut out of the surface.
+ */
+class LocalPatch {
+public:
+    struct Triangle {
+        int v[3];
+    };
+
+    LocalPatch(int numVerts)
+        : numVerts(numVerts), boundaryNext(numVerts, -1), boundaryPrev(numVerts, -1), firstCorner(numVerts, -1),
+          lastCorner(numVerts, -1) {}
+
+    inline void addTriangle(int a, int b, int c) {
+        Triangle triangle = {{a, b, c}};
+        triangles.append(triangle);
+        for (int i = 0; i < 3; ++i) {
+            int corner = nextCorner.size();
+            int v = triangle.v[i];
+            nextCorner.append(-1);
+            if (lastCorner[v] < 0) {
+                firstCorner[v] = corner;
+            } else {
+                nextCorner[lastCorner[v]] = corner;
+            }
+            lastCorner[v] = corner;
+        }
+    }
+    inline void addBoundaryEdge(int a, int b) {
+        boundaryNext[a] = b;
+        boundaryPrev[b] = a;
+    }
+    inline bool isBoundaryVertex(int v) const { return boundaryNext[v] >= 0 || boundaryPrev[v] >= 0; }
+    inline int edgePoint(int a, int b) const { return numVerts + qMin(a, b) * numVerts + qMax(a, b); }
+
+    int ccwNext(int v, int w) const;
+    bool ring(int v, QVarLengthArray<int, 16>& neighbours) const;
+    bool gather(int v0, int v1, int valence, int* points) const;
+    bool stencil(int point, QVarLengthArray<int, 16>& indices, QVarLengthArray<double, 16>& weights) const;
+    LocalPatch subdivide() const;
+
+    int numVerts;
+    QVector<Triangle> triangles;
+    // The target of the boundary edge leaving every vertex and the origin of
+    // the one entering it, -1 if there is none
+    QVector<int> boundaryNext;
+    QVector<int> boundaryPrev;
+
+private:
+    // The corners (3 * triangle + i) of every vertex, in the order of the
+    // triangles
+    QVector<int> firstCorner;
+    QVector<int> lastCorner;
+    QVector<int> nextCorner;
+};
+
+/**
+ * @brief LocalPatch::ccwNext Finds the neighbour of v that follows w in
+ * counterclockwise order.
+ * @return The neighbour, -1 if there is no triangle (v, w, x).
+ */
+int LocalPatch::ccwNext(int v, int w) const {
+    for (int corner = firstCorner[v]; corner >= 0; corner = nextCorner[corner]) {
+        const Triangle& triangle = triangles[corner / 3];
+        if (triangle.v[(corner + 1) % 3] == w) {
+            return triangle.v[(corner + 2) % 3];
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief LocalPatch::ring Lists the neighbours of a vertex in counterclockwise
+ * order. On the boundary, the first and last are the boundary neighbours.
+ * @param v The vertex.
+ * @param neighbours Set to the neighbours.
+ * @return False if the ring does not close, or does not reach the boundary.
+ */
+bool LocalPatch::ring(int v, QVarLengthArray<int, 16>& neighbours) const {
+    neighbours.clear();
+    int start = boundaryNext[v];
+    int end = boundaryPrev[v];
+    if ((start < 0) != (end < 0)) {
+        return false;
+    }
+    if (start < 0 && lastCorner[v] >= 0) {
+        start = triangles[lastCorner[v] / 3].v[(lastCorner[v] + 1) % 3];
+    }
+
+    int neighbour = start;
+    while (neighbour >= 0 && neighbours.size() <= triangles.size()) {
+        neighbours.append(neighbour);
+        if (neighbour == end) {
+            return true;
+        }
+        neighbour = ccwNext(v, neighbour);
+        if (neighbour == start) {
+            return end < 0;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief LocalPatch::gather Lists the control points of the patch over the
+ * triangle (v0, v1, v2), with v2 the neighbour following v1 around v0. The
+ * order is v0, its ring counterclockwise starting at v1, the three remaining
+ * neighbours of v1 and the two remaining neighbours of v2. v1 and v2 have to
+ * be regular.
+ * @param v0 The first corner, of the provided valence.
+ * @param v1 The second corner.
+ * @param valence The valence of v0.
+ * @param points Receives valence + 6 points.
+ * @return False if the neighbourhood is incomplete or not of this shape.
+ */
+bool LocalPatch::gather(int v0, int v1, int valence, int* points) const {
+    int n = valence;
+    points[0] = v0;
+    points[1] = v1;
+    for (int i = 2; i <= n; ++i) {
+        points[i] = ccwNext(v0, points[i - 1]);
+        if (points[i] < 0) {
+            return false;
+        }
+    }
+    int v2 = points[2];
+    if (ccwNext(v0, points[n]) != v1 || ccwNext(v1, v0) != points[n]) {
+        return false;
+    }
+
+    for (int i = n + 1; i <= n + 3; ++i) {
+        points[i] = ccwNext(v1, points[i - 1]);
+        if (points[i] < 0) {
+            return false;
+        }
+    }
+    if (ccwNext(v1, points[n + 3]) != v2 || ccwNext(v2, v1) != points[n + 3]) {
+        return false;
+    }
+
+    for (int i = n + 4; i <= n + 5; ++i) {
+        points[i] = ccwNext(v2, points[i - 1]);
+        if (points[i] < 0) {
+            return false;
+        }
+    }
+    return ccwNext(v2, points[n + 5]) == points[3];
+}
+
+/**
+ * @brief LocalPatch::stencil Determines Loop's stencil of a point of the
+ * subdivided patch.
+ * @param point Number of the point in the subdivided patch.
+ * @param indices Set to the vertices of this patch in the stencil.
+ * @param weights Set to the corresponding weights.
+ * @return False if the neighbourhood of the point is incomplete.
+ */
+bool LocalPatch::stencil(int point, QVarLengthArray<int, 16>& indices,
+                         QVarLengthArray<double, 16>& weights) const {
+    indices.clear();
+    weights.clear();
+
+    if (point >= numVerts) {
+        int a = (point - numVerts) / numVerts;
+        int b = (point - numVerts) % numVerts;
+        if (boundaryNext[a] == b || boundaryNext[b] == a) {
+            indices.append(a);
+            indices.append(b);
+            weights.append(0.5);
+            weights.append(0.5);
+            return true;
+        }
+        int c = ccwNext(a, b);
+        int d = ccwNext(b, a);
+        if (c < 0 || d < 0) {
+            return false;
+        }
+        const int points[4] = {a, b, c, d};
+        const double edgeWeights[4] = {3.0 / 8.0, 3.0 / 8.0, 1.0 / 8.0, 1.0 / 8.0};
+        for (int i = 0; i < 4; ++i) {
+            indices.append(points[i]);
+            weights.append(edgeWeights[i]);
+        }
+        return true;
+    }
+
+    if (isBoundaryVertex(point)) {
+        int next = boundaryNext[point];
+        int prev = boundaryPrev[point];
+        if (next < 0 || prev < 0) {
+            return false;
+        }
+        const int points[3] = {point, next, prev};
+        const double vertexWeights[3] = {3.0 / 4.0, 1.0 / 8.0, 1.0 / 8.0};
+        for (int i = 0; i < 3; ++i) {
+            indices.append(points[i]);
+            weights.append(vertexWeights[i]);
+        }
+        return true;
+    }
+
+    QVarLengthArray<int, 16> neighbours;
+    if (!ring(point, neighbours)) {
+        return false;
+    }
+
+    double valence = neighbours.size();
+    double ringWeight = valence == 3.0 ? 3.0 / 16.0 : 3.0 / (8.0 * valence);
+    indices.append(point);
+    weights.append(1.0 - valence * ringWeight);
+    for (int v : neighbours) {
+        indices.append(v);
+        weights.append(ringWeight);
+    }
+    return true;
+}
+
+/**
+ * @brief LocalPatch::subdivide Splits every triangle into four.
+ * @return The subdivided patch.
+ */
+LocalPatch LocalPatch::subdivide() const {
+    LocalPatch child(numVerts * (numVerts + 1));
+    for (const Triangle& triangle : triangles) {
+        int a = triangle.v[0];
+        int b = triangle.v[1];
+        int c = triangle.v[2];
+        int ab = edgePoint(a, b);
+        int bc = edgePoint(b, c);
+        int ca = edgePoint(c, a);
+        child.addTriangle(a, ab, ca);
+        child.addTriangle(ab, b, bc);
+        child.addTriangle(ca, bc, c);
+        child.addTriangle(ab, bc, ca);
+    }
+    return child;
+}
+
+/**
+ * @brief gatherControlPoints Lists the control points of the patch over the
+ * face of the provided half-edge in the order of LocalPatch::gather.
+ * @param corner Half-edge leaving the first corner of the patch.
+ * @param valence The valence of the first corner.
+ * @param points Receives valence + 6 vertex indices.
+ * @return False if the neighbourhood is incomplete or not of this shape.
+ */
+static bool gatherControlPoints(const HalfEdge* corner, int valence, int* points) {
+    // Outgoing half-edges in counterclockwise order around their origin
+    auto rotate = [](const HalfEdge* edge) { return edge == nullptr ? nullptr : edge->prev->twin; };
+    auto target = [](const HalfEdge* edge) { return edge->next->origin->index; };
+    int n = valence;
+
+    points[0] = corner->origin->index;
+    const HalfEdge* edge = corner;
+    for (int i = 1; i <= n; ++i) {
+        points[i] = target(edge);
+        edge = rotate(edge);
+        if (edge == nullptr) {
+            return false;
+        }
+    }
+    if (edge != corner) {
+        return false;
+    }
+
+    edge = rotate(corner->twin);
+    if (edge == nullptr || target(edge) != points[n]) {
+        return false;
+    }
+    for (int i = n + 1; i <= n + 3; ++i) {
+        edge = rotate(edge);
+        if (edge == nullptr) {
+            return false;
+        }
+        points[i] = target(edge);
+    }
+    if (rotate(edge) != corner->next) {
+        return false;
+    }
+
+    edge = rotate(corner->next->twin);
+    if (edge == nullptr || target(edge) != points[n + 3]) {
+        return false;
+    }
+    for (int i = n + 4; i <= n + 5; ++i) {
+        edge = rotate(edge);
+        if (edge == nullptr) {
+            return false;
+        }
+        points[i] = target(edge);
+    }
+    edge = rotate(edge);
+    return edge != nullptr && target(edge) == points[3] && rotate(edge) == corner->prev;
+}
+
+/**
+ * @brief refineNeighbourhood Moves from the first triangle of a neighbourhood
+ * to the child that contains the provided point. The neighbourhood holds the
+ * faces within two rings of that triangle, so the vertices of the faces within
+ * one ring have complete stencils. Subdividing those faces gives the faces
+ * within two rings of every child, of which the ones of the chosen child are
+ * kept. The size of the neighbourhood therefore does not grow with the level.
+ * @param patch The neighbourhood, whose first triangle is (0, 1, 2). Replaced
+ * by the neighbourhood of the child, in the same form.
+ * @param points The positions of its vertices, replaced as well.
+ * @param barycentric The coordinates of the point in the first triangle,
+ * replaced by its coordinates in the child.
+ * @return False if a stencil is incomplete, e.g. on non-manifold meshes.
+ */
+static bool refineNeighbourhood(LocalPatch& patch, QVector<QVector3D>& points, float* barycentric) {
+    // The faces within one ring, split as in LocalPatch::subdivide
+    int numChildVerts = patch.numVerts * (patch.numVerts + 1);
+    QVector<LocalPatch::Triangle> children;
+    QVector<int> childBoundary(numChildVerts, -1);
+    children.reserve(4 * patch.triangles.size());
+    for (const LocalPatch::Triangle& triangle : patch.triangles) {
+        if (triangle.v[0] >= 3 && triangle.v[1] >= 3 && triangle.v[2] >= 3) {
+            continue;
+        }
+        int a = triangle.v[0];
+        int b = triangle.v[1];
+        int c = triangle.v[2];
+        int ab = patch.edgePoint(a, b);
+        int bc = patch.edgePoint(b, c);
+        int ca = patch.edgePoint(c, a);
+        const LocalPatch::Triangle split[4] = {{{a, ab, ca}}, {{ab, b, bc}}, {{ca, bc, c}}, {{ab, bc, ca}}};
+        for (const LocalPatch::Triangle& child : split) {
+            children.append(child);
+        }
+        for (int i = 0; i < 3; ++i) {
+            int v = triangle.v[i];
+            int w = triangle.v[(i + 1) % 3];
+            if (patch.boundaryNext[v] == w) {
+                childBoundary[v] = patch.edgePoint(v, w);
+                childBoundary[patch.edgePoint(v, w)] = w;
+            }
+        }
+    }
+
+    // The child that contains the point: the one at corner c, with the edge
+    // points of the edges of c in the other two positions, or the middle one
+    int target[3] = {patch.edgePoint(0, 1), patch.edgePoint(1, 2), patch.edgePoint(2, 0)};
+    int c = 0;
+    while (c < 3 && barycentric[c] < 0.5f) {
+        c++;
+    }
+    if (c < 3) {
+        target[c] = c;
+        target[(c + 1) % 3] = patch.edgePoint(c, (c + 1) % 3);
+        target[(c + 2) % 3] = patch.edgePoint(c, (c + 2) % 3);
+        for (int i = 0; i < 3; ++i) {
+            barycentric[i] = i == c ? 2.0f * barycentric[i] - 1.0f : 2.0f * barycentric[i];
+        }
+    } else {
+        const float middle[3] = {1.0f - 2.0f * barycentric[2], 1.0f - 2.0f * barycentric[0],
+                                 1.0f - 2.0f * barycentric[1]};
+        std::copy(middle, middle + 3, barycentric);
+    }
+
+    // Marks the vertices of the child, then those of the faces within one
+    // ring of it; the faces within two rings touch the latter
+    QVector<int> local(numChildVerts, -1);
+    QVector<char> rings(numChildVerts, 0);
+    auto touches = [](const LocalPatch::Triangle& triangle, const QVector<char>& marks, char mark) {
+        return marks[triangle.v[0]] >= mark || marks[triangle.v[1]] >= mark || marks[triangle.v[2]] >= mark;
+    };
+    for (int i = 0; i < 3; ++i) {
+        rings[target[i]] = 2;
+    }
+    for (const LocalPatch::Triangle& triangle : children) {
+        if (touches(triangle, rings, 2)) {
+            for (int i = 0; i < 3; ++i) {
+                rings[triangle.v[i]] = qMax(rings[triangle.v[i]], char(1));
+            }
+        }
+    }
+
+    // The child first, so that its corners are 0, 1 and 2
+    QVector<LocalPatch::Triangle> kept;
+    kept.reserve(children.size());
+    LocalPatch::Triangle first = {{target[0], target[1], target[2]}};
+    kept.append(first);
+    for (const LocalPatch::Triangle& triangle : children) {
+        bool isFirst = triangle.v[0] == target[0] && triangle.v[1] == target[1] && triangle.v[2] == target[2];
+        if (!isFirst && touches(triangle, rings, 1)) {
+            kept.append(triangle);
+        }
+    }
+
+    QVector<QVector3D> refined;
+    refined.reserve(3 * kept.size());
+    QVarLengthArray<int, 16> stencilIndices;
+    QVarLengthArray<double, 16> stencilWeights;
+    for (const LocalPatch::Triangle& triangle : kept) {
+        for (int i = 0; i < 3; ++i) {
+            int label = triangle.v[i];
+            if (local[label] >= 0) {
+                continue;
+            }
+            if (!patch.stencil(label, stencilIndices, stencilWeights)) {
+                return false;
+            }
+            QVector3D point;
+            for (int j = 0; j < stencilIndices.size(); ++j) {
+                point += stencilWeights[j] * points[stencilIndices[j]];
+            }
+            local[label] = refined.size();
+            refined.append(point);
+        }
+    }
+
+    LocalPatch next(refined.size());
+    for (const LocalPatch::Triangle& triangle : kept) {
+        next.addTriangle(local[triangle.v[0]], local[triangle.v[1]], local[triangle.v[2]]);
+        for (int i = 0; i < 3; ++i) {
+            int v = triangle.v[i];
+            int w = triangle.v[(i + 1) % 3];
+            if (childBoundary[v] == w) {
+                next.addBoundaryEdge(local[v], local[w]);
+            }
+        }
+    }
+    patch = std::move(next);
+    points = std::move(refined);
+    return true;
+}
+
+/**
+ * @brief LoopEvaluator::LoopEvaluator Builds the patches of every face of the
+ * provided mesh. The evaluator keeps its own copy of the control points, later
+ * changes to the mesh are not picked up. The mesh is not modified.
+ * @param mesh A triangle mesh, e.g. a base mesh or a mesh of any level.
+ */
+LoopEvaluator::LoopEvaluator(Mesh& mesh) {
+    const QVector<Vertex>& vertices = mesh.getVertices();
+    const QVector<HalfEdge>& halfEdges = mesh.getHalfEdges();
+    int numVerts = mesh.numVerts();
+    int numFaces = mesh.numFaces();
+    int maxSteps = mesh.numHalfEdges();
+
+    // Valence of every interior vertex, -1 for boundary vertices. Faces with a
+    // corner of valence below 3 are treated as boundary faces.
+    QVector<int> valences(numVerts);
+    points.resize(numVerts);
+    int* valenceData = valences.data();
+    QVector3D* pointData = points.data();
+
+    #pragma omp parallel for
+    for (int v = 0; v < numVerts; v++) {
+        const Vertex& vertex = vertices[v];
+        pointData[v] = vertex.coords;
+        int valence = -1;
+        if (vertex.out != nullptr) {
+            const HalfEdge* edge = vertex.out;
+            valence = 0;
+            do {
+                valence++;
+                edge = edge->prev->twin;
+            } while (edge != nullptr && edge != vertex.out && valence < maxSteps);
+            valence = edge == vertex.out ? valence : -1;
+        }
+        valenceData[v] = valence;
+    }
+
+    // Faces with at most one extraordinary corner are a single patch, which
+    // starts at that corner
+    faces.resize(numFaces);
+    patches.resize(numFaces);
+    QVector<int> corners(3 * numFaces);
+    QVector<int> offsets(numFaces + 1);
+    FacePatches* faceData = faces.data();
+    int* offsetData = offsets.data();
+    int* cornerData = corners.data();
+
+    #pragma omp parallel for
+    for (int f = 0; f < numFaces; f++) {
+        int extraordinary = 0;
+        int corner = 0;
+        bool boundary = false;
+        for (int c = 0; c < 3; ++c) {
+            int v = halfEdges[3 * f + c].origin->index;
+            cornerData[3 * f + c] = v;
+            if (valenceData[v] < 3) {
+                boundary = true;
+            } else if (valenceData[v] != 6) {
+                extraordinary++;
+                corner = c;
+            }
+        }
+
+        if (boundary) {
+            faceData[f] = {PATCH_BOUNDARY, 0, -1};
+        } else if (extraordinary > 1) {
+            faceData[f] = {PATCH_SPLIT, 0, -1};
+        } else {
+            faceData[f] = {PATCH_DIRECT, corner, f};
+        }
+        bool direct = faceData[f].kind == PATCH_DIRECT;
+        offsetData[f + 1] = direct ? valenceData[cornerData[3 * f + corner]] + 6 : 0;
+    }
+
+    for (int f = 0; f < numFaces; f++) {
+        offsets[f + 1] += offsets[f];
+    }
+    indices.resize(offsets[numFaces]);
+    int* indexData = indices.data();
+    Patch* patchData = patches.data();
+
+    #pragma omp parallel for
+    for (int f = 0; f < numFaces; f++) {
+        FacePatches& face = faceData[f];
+        if (face.kind != PATCH_DIRECT) {
+            continue;
+        }
+        int valence = valenceData[cornerData[3 * f + face.corner]];
+        patchData[f] = {valence, offsetData[f]};
+        if (!gatherControlPoints(&halfEdges[3 * f + face.corner], valence, indexData + offsetData[f])) {
+            face.kind = PATCH_BOUNDARY;
+        }
+    }
+
+    for (int f = 0; f < numFaces; f++) {
+        if (faces[f].kind == PATCH_SPLIT) {
+            splitFace(mesh, f, valences);
+        }
+    }
+
+    for (int f = 0; f < numFaces; f++) {
+        if (faces[f].kind == PATCH_BOUNDARY) {
+            gatherNeighbourhood(mesh, f, valences);
+        }
+    }
+
+    // The slots of split and boundary faces are unused
+    for (const FacePatches& face : faces) {
+        int count = face.kind == PATCH_SPLIT ? 4 : face.kind == PATCH_DIRECT ? 1 : 0;
+        for (int i = 0; i < count; ++i) {
+            int valence = patches[face.patch + i].valence;
+            if (valence != 6 && (valence >= tables.size() || tables[valence].matrices.isEmpty())) {
+                buildTable(valence);
+            }
+        }
+    }
+}
+
+/**
+ * @brief LoopEvaluator::splitFace Splits a face with several extraordinary
+ * corners into the patches of its four children, by subdividing its
+ * neighbourhood once. The control points of the children are added to the
+ * points of the evaluator.
+ * @param mesh The mesh the evaluator is built from.
+ * @param f The face to split.
+ * @param valences The valence of every vertex of the mesh.
+ */
+void LoopEvaluator::splitFace(Mesh& mesh, int f, const QVector<int>& valences) {
+    const QVector<HalfEdge>& halfEdges = mesh.getHalfEdges();
+
+    // The faces around the corners, over local vertex numbers. On
+    // non-manifold vertices the fan of the face may not be the one the
+    // valence was counted on, so the walks are bounded by the valence.
+    QVector<int> local;
+    QVector<int> neighbourhood;
+    for (int c = 0; c < 3; ++c) {
+        const HalfEdge* start = &halfEdges[3 * f + c];
+        const HalfEdge* edge = start;
+        int steps = 0;
+        do {
+            if (!neighbourhood.contains(edge->faceIdx())) {
+                neighbourhood.append(edge->faceIdx());
+            }
+            edge = edge->prev->twin;
+        } while (edge != nullptr && edge != start && ++steps < valences[start->origin->index]);
+        if (edge != start) {
+            faces[f].kind = PATCH_BOUNDARY;
+            return;
+        }
+    }
+    auto localIndex = [&local](int v) {
+        int i = local.indexOf(v);
+        if (i < 0) {
+            local.append(v);
+            i = local.size() - 1;
+        }
+        return i;
+    };
+    int corners[3];
+    for (int c = 0; c < 3; ++c) {
+        corners[c] = localIndex(halfEdges[3 * f + c].origin->index);
+    }
+    QVector<int> triangles;
+    for (int g : neighbourhood) {
+        for (int c = 0; c < 3; ++c) {
+            triangles.append(localIndex(halfEdges[3 * g + c].origin->index));
+        }
+    }
+
+    LocalPatch patch(local.size());
+    for (int i = 0; i < triangles.size(); i += 3) {
+        patch.addTriangle(triangles[i], triangles[i + 1], triangles[i + 2]);
+    }
+    LocalPatch child = patch.subdivide();
+
+    // The three corners, then the middle, see evaluate
+    int first = patches.size();
+    QVarLengthArray<int, 16> stencilIndices;
+    QVarLengthArray<double, 16> stencilWeights;
+    for (int i = 0; i < 4; ++i) {
+        int valence = 6;
+        int v0 = patch.edgePoint(corners[1], corners[2]);
+        int v1 = patch.edgePoint(corners[0], corners[2]);
+        if (i < 3) {
+            valence = valences[local[corners[i]]];
+            v0 = corners[i];
+            v1 = patch.edgePoint(corners[i], corners[(i + 1) % 3]);
+        }
+
+        QVarLengthArray<int, 32> labels(valence + 6);
+        if (!child.gather(v0, v1, valence, labels.data())) {
+            faces[f].kind = PATCH_BOUNDARY;
+            patches.resize(first);
+            return;
+        }
+        patches.append({valence, int(indices.size())});
+        for (int label : labels) {
+            QVector3D point;
+            patch.stencil(label, stencilIndices, stencilWeights);
+            for (int j = 0; j < stencilIndices.size(); ++j) {
+                point += stencilWeights[j] * points[local[stencilIndices[j]]];
+            }
+            indices.append(points.size());
+            points.append(point);
+        }
+    }
+    faces[f].patch = first;
+}
+
+/**
+ * @brief LoopEvaluator::gatherNeighbourhood Copies the faces within two rings
+ * of a boundary face, which is what evaluateBoundary subdivides. The tables
+ * of the extraordinary vertices among them are built as well, since the
+ * sub-patches they end up in are evaluated with them.
+ * @param mesh The mesh the evaluator is built from.
+ * @param f The boundary face.
+ * @param valences The valence of every vertex of the mesh.
+ */
+void LoopEvaluator::gatherNeighbourhood(Mesh& mesh, int f, const QVector<int>& valences) {
+    const QVector<HalfEdge>& halfEdges = mesh.getHalfEdges();
+    int maxSteps = mesh.numHalfEdges();
+
+    // The faces around the corners, then the faces around their vertices
+    QVector<int> neighbourhood;
+    QSet<int> included;
+    neighbourhood.append(f);
+    included.insert(f);
+    QVarLengthArray<HalfEdge*, 16> outgoing;
+    for (int r = 0; r < 2; ++r) {
+        int count = neighbourhood.size();
+        for (int i = 0; i < count; ++i) {
+            for (int c = 0; c < 3; ++c) {
+                outgoing.clear();
+                halfEdges[3 * neighbourhood[i] + c].origin->outgoingHalfEdges(outgoing, maxSteps);
+                for (const HalfEdge* edge : outgoing) {
+                    int g = edge->faceIdx();
+                    if (!included.contains(g)) {
+                        included.insert(g);
+                        neighbourhood.append(g);
+                    }
+                }
+            }
+        }
+    }
+
+    // The corners of f come first, since neighbourhood starts with f
+    QHash<int, int> local;
+    Neighbourhood patch = {int(boundaryPoints.size()), 0, int(boundaryTriangles.size()),
+                           int(neighbourhood.size()), int(boundaryEdges.size()), 0};
+    for (int g : neighbourhood) {
+        for (int c = 0; c < 3; ++c) {
+            const HalfEdge& edge = halfEdges[3 * g + c];
+            int v = edge.origin->index;
+            if (!local.contains(v)) {
+                local.insert(v, local.size());
+                boundaryPoints.append(points[v]);
+                int valence = valences[v];
+                if (valence >= 3 && valence != 6 && (valence >= tables.size() || tables[valence].matrices.isEmpty())) {
+                    buildTable(valence);
+                }
+            }
+            boundaryTriangles.append(local.value(v));
+        }
+    }
+    for (int g : neighbourhood) {
+        for (int c = 0; c < 3; ++c) {
+            const HalfEdge& edge = halfEdges[3 * g + c];
+            if (edge.twin == nullptr) {
+                boundaryEdges.append(local.value(edge.origin->index));
+                boundaryEdges.append(local.value(edge.next->origin->index));
+                patch.numEdges++;
+            }
+        }
+    }
+    patch.numPoints = local.size();
+    faces[f].patch = neighbourhoods.size();
+    neighbourhoods.append(patch);
+}
+
+/**
+ * @brief LoopEvaluator::buildTable Tabulates, for every level n below the
+ * depth of the table, the matrices that map the control points of a patch with an
+ * extraordinary corner of the provided valence to the control points of its
+ * three regular sub-patches of level n + 1. These are the products of the
+ * picking and subdivision matrices of Stam (1998); tabulating the powers
+ * replaces his eigen decomposition. The matrices are kept in double precision,
+ * since the sub-patches of deep levels differ from each other only in the
+ * trailing digits. The depth stops where the sub-patches, which shrink with
+ * the subdominant eigenvalue, are no longer resolved in double precision.
+ * @param valence The valence of the extraordinary corner.
+ */
+void LoopEvaluator::buildTable(int valence) {
+    int n = valence;
+    int size = n + 6;
+
+    // The neighbourhood of a patch, in the order of LocalPatch::gather
+    LocalPatch patch(size);
+    for (int i = 1; i <= n; ++i) {
+        patch.addTriangle(0, i, i % n + 1);
+    }
+    patch.addTriangle(1, n, n + 1);
+    patch.addTriangle(1, n + 1, n + 2);
+    patch.addTriangle(1, n + 2, n + 3);
+    patch.addTriangle(1, n + 3, 2);
+    patch.addTriangle(2, n + 3, n + 4);
+    patch.addTriangle(2, n + 4, n + 5);
+    patch.addTriangle(2, n + 5, 3);
+    LocalPatch child = patch.subdivide();
+
+    // The sub-patch at the extraordinary corner, and the regular sub-patches
+    // at the second corner, the third corner and in the middle
+    int e01 = patch.edgePoint(0, 1);
+    int e02 = patch.edgePoint(0, 2);
+    int e12 = patch.edgePoint(1, 2);
+    QVector<int> irregular(size);
+    int regular[3][12];
+    child.gather(0, e01, n, irregular.data());
+    child.gather(e01, 1, 6, regular[0]);
+    child.gather(e02, e12, 6, regular[1]);
+    child.gather(e12, e02, 6, regular[2]);
+
+    QVarLengthArray<int, 16> stencilIndices;
+    QVarLengthArray<double, 16> stencilWeights;
+    auto addRow = [&](int point, double* row) {
+        patch.stencil(point, stencilIndices, stencilWeights);
+        for (int j = 0; j < stencilIndices.size(); ++j) {
+            row[stencilIndices[j]] += stencilWeights[j];
+        }
+    };
+
+    QVector<double> subdivision(size * size, 0.0);
+    QVector<double> picking(3 * 12 * size, 0.0);
+    for (int r = 0; r < size; ++r) {
+        addRow(irregular[r], subdivision.data() + r * size);
+    }
+    for (int k = 0; k < 3; ++k) {
+        for (int r = 0; r < 12; ++r) {
+            addRow(regular[k][r], picking.data() + (k * 12 + r) * size);
+        }
+    }
+
+    if (tables.size() <= valence) {
+        tables.resize(valence + 1);
+    }
+    ValenceTable& table = tables[valence];
+    double subdominant = 3.0 / 8.0 + cos(2.0 * M_PI / valence) / 4.0;
+    int depth = log(1e-10) / log(subdominant);
+    table.depth = depth < maxDepth ? depth : maxDepth;
+    QVector<double>& matrices = table.matrices;
+    matrices.resize(table.depth * 3 * 12 * size);
+
+    // power holds the subdivision matrix to the power depth
+    QVector<double> power(size * size, 0.0);
+    QVector<double> next(size * size);
+    for (int i = 0; i < size; ++i) {
+        power[i * size + i] = 1.0;
+    }
+    for (int depth = 0; depth < table.depth; ++depth) {
+        for (int r = 0; r < 3 * 12; ++r) {
+            for (int j = 0; j < size; ++j) {
+                double sum = 0.0;
+                for (int m = 0; m < size; ++m) {
+                    sum += picking[r * size + m] * power[m * size + j];
+                }
+                matrices[(depth * 3 * 12 + r) * size + j] = sum;
+            }
+        }
+        for (int r = 0; r < size; ++r) {
+            for (int j = 0; j < size; ++j) {
+                double sum = 0.0;
+                for (int m = 0; m < size; ++m) {
+                    sum += subdivision[r * size + m] * power[m * size + j];
+                }
+                next[r * size + j] = sum;
+            }
+        }
+        std::swap(power, next);
+    }
+}
+
+/**
+ * @brief LoopEvaluator::evaluatePatch Evaluates one of the patches of the
+ * faces.
+ * @param patch The patch.
+ * @param s Parameter towards the second corner.
+ * @param t Parameter towards the third corner.
+ * @param position Set to the position.
+ * @param normal Set to the unit normal.
+ */
+void LoopEvaluator::evaluatePatch(const Patch& patch, float s, float t,
+                                  QVector3D& position, QVector3D& normal) const {
+    const int* patchIndices = indices.constData() + patch.offset;
+    const QVector3D* pointData = points.constData();
+    QVarLengthArray<QVector3D, 32> control(patch.valence + 6);
+    for (int i = 0; i < control.size(); ++i) {
+        control[i] = pointData[patchIndices[i]];
+    }
+    evaluatePatch(patch.valence, control.constData(), s, t, position, normal);
+}
+
+/**
+ * @brief LoopEvaluator::evaluatePatch Evaluates a patch. Near an
+ * extraordinary corner, the parameters are scaled up until they leave the
+ * sub-patch at that corner; the regular sub-patch they end up in is then
+ * evaluated from the tabulated control points.
+ * @param valence The valence of the first corner. The table of the valence
+ * has to be built.
+ * @param control The valence + 6 control points, in the order of
+ * LocalPatch::gather.
+ * @param s Parameter towards the second corner.
+ * @param t Parameter towards the third corner.
+ * @param position Set to the position.
+ * @param normal Set to the unit normal.
+ */
+void LoopEvaluator::evaluatePatch(int valence, const QVector3D* control, float s, float t,
+                                  QVector3D& position, QVector3D& normal) const {
+    if (valence == 6) {
+        evaluateRegular(control, s, t, position, normal);
+        return;
+    }
+
+    const ValenceTable& table = tables[valence];
+    int depth = 0;
+    while (s + t < 0.5f && depth < table.depth - 1) {
+        s *= 2.0f;
+        t *= 2.0f;
+        depth++;
+    }
+    // Points closer to the corner than the last level are moved onto it
+    if (s + t < 0.5f) {
+        float scale = s + t > 0.0f ? 0.5f / (s + t) : 0.0f;
+        s = s + t > 0.0f ? s * scale : 0.25f;
+        t = t > 0.0f ? t * scale : 0.5f - s;
+    }
+
+    int k;
+    if (s >= 0.5f) {
+        k = 0;
+        s = 2.0f * s - 1.0f;
+        t = 2.0f * t;
+    } else if (t >= 0.5f) {
+        k = 1;
+        s = 2.0f * s;
+        t = 2.0f * t - 1.0f;
+    } else {
+        k = 2;
+        s = 1.0f - 2.0f * s;
+        t = 1.0f - 2.0f * t;
+    }
+
+    int size = valence + 6;
+    const double* matrix = table.matrices.constData() + (depth * 3 + k) * 12 * size;
+    double sub[12][3] = {};
+    for (int r = 0; r < 12; ++r) {
+        for (int j = 0; j < size; ++j) {
+            const QVector3D& point = control[j];
+            for (int i = 0; i < 3; ++i) {
+                sub[r][i] += matrix[r * size + j] * point[i];
+            }
+        }
+    }
+
+    // Deep sub-patches are tiny compared to their position, so they are
+    // evaluated relative to their first control point and scaled to unit size
+    // to keep the tangents
+    double extent = 0.0;
+    for (int r = 1; r < 12; ++r) {
+        for (int i = 0; i < 3; ++i) {
+            extent = qMax(extent, qAbs(sub[r][i] - sub[0][i]));
+        }
+    }
+    extent = extent > 0.0 ? extent : 1.0;
+    QVector3D regular[12];
+    for (int r = 0; r < 12; ++r) {
+        regular[r] = QVector3D((sub[r][0] - sub[0][0]) / extent, (sub[r][1] - sub[0][1]) / extent,
+                               (sub[r][2] - sub[0][2]) / extent);
+    }
+    evaluateRegular(regular, s, t, position, normal);
+    position = position * extent + QVector3D(sub[0][0], sub[0][1], sub[0][2]);
+}
+
+/**
+ * @brief LoopEvaluator::evaluateBoundary Evaluates a boundary face. Its
+ * neighbourhood is subdivided towards the point, see refineNeighbourhood,
+ * until the sub-face that contains the point has interior corners of which at
+ * most one is extraordinary. That sub-face is a patch, whose control points
+ * are the vertices around it. After boundaryDepth levels the limit positions
+ * and normals of the corners of the sub-face are interpolated instead.
+ * @param f The face.
+ * @param barycentric The coordinates of the point with respect to the corners.
+ * @param position Set to the position.
+ * @param normal Set to the unit normal.
+ * @return False if the point was interpolated.
+ */
+bool LoopEvaluator::evaluateBoundary(int f, const float* barycentric, QVector3D& position,
+                                     QVector3D& normal) const {
+    const Neighbourhood& neighbourhood = neighbourhoods[faces[f].patch];
+    const int* triangles = boundaryTriangles.constData() + neighbourhood.triangleOffset;
+    const int* edges = boundaryEdges.constData() + neighbourhood.edgeOffset;
+    LocalPatch patch(neighbourhood.numPoints);
+    for (int i = 0; i < neighbourhood.numTriangles; ++i) {
+        patch.addTriangle(triangles[3 * i], triangles[3 * i + 1], triangles[3 * i + 2]);
+    }
+    for (int i = 0; i < neighbourhood.numEdges; ++i) {
+        patch.addBoundaryEdge(edges[2 * i], edges[2 * i + 1]);
+    }
+    // The points are kept relative to the first corner, since the sub-faces
+    // of deep levels are tiny compared to their position, see evaluatePatch
+    QVector3D origin = boundaryPoints[neighbourhood.pointOffset];
+    QVector<QVector3D> local(neighbourhood.numPoints);
+    for (int i = 0; i < neighbourhood.numPoints; ++i) {
+        local[i] = boundaryPoints[neighbourhood.pointOffset + i] - origin;
+    }
+    float w[3] = {barycentric[0], barycentric[1], barycentric[2]};
+
+    QVarLengthArray<int, 16> ring;
+    for (int depth = 0; depth <= boundaryDepth; ++depth) {
+        bool boundary = false;
+        bool complete = true;
+        int extraordinary = 0;
+        int corner = 0;
+        int valences[3];
+        for (int c = 0; c < 3; ++c) {
+            if (patch.isBoundaryVertex(c)) {
+                boundary = true;
+                continue;
+            }
+            complete = complete && patch.ring(c, ring);
+            valences[c] = ring.size();
+            if (valences[c] != 6) {
+                extraordinary++;
+                corner = c;
+                complete = complete && valences[c] >= 3 && valences[c] < tables.size() &&
+                           !tables[valences[c]].matrices.isEmpty();
+            }
+        }
+        if (!complete) {
+            break;
+        }
+
+        if (!boundary && extraordinary <= 1) {
+            int n = valences[corner];
+            QVarLengthArray<int, 32> labels(n + 6);
+            if (!patch.gather(corner, (corner + 1) % 3, n, labels.data())) {
+                break;
+            }
+            QVarLengthArray<QVector3D, 32> control(n + 6);
+            for (int i = 0; i < n + 6; ++i) {
+                control[i] = local[labels[i]];
+            }
+            evaluatePatch(n, control.constData(), w[(corner + 1) % 3], w[(corner + 2) % 3], position, normal);
+            position += origin;
+            return true;
+        }
+        if (depth == boundaryDepth || !refineNeighbourhood(patch, local, w)) {
+            break;
+        }
+        QVector3D shift = local[0];
+        for (QVector3D& point : local) {
+            point -= shift;
+        }
+        origin += shift;
+    }
+
+    // Corners whose ring is incomplete keep their position and take the
+    // normal of the sub-face
+    QVector3D faceNormal = QVector3D::crossProduct(local[1] - local[0], local[2] - local[0]).normalized();
+    position = QVector3D();
+    normal = QVector3D();
+    for (int c = 0; c < 3; ++c) {
+        QVector3D cornerPosition = local[c];
+        QVector3D cornerNormal = faceNormal;
+        if (patch.ring(c, ring)) {
+            QVarLengthArray<QVector3D, 16> coords;
+            for (int v : ring) {
+                coords.append(local[v]);
+            }
+            LoopSubdivider::limitPoint(local[c], coords, patch.isBoundaryVertex(c), cornerPosition, cornerNormal);
+        }
+        position += w[c] * cornerPosition;
+        normal += w[c] * cornerNormal;
+    }
+    position += origin;
+    normal.normalize();
+    return false;
+}
+
+/**
+ * @brief LoopEvaluator::evaluate Evaluates the limit surface at a single
+ * sample.
+ * @param sample The face and parameters, see SurfaceSample.
+ * @param position Set to the position on the limit surface.
+ * @param normal Set to the unit normal of the limit surface.
+ * @return False if the sample lies too close to the boundary and was
+ * interpolated, see evaluateBoundary.
+ */
+bool LoopEvaluator::evaluate(const SurfaceSample& sample, QVector3D& position,
+                             QVector3D& normal) const {
+    float u = qBound(0.0f, sample.u, 1.0f);
+    float v = qBound(0.0f, sample.v, 1.0f - u);
+    const float barycentric[3] = {1.0f - u - v, u, v};
+    const FacePatches& face = faces[sample.face];
+
+    if (face.kind == PATCH_DIRECT) {
+        int c = face.corner;
+        evaluatePatch(patches[face.patch], barycentric[(c + 1) % 3], barycentric[(c + 2) % 3], position, normal);
+    } else if (face.kind == PATCH_SPLIT) {
+        for (int c = 0; c < 3; ++c) {
+            if (barycentric[c] >= 0.5f) {
+                evaluatePatch(patches[face.patch + c], 2.0f * barycentric[(c + 1) % 3],
+                              2.0f * barycentric[(c + 2) % 3], position, normal);
+                return true;
+            }
+        }
+        evaluatePatch(patches[face.patch + 3], 1.0f - 2.0f * u, 1.0f - 2.0f * v, position, normal);
+    } else {
+        return evaluateBoundary(sample.face, barycentric, position, normal);
+    }
+    return true;
+}
+
+/**
+ * @brief LoopEvaluator::evaluate Evaluates the limit surface at many samples
+ * in parallel.
+ * @param samples The faces and parameters, see SurfaceSample.
+ * @param positions Set to the positions on the limit surface.
+ * @param normals Set to the unit normals of the limit surface.
+ * @param exact If provided, set to whether each sample was evaluated exactly,
+ * see evaluate.
+ */
+void LoopEvaluator::evaluate(const QVector<SurfaceSample>& samples,
+                             QVector<QVector3D>& positions,
+                             QVector<QVector3D>& normals, QVector<bool>* exact) const {
+    positions.resize(samples.size());
+    normals.resize(samples.size());
+    const SurfaceSample* sampleData = samples.constData();
+    QVector3D* positionData = positions.data();
+    QVector3D* normalData = normals.data();
+    bool* exactData = nullptr;
+    if (exact != nullptr) {
+        exact->resize(samples.size());
+        exactData = exact->data();
+    }
+
+    #pragma omp parallel for
+    for (int i = 0; i < samples.size(); i++) {
+        bool evaluated = evaluate(sampleData[i], positionData[i], normalData[i]);
+        if (exactData != nullptr) {
+            exactData[i] = evaluated;
+        }
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef LOOP_EVALUATOR_H
+#define LOOP_EVALUATOR_H
+
+#include <QVector>
+#include <QVector3D>
+
+#include "mesh/mesh.h"
+
+/**
+ * @brief The SurfaceSample struct is a point on the limit surface over a face
+ * of the control mesh. The point lies at (1 - u - v) c0 + u c1 + v c2, where
+ * c0, c1 and c2 are the origins of the half-edges 3f, 3f + 1 and 3f + 2.
+ */
+struct SurfaceSample {
+    int face;
+    float u;
+    float v;
+};
+
+/**
+ * @brief The LoopEvaluator class evaluates the limit surface of Loop
+ * subdivision at arbitrary parameters, without refining the mesh. Faces whose
+ * corners are all regular are quartic box-spline patches, evaluated in Bezier
+ * form. Faces with one extraordinary corner are evaluated following Stam
+ * (1998): the point is located in a regular sub-patch n levels down, whose
+ * control points are a precomputed linear map of the control points of the
+ * face. Faces with several extraordinary corners are split once when the
+ * evaluator is built, so that each part has at most one. Faces touching the
+ * boundary are followed down by subdividing their neighbourhood, with the
+ * boundary rules, until the sub-face that contains the point no longer
+ * touches the boundary and is one of these patches. Points that are still on
+ * a boundary sub-face after boundaryDepth levels interpolate the limit
+ * positions and normals of its corners; these samples are reported as not
+ * exact.
+ */
+class LoopEvaluator {
+public:
+    LoopEvaluator(Mesh& mesh);
+
+    bool evaluate(const SurfaceSample& sample, QVector3D& position, QVector3D& normal) const;
+    void evaluate(const QVector<SurfaceSample>& samples, QVector<QVector3D>& positions,
+                  QVector<QVector3D>& normals, QVector<bool>* exact = nullptr) const;
+
+private:
+    enum PatchKind { PATCH_DIRECT, PATCH_SPLIT, PATCH_BOUNDARY };
+
+    // Control points of a patch: points[indices[offset + i]] for i < valence + 6,
+    // in the order of LocalPatch::gather. Valence 6 patches are regular.
+    struct Patch {
+        int valence;
+        int offset;
+    };
+
+    // A face is a single patch with the extraordinary corner (if any) first,
+    // four patches (the three corners and the middle) for split faces, or a
+    // boundary face with its neighbourhood
+    struct FacePatches {
+        PatchKind kind;
+        int corner;
+        int patch;
+    };
+
+    // Maps the control points of an irregular patch to the regular sub-patches
+    // (corner 1, corner 2 and middle) of every level below depth
+    struct ValenceTable {
+        int depth;
+        QVector<double> matrices;
+    };
+
+    // The faces within two rings of a boundary face, over local vertex numbers
+    // that start with the corners of the face, and the boundary edges among
+    // their edges. The local numbers index boundaryPoints from pointOffset.
+    struct Neighbourhood {
+        int pointOffset;
+        int numPoints;
+        int triangleOffset;
+        int numTriangles;
+        int edgeOffset;
+        int numEdges;
+    };
+
+    void buildTable(int valence);
+    void splitFace(Mesh& mesh, int f, const QVector<int>& valences);
+    void gatherNeighbourhood(Mesh& mesh, int f, const QVector<int>& valences);
+    void evaluatePatch(const Patch& patch, float s, float t, QVector3D& position, QVector3D& normal) const;
+    void evaluatePatch(int valence, const QVector3D* control, float s, float t, QVector3D& position,
+                       QVector3D& normal) const;
+    bool evaluateBoundary(int f, const float* barycentric, QVector3D& position, QVector3D& normal) const;
+
+    static const int maxDepth = 48;
+    static const int boundaryDepth = 12;
+
+    QVector<QVector3D> points;
+    QVector<int> indices;
+    QVector<Patch> patches;
+    QVector<FacePatches> faces;
+    QVector<ValenceTable> tables;
+
+    QVector<Neighbourhood> neighbourhoods;
+    QVector<QVector3D> boundaryPoints;
+    QVector<int> boundaryTriangles;
+    QVector<int> boundaryEdges;
+};
+
+#endif  // LOOP_EVALUATOR_H
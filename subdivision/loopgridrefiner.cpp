@@ -0,0 +1,372 @@
+#include "loopgridrefiner.h"
+
+#include <QVarLengthArray>
+
+#include <algorithm>
+
+#include "initialization/meshinitializer.h"
+#include "loopsubdivider.h"
+#include "looptopologygenerator.h"
+#include "mesh/meshvalidator.h"
+
+// Lattice offsets of the six neighbours of a grid point, counterclockwise
+static const int directions[6][2] = {{1, 0}, {0, 1}, {-1, 1}, {-1, 0}, {0, -1}, {1, -1}};
+// Position of the corners of a face on the level 0 grid, and the direction of
+// the half-edge that leaves each corner
+static const int corners[3][2] = {{0, 0}, {1, 0}, {0, 1}};
+static const int cornerDirections[3] = {0, 2, 4};
+
+/**
+ * @brief gridPoints The number of points of a grid of a level, apron included:
+ * the points with i, j >= -1 and i + j <= n + 1.
+ */
+static inline int gridPoints(int level) {
+    int n = 1 << level;
+    return (n + 4) * (n + 5) / 2;
+}
+
+/**
+ * @brief gridIndex The index of point (i, j) within a grid of size n. Rows of
+ * constant i are stored one after the other.
+ */
+static inline int gridIndex(int n, int i, int j) {
+    int row = i + 1;
+    return row * (n + 4) - row * (row - 1) / 2 + j + 1;
+}
+
+/**
+ * @brief refineGrid Applies the Loop stencils of the regular lattice to a
+ * grid of size n, apron included. The three corners of the apron are not
+ * adjacent to the face and are neither read nor written.
+ * @param coarse The grid of size n.
+ * @param fine Set to the grid of size 2n.
+ * @param n The size of the coarse grid.
+ */
+static void refineGrid(const QVector3D* coarse, QVector3D* fine, int n) {
+    int fineN = 2 * n;
+    auto at = [&](int i, int j) -> const QVector3D& { return coarse[gridIndex(n, i, j)]; };
+
+    for (int I = -1; I <= fineN + 1; ++I) {
+        for (int J = -1; J <= fineN + 1 - I; ++J) {
+            if (I == -1 && (J == -1 || J == fineN + 2)) {
+                continue;
+            }
+            int i = (I - (I & 1)) / 2;
+            int j = (J - (J & 1)) / 2;
+            QVector3D& point = fine[gridIndex(fineN, I, J)];
+            if (!(I & 1) && !(J & 1)) {
+                // Vertex point, beta = 1 / 16
+                point = 0.625f * at(i, j) + 0.0625f * (at(i + 1, j) + at(i, j + 1) + at(i - 1, j + 1) +
+                                                       at(i - 1, j) + at(i, j - 1) + at(i + 1, j - 1));
+            } else if (!(J & 1)) {
+                point = 0.375f * (at(i, j) + at(i + 1, j)) + 0.125f * (at(i, j + 1) + at(i + 1, j - 1));
+            } else if (!(I & 1)) {
+                point = 0.375f * (at(i, j) + at(i, j + 1)) + 0.125f * (at(i + 1, j) + at(i - 1, j + 1));
+            } else {
+                point = 0.375f * (at(i + 1, j) + at(i, j + 1)) + 0.125f * (at(i, j) + at(i + 1, j + 1));
+            }
+        }
+    }
+}
+
+/**
+ * @brief mapVertices Finds the vertices of the subdivided mesh that the points
+ * of a face lie on, by following the faces that descend from it down to the
+ * level of the generator. The corner faces 3f + c and middle face 3F + f
+ * follow LoopSubdivider::topologyRefinement.
+ * @param generator Generates the faces of the subdivided mesh.
+ * @param level The level of the face.
+ * @param levelFaces The number of faces of that level.
+ * @param face Index of the face.
+ * @param points The grid positions of the origins of the three half-edges of
+ * the face.
+ * @param n The grid size of the level of the generator.
+ * @param map Receives, at the grid index of every point, the vertex index.
+ */
+static void mapVertices(const LoopTopologyGenerator& generator, int level, int levelFaces, int face,
+                        const int points[3][2], int n, int* map) {
+    if (level == generator.numLevels()) {
+        unsigned int indices[3];
+        int twins[3];
+        generator.generate(face, face + 1, indices, twins);
+        for (int j = 0; j < 3; ++j) {
+            map[gridIndex(n, points[j][0], points[j][1])] = indices[j];
+        }
+        return;
+    }
+
+    // The midpoint of the edge ending at every corner
+    int middle[3][2];
+    for (int j = 0; j < 3; ++j) {
+        middle[j][0] = (points[(j + 2) % 3][0] + points[j][0]) / 2;
+        middle[j][1] = (points[(j + 2) % 3][1] + points[j][1]) / 2;
+    }
+    for (int c = 0; c < 3; ++c) {
+        int child[3][2] = {{points[c][0], points[c][1]},
+                           {middle[(c + 1) % 3][0], middle[(c + 1) % 3][1]},
+                           {middle[c][0], middle[c][1]}};
+        mapVertices(generator, level + 1, 4 * levelFaces, 3 * face + c, child, n, map);
+    }
+    mapVertices(generator, level + 1, 4 * levelFaces, 3 * levelFaces + face, middle, n, map);
+}
+
+/**
+ * @brief LoopGridRefiner::LoopGridRefiner Analyses the connectivity of the
+ * provided mesh and refines its positions.
+ * @param baseMesh A triangle mesh.
+ * @param levels The number of subdivision steps.
+ */
+LoopGridRefiner::LoopGridRefiner(Mesh& baseMesh, int levels) {
+    int faces = baseMesh.numFaces();
+    grids.resize(levels + 1);
+    for (int level = 0; level <= levels; ++level) {
+        grids[level].resize(faces * gridPoints(level));
+    }
+
+    regular.fill(false, faces);
+    baseIndices.fill(-1, faces * gridPoints(0));
+    for (int f = 0; f < faces; ++f) {
+        regular[f] = gatherFace(baseMesh, f);
+        if (!regular[f]) {
+            irregularFaces.append(f);
+        }
+    }
+    if (!irregularFaces.isEmpty()) {
+        buildSubmesh(baseMesh);
+    }
+
+    // Every vertex is written by the first face that holds it
+    LoopTopologyGenerator generator(baseMesh, levels);
+    int n = 1 << levels;
+    int points = gridPoints(levels);
+    const int basePoints[3][2] = {{0, 0}, {n, 0}, {0, n}};
+    vertexMap.fill(-1, faces * points);
+    int* map = vertexMap.data();
+
+    #pragma omp parallel for
+    for (int f = 0; f < faces; ++f) {
+        mapVertices(generator, 0, faces, f, basePoints, n, map + f * points);
+    }
+
+    QVector<bool> written(generator.numVerts(), false);
+    for (int k = 0; k < vertexMap.size(); ++k) {
+        if (map[k] >= 0) {
+            if (written[map[k]]) {
+                map[k] = -1;
+            } else {
+                written[map[k]] = true;
+            }
+        }
+    }
+
+    QVector<QVector3D> baseCoords(baseMesh.numVerts());
+    for (int v = 0; v < baseMesh.numVerts(); ++v) {
+        baseCoords[v] = baseMesh.getVertices()[v].coords;
+    }
+    refine(baseCoords);
+}
+
+/**
+ * @brief LoopGridRefiner::gatherFace Finds the base vertices of the level 0
+ * grid of a face. If the face is regular, its apron holds the ring of vertices
+ * around it.
+ * @param baseMesh The base mesh.
+ * @param f Index of the face.
+ * @return True if the face is regular.
+ */
+bool LoopGridRefiner::gatherFace(Mesh& baseMesh, int f) {
+    const QVector<HalfEdge>& halfEdges = baseMesh.getHalfEdges();
+    int* indices = baseIndices.data() + f * gridPoints(0);
+    for (int c = 0; c < 3; ++c) {
+        indices[gridIndex(1, corners[c][0], corners[c][1])] = halfEdges[3 * f + c].origin->index;
+    }
+
+    // Walk the six outgoing half-edges of every corner counterclockwise,
+    // starting along the face
+    QVarLengthArray<int, 16> ring(gridPoints(0));
+    std::fill(ring.begin(), ring.end(), -1);
+    for (int c = 0; c < 3; ++c) {
+        const HalfEdge* start = &halfEdges[3 * f + c];
+        const HalfEdge* edge = start;
+        for (int i = 0; i < 6; ++i) {
+            const int* direction = directions[(cornerDirections[c] + i) % 6];
+            ring[gridIndex(1, corners[c][0] + direction[0], corners[c][1] + direction[1])] = edge->next->origin->index;
+            edge = edge->prev->twin;
+            if (edge == nullptr || (edge == start) != (i == 5)) {
+                return false;
+            }
+        }
+    }
+    std::copy(ring.begin(), ring.end(), indices);
+    return true;
+}
+
+/**
+ * @brief LoopGridRefiner::buildSubmesh Builds the general path for the
+ * irregular faces. The submesh holds the irregular faces and every face that
+ * shares a vertex with one, so that every vertex and edge of an irregular face
+ * is refined with its complete neighbourhood, at every level. It is
+ * subdivided once to find the prolongation of every level and the vertices
+ * the points of the irregular faces lie on.
+ * @param baseMesh The base mesh.
+ */
+void LoopGridRefiner::buildSubmesh(Mesh& baseMesh) {
+    const QVector<HalfEdge>& halfEdges = baseMesh.getHalfEdges();
+    int numFaces = baseMesh.numFaces();
+    auto corner = [&](int f, int c) { return halfEdges[3 * f + c].origin->index; };
+
+    QVector<bool> touched(baseMesh.numVerts(), false);
+    for (int f : irregularFaces) {
+        touched[corner(f, 0)] = touched[corner(f, 1)] = touched[corner(f, 2)] = true;
+    }
+
+    // The irregular faces come first, so that face s of the submesh is
+    // irregularFaces[s]
+    QVector<int> localIndices(baseMesh.numVerts(), -1);
+    QVector<QVector3D> coords;
+    QVector<QVector<int>> faceIndices;
+    auto addFace = [&](int f) {
+        QVector<int> indices;
+        for (int c = 0; c < 3; ++c) {
+            int v = corner(f, c);
+            if (localIndices[v] < 0) {
+                localIndices[v] = submeshVertices.size();
+                submeshVertices.append(v);
+                coords.append(baseMesh.getVertices()[v].coords);
+            }
+            indices.append(localIndices[v]);
+        }
+        faceIndices.append(indices);
+    };
+    for (int f : irregularFaces) {
+        addFace(f);
+    }
+    for (int f = 0; f < numFaces; ++f) {
+        if (regular[f] && (touched[corner(f, 0)] || touched[corner(f, 1)] || touched[corner(f, 2)])) {
+            addFace(f);
+        }
+    }
+
+    Mesh submesh = MeshInitializer().constructHalfEdgeMesh(coords, faceIndices);
+    MeshValidator().validate(submesh);
+
+    LoopSubdivider subdivider;
+    Mesh mesh;
+    submeshMaps.resize(numLevels() + 1);
+    for (int level = 1; level <= numLevels(); ++level) {
+        Mesh& coarse = level == 1 ? submesh : mesh;
+        prolongations.append(LoopProlongation(coarse));
+        Mesh refined = subdivider.subdivide(coarse, REFINE_GEOMETRY);
+        MeshValidator().validate(refined);
+        mesh = refined;
+
+        LoopTopologyGenerator generator(submesh, level);
+        int n = 1 << level;
+        int points = gridPoints(level);
+        const int basePoints[3][2] = {{0, 0}, {n, 0}, {0, n}};
+        submeshMaps[level].fill(-1, irregularFaces.size() * points);
+        int* map = submeshMaps[level].data();
+
+        #pragma omp parallel for
+        for (int s = 0; s < irregularFaces.size(); ++s) {
+            mapVertices(generator, 0, submesh.numFaces(), s, basePoints, n, map + s * points);
+        }
+    }
+}
+
+/**
+ * @brief LoopGridRefiner::refine Refines new positions of the base vertices.
+ * The connectivity must not have changed since the refiner was built.
+ * @param baseCoords The position of every base vertex.
+ */
+void LoopGridRefiner::refine(const QVector<QVector3D>& baseCoords) {
+    int faces = numFaces();
+    const QVector3D* coords = baseCoords.constData();
+    const int* indices = baseIndices.constData();
+    QVector3D* baseGrid = grids[0].data();
+
+    #pragma omp parallel for
+    for (int k = 0; k < baseIndices.size(); ++k) {
+        if (indices[k] >= 0) {
+            baseGrid[k] = coords[indices[k]];
+        }
+    }
+
+    const bool* regularData = regular.constData();
+    for (int level = 0; level < numLevels(); ++level) {
+        const QVector3D* coarse = grids[level].constData();
+        QVector3D* fine = grids[level + 1].data();
+        int coarsePoints = gridPoints(level);
+        int finePoints = gridPoints(level + 1);
+
+        #pragma omp parallel for
+        for (int f = 0; f < faces; ++f) {
+            if (regularData[f]) {
+                refineGrid(coarse + f * coarsePoints, fine + f * finePoints, 1 << level);
+            }
+        }
+    }
+
+    if (irregularFaces.isEmpty()) {
+        return;
+    }
+
+    QVector<QVector3D> submeshCoords(submeshVertices.size());
+    for (int v = 0; v < submeshVertices.size(); ++v) {
+        submeshCoords[v] = coords[submeshVertices[v]];
+    }
+    QVector<QVector3D> refinedCoords;
+    for (int level = 1; level <= numLevels(); ++level) {
+        refinedCoords.resize(prolongations[level - 1].numRows());
+        prolongations[level - 1].apply(submeshCoords, refinedCoords.data());
+        std::swap(submeshCoords, refinedCoords);
+
+        const QVector3D* levelCoords = submeshCoords.constData();
+        const int* map = submeshMaps[level].constData();
+        const int* faceData = irregularFaces.constData();
+        QVector3D* grid = grids[level].data();
+        int points = gridPoints(level);
+
+        #pragma omp parallel for
+        for (int s = 0; s < irregularFaces.size(); ++s) {
+            for (int k = 0; k < points; ++k) {
+                if (map[s * points + k] >= 0) {
+                    grid[faceData[s] * points + k] = levelCoords[map[s * points + k]];
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief LoopGridRefiner::point Retrieves a point of a face.
+ * @param face Index of the base face.
+ * @param level The level, at most numLevels().
+ * @param i The number of steps from corner c0 towards c1.
+ * @param j The number of steps from corner c0 towards c2. The point must lie
+ * on the face: i, j >= 0 and i + j <= 2^level.
+ * @return The position of the point.
+ */
+QVector3D LoopGridRefiner::point(int face, int level, int i, int j) const {
+    return grids[level][face * gridPoints(level) + gridIndex(1 << level, i, j)];
+}
+
+/**
+ * @brief LoopGridRefiner::copyTo Writes the finest level into the vertices of a
+ * mesh with the connectivity of the same level of Loop subdivision, e.g. one
+ * restored by LoopTopologyGenerator.
+ * @param levelMesh The mesh.
+ */
+void LoopGridRefiner::copyTo(Mesh& levelMesh) const {
+    Vertex* vertices = levelMesh.getVertices().data();
+    const QVector3D* grid = grids.last().constData();
+    const int* map = vertexMap.constData();
+
+    #pragma omp parallel for
+    for (int k = 0; k < vertexMap.size(); ++k) {
+        if (map[k] >= 0) {
+            vertices[map[k]].coords = grid[k];
+        }
+    }
+    levelMesh.invalidateGeometry();
+}
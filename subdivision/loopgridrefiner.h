@@ -0,0 +1,67 @@
+#ifndef LOOP_GRID_REFINER_H
+#define LOOP_GRID_REFINER_H
+
+#include <QVector>
+#include <QVector3D>
+
+#include "loopprolongation.h"
+#include "mesh/mesh.h"
+
+/**
+ * @brief The LoopGridRefiner class refines a triangle mesh with Loop
+ * subdivision, storing the result per base face as triangular grids addressed
+ * by (face, level, i, j). Point (i, j) of a face at level l lies at
+ * (1 - (i + j) / n) c0 + i / n c1 + j / n c2, with n = 2^l and c0, c1 and c2
+ * the origins of the half-edges 3f, 3f + 1 and 3f + 2.
+ *
+ * Faces whose three corners are interior vertices of valence 6 are regular:
+ * their refinement is a box spline that only depends on the face and the ring
+ * of nine vertices around it. Their grids carry that ring as an apron of width
+ * one, which the fixed Loop stencils of the regular lattice reproduce at
+ * every level, so they are refined without any ring walk or half-edge
+ * indexing. The remaining faces go through the general path: a submesh holding
+ * them and the ring of faces around them is subdivided once, and its positions
+ * are refined with the LoopProlongation of every level.
+ *
+ * The connectivity is analysed once, when the refiner is built. Refining new
+ * positions of the base vertices (e.g. an animated control mesh) only runs the
+ * grid stencils and the sparse products of the irregular region.
+ */
+class LoopGridRefiner {
+public:
+    LoopGridRefiner(Mesh& baseMesh, int levels);
+
+    inline int numLevels() const { return grids.size() - 1; }
+    inline int numFaces() const { return regular.size(); }
+    inline bool isRegular(int face) const { return regular[face]; }
+
+    void refine(const QVector<QVector3D>& baseCoords);
+    QVector3D point(int face, int level, int i, int j) const;
+    void copyTo(Mesh& levelMesh) const;
+
+private:
+    bool gatherFace(Mesh& baseMesh, int f);
+    void buildSubmesh(Mesh& baseMesh);
+
+    // For every level, the grids of all faces, one after the other
+    QVector<QVector<QVector3D>> grids;
+    QVector<bool> regular;
+    // For every point of the level 0 grids, the base vertex it holds, -1 for
+    // the apron of irregular faces
+    QVector<int> baseIndices;
+
+    // The irregular faces, which are the first faces of the submesh
+    QVector<int> irregularFaces;
+    // The base vertex every vertex of the submesh comes from
+    QVector<int> submeshVertices;
+    QVector<LoopProlongation> prolongations;
+    // For every level and every point of the grids of the irregular faces, the
+    // vertex of the subdivided submesh it lies on, -1 for the apron
+    QVector<QVector<int>> submeshMaps;
+    // For every point of the finest grids, the vertex of the subdivided mesh
+    // it is written to by copyTo, -1 for the apron and for points another face
+    // writes
+    QVector<int> vertexMap;
+};
+
+#endif  // LOOP_GRID_REFINER_H
@@ -0,0 +1,111 @@
+#include "loopprolongation.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QVarLengthArray>
+
+#include <cstdio>
+
+#include "neighborhood.h"
+
+/**
+ * @brief LoopProlongation::LoopProlongation Creates an empty operator.
+ */
+LoopProlongation::LoopProlongation() {}
+
+/**
+ * @brief LoopProlongation::LoopProlongation Gathers the Loop stencils of the
+ * vertex and edge points of the provided mesh.
+ * @param controlMesh The mesh of the coarse level.
+ */
+LoopProlongation::LoopProlongation(Mesh& controlMesh) {
+    const QVector<Vertex>& vertices = controlMesh.getVertices();
+    const QVector<HalfEdge>& halfEdges = controlMesh.getHalfEdges();
+    const QVector<int>& edgeHalfEdges = controlMesh.getEdgeHalfEdges();
+    bool checked = !controlMesh.validated;
+    int numVerts = controlMesh.numVerts();
+
+    build(numVerts + controlMesh.numEdges(), numVerts, [&](int row, Row& entries) {
+        QVarLengthArray<int, 16> stencilIndices;
+        QVarLengthArray<float, 16> stencilWeights;
+        if (row < numVerts) {
+            VertexNeighborhood(vertices[row], checked).stencil(stencilIndices, stencilWeights);
+        } else {
+            EdgeNeighborhood(halfEdges[edgeHalfEdges[row - numVerts]]).stencil(stencilIndices, stencilWeights);
+        }
+        for (int i = 0; i < stencilIndices.size(); ++i) {
+            entries.append(qMakePair(stencilIndices[i], stencilWeights[i]));
+        }
+    });
+}
+
+/**
+ * @brief LoopProlongation::writeMatrixMarket Writes the operator as a real
+ * general coordinate matrix in the Matrix Market exchange format, with
+ * 1-based indices. The rows are formatted in parallel.
+ * @param fileName Path of the .mtx file.
+ * @return False if the file could not be written.
+ */
+bool LoopProlongation::writeMatrixMarket(const QString& fileName) const {
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    char line[64];
+    int length = std::snprintf(line, sizeof(line), "%d %d %d\n", numRows(), numCols(), numNonZeros());
+    QByteArray header("%%MatrixMarket matrix coordinate real general\n");
+    header.append(line, length);
+    bool written = file.write(header) == header.size();
+
+    const int chunkSize = 4096;
+    int numChunks = (numRows() + chunkSize - 1) / chunkSize;
+    QVector<QByteArray> chunks(numChunks);
+    QByteArray* chunkData = chunks.data();
+    const int* rowOffsets = offsets.constData();
+    const int* rowIndices = indices.constData();
+    const float* rowWeights = weights.constData();
+
+    #pragma omp parallel for
+    for (int chunk = 0; chunk < numChunks; ++chunk) {
+        char entry[64];
+        for (int row = chunk * chunkSize; row < qMin((chunk + 1) * chunkSize, numRows()); ++row) {
+            for (int i = rowOffsets[row]; i < rowOffsets[row + 1]; ++i) {
+                int length = std::snprintf(entry, sizeof(entry), "%d %d %.9g\n", row + 1, rowIndices[i] + 1,
+                                           rowWeights[i]);
+                chunkData[chunk].append(entry, length);
+            }
+        }
+    }
+
+    for (int chunk = 0; chunk < numChunks && written; ++chunk) {
+        written = file.write(chunks[chunk]) == chunks[chunk].size();
+    }
+    return written;
+}
+
+/**
+ * @brief LoopProlongation::writeBinary Writes the operator in a raw binary CSR
+ * layout: the magic "CSR1", the number of rows, columns and non-zeros as 32-bit
+ * integers, then the offsets (rows + 1 integers), the column indices (32-bit
+ * integers) and the weights (32-bit floats). Numbers use the byte order of the
+ * host.
+ * @param fileName Path of the file.
+ * @return False if the file could not be written.
+ */
+bool LoopProlongation::writeBinary(const QString& fileName) const {
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    qint32 sizes[3] = {numRows(), numCols(), numNonZeros()};
+    qint64 offsetBytes = qint64(offsets.size()) * sizeof(int);
+    qint64 indexBytes = qint64(indices.size()) * sizeof(int);
+    qint64 weightBytes = qint64(weights.size()) * sizeof(float);
+    return file.write("CSR1", 4) == 4 &&
+           file.write(reinterpret_cast<const char*>(sizes), sizeof(sizes)) == sizeof(sizes) &&
+           file.write(reinterpret_cast<const char*>(offsets.constData()), offsetBytes) == offsetBytes &&
+           file.write(reinterpret_cast<const char*>(indices.constData()), indexBytes) == indexBytes &&
+           file.write(reinterpret_cast<const char*>(weights.constData()), weightBytes) == weightBytes;
+}
@@ -0,0 +1,27 @@
+#ifndef LOOP_PROLONGATION_H
+#define LOOP_PROLONGATION_H
+
+#include <QString>
+
+#include "mesh/mesh.h"
+#include "sparsematrix.h"
+
+/**
+ * @brief The LoopProlongation class holds one level of Loop subdivision as a
+ * SparseMatrix: the vertex and edge stencils LoopSubdivider applies to the
+ * positions of the control mesh, boundary rules included. Row v holds the
+ * weights with which vertex v of the subdivided mesh combines the control
+ * vertices. The rows of the vertex points come first, followed by the rows of
+ * the edge points, in the order of the subdivided mesh. Its transpose is the
+ * matching restriction operator of a multigrid hierarchy.
+ */
+class LoopProlongation : public SparseMatrix {
+public:
+    LoopProlongation();
+    LoopProlongation(Mesh& controlMesh);
+
+    bool writeMatrixMarket(const QString& fileName) const;
+    bool writeBinary(const QString& fileName) const;
+};
+
+#endif  // LOOP_PROLONGATION_H
@@ -0,0 +1,61 @@
+#include "loopstenciltable.h"
+
+#include <numeric>
+
+#include "loopprolongation.h"
+#include "mesh/meshvalidator.h"
+
+/**
+ * @brief LoopStencilTable::LoopStencilTable Subdivides the topology of the
+ * provided control mesh and composes the stencils of every level into the
+ * table.
+ * @param controlMesh The control mesh, e.g. the rest pose of a character.
+ * @param levels The number of subdivision steps, at least 1.
+ */
+LoopStencilTable::LoopStencilTable(Mesh& controlMesh, int levels) : levels(levels) {
+    // Level 0 is the identity
+    cols = controlMesh.numVerts();
+    offsets.resize(cols + 1);
+    indices.resize(cols);
+    weights.fill(1.0, cols);
+    std::iota(offsets.begin(), offsets.end(), 0);
+    std::iota(indices.begin(), indices.end(), 0);
+
+    LoopSubdivider subdivider;
+    for (int level = 0; level < levels; ++level) {
+        Mesh& coarse = level == 0 ? controlMesh : mesh;
+        composeLevel(coarse);
+        Mesh refined = subdivider.subdivide(coarse, REFINE_GEOMETRY);
+        MeshValidator().validate(refined);
+        mesh = refined;
+    }
+}
+
+/**
+ * @brief LoopStencilTable::composeLevel Replaces the rows of the vertices of
+ * the provided mesh by the rows of the vertices of its subdivision: the
+ * product of its LoopProlongation and the table.
+ * @param coarse The mesh of the level the table currently describes.
+ */
+void LoopStencilTable::composeLevel(Mesh& coarse) {
+    SparseMatrix::operator=(LoopProlongation(coarse).multiply(*this));
+}
+
+/**
+ * @brief LoopStencilTable::pose Moves the refined mesh to a new pose of the
+ * control mesh.
+ * @param controlCoords The new positions of the control vertices.
+ */
+void LoopStencilTable::pose(const QVector<QVector3D>& controlCoords) {
+    QVector<QVector3D> coords(numRows());
+    apply(controlCoords, coords.data());
+
+    Vertex* vertices = mesh.getVertices().data();
+    const QVector3D* coordData = coords.constData();
+
+    #pragma omp parallel for
+    for (int v = 0; v < numRows(); v++) {
+        vertices[v].coords = coordData[v];
+    }
+    mesh.invalidateGeometry();
+}
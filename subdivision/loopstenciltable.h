@@ -0,0 +1,41 @@
+#ifndef LOOP_STENCIL_TABLE_H
+#define LOOP_STENCIL_TABLE_H
+
+#include <QVector>
+#include <QVector3D>
+
+#include "loopsubdivider.h"
+#include "mesh/mesh.h"
+#include "sparsematrix.h"
+
+/**
+ * @brief The LoopStencilTable class factors several levels of Loop
+ * subdivision into a SparseMatrix, for control meshes whose topology stays
+ * fixed while the control points move (e.g. animated characters). Row v holds
+ * the weights with which vertex v of the refined mesh combines the control
+ * vertices: the product of the LoopProlongation of every level. The refined
+ * topology is built once, after which every new pose is a single parallel
+ * sparse matrix-vector product.
+ */
+class LoopStencilTable : public SparseMatrix {
+public:
+    LoopStencilTable(Mesh& controlMesh, int levels);
+
+    inline int numControlVerts() const { return numCols(); }
+    inline int numLevels() const { return levels; }
+
+    /**
+     * @brief getMesh The refined mesh, whose positions follow the last pose.
+     */
+    inline Mesh& getMesh() { return mesh; }
+
+    void pose(const QVector<QVector3D>& controlCoords);
+
+private:
+    void composeLevel(Mesh& coarse);
+
+    int levels;
+    Mesh mesh;
+};
+
+#endif  // LOOP_STENCIL_TABLE_H
@@ -1,6 +1,15 @@
 #include "loopsubdivider.h"
 
-#include <QDebug>
+#include <assert.h>
+#include <math.h>
+
+#include <algorithm>
+#include <numeric>
+
+#include <QVarLengthArray>
+
+#include "butterflystenciltable.h"
+#include "refineattribute.h"
 
 /**
  * @brief LoopSubdivider::LoopSubdivider Creates a new empty Loop subdivider.
@@ -13,23 +22,484 @@ LoopSubdivider::LoopSubdivider() {}
  * subdivision follows the indexing rules of this paper:
  * https://diglib.eg.org/bitstream/handle/10.2312/egs20221028/041-044.pdf?sequence=1&isAllowed=y
  * @param controlMesh The mesh to be subdivided.
+ * @param attributes The RefinementAttribute flags to produce on top of the
+ * geometry. Attributes that are left out can be added later with
+ * refineAttributes.
  * @return The mesh resulting of applying a single subdivision step on the
  * control mesh.
  */
-Mesh LoopSubdivider::subdivide(Mesh& controlMesh) const {
+Mesh LoopSubdivider::subdivide(Mesh& controlMesh, int attributes) const {
     Mesh newMesh;
     reserveSizes(controlMesh, newMesh);
-    geometryRefinement(controlMesh, newMesh);
+    levelRefinement(controlMesh, newMesh, attributes | REFINE_GEOMETRY);
     topologyRefinement(controlMesh, newMesh);
 
-    subdivisionShaderLoop.normalRefinement(controlMesh, newMesh);
-    subdivisionShaderLoop.blendWeightsRefinement(controlMesh, newMesh);
-    subdivisionShaderButterfly.normalRefinement(controlMesh, newMesh);
-    subdivisionShaderButterfly.blendWeightsRefinement(controlMesh, newMesh);
-
     return newMesh;
 }
 
+/**
+ * @brief LoopSubdivider::refineAttributes Refines shading attributes that were
+ * not produced when newMesh was subdivided from controlMesh. The topology and
+ * geometry of newMesh are left untouched.
+ * @param controlMesh The mesh newMesh was subdivided from. Must already have
+ * the requested attributes.
+ * @param newMesh The subdivided mesh.
+ * @param attributes The RefinementAttribute flags to produce.
+ */
+void LoopSubdivider::refineAttributes(Mesh& controlMesh, Mesh& newMesh,
+                                      int attributes) const {
+    levelRefinement(controlMesh, newMesh, attributes & ~REFINE_GEOMETRY);
+}
+
+/**
+ * @brief interiorLimit Applies the limit masks of Loop's scheme to an interior
+ * vertex. The limit position weighs the ring with chi = 1 / (n + 3 / (8 beta))
+ * and the centre with 1 - n chi. The two tangents weigh ring vertex i with
+ * cos(2 pi i / n) and sin(2 pi i / n).
+ * @param center Position of the vertex.
+ * @param ring Positions of the neighbours, in counterclockwise order.
+ * @param position Set to the limit position.
+ * @param normal Set to the unit limit normal.
+ */
+static void interiorLimit(QVector3D center, const QVarLengthArray<QVector3D, 16>& ring,
+                          QVector3D& position, QVector3D& normal) {
+    int valence = ring.size();
+    float beta = valence == 3 ? 3.0 / 16.0 : 3.0 / (8.0 * valence);
+    float chi = 1.0 / (valence + 3.0 / (8.0 * beta));
+
+    QVector3D sum;
+    QVector3D tangent1;
+    QVector3D tangent2;
+    for (int i = 0; i < valence; ++i) {
+        float angle = 2.0 * M_PI * i / valence;
+        sum += ring[i];
+        tangent1 += cosf(angle) * ring[i];
+        tangent2 += sinf(angle) * ring[i];
+    }
+    position = (1.0 - valence * chi) * center + chi * sum;
+    normal = QVector3D::crossProduct(tangent1, tangent2).normalized();
+}
+
+/**
+ * @brief boundaryLimit Applies the limit masks of the boundary rules to a
+ * boundary vertex. The limit position is the cubic B-spline limit (1, 4, 1) / 6
+ * of the boundary neighbours, and the tangent along the boundary is the
+ * difference of the boundary neighbours. The tangent across is the left
+ * eigenvector of the subdivision matrix of the one-ring for the eigenvalue
+ * 3 / 8 + cos(pi / k) / 4, which weighs interior neighbour i with
+ * sin(i pi / k). The masks of Hoppe et al. (1994) do not apply, since they
+ * belong to modified edge rules.
+ * @param center Position of the vertex.
+ * @param ring Positions of the k + 1 neighbours in counterclockwise order, the
+ * first and last are the boundary neighbours.
+ * @param position Set to the limit position.
+ * @param normal Set to the unit limit normal.
+ */
+static void boundaryLimit(QVector3D center, const QVarLengthArray<QVector3D, 16>& ring,
+                          QVector3D& position, QVector3D& normal) {
+    int k = ring.size() - 1;
+    position = (ring[0] + 4.0 * center + ring[k]) / 6.0;
+
+    QVector3D along = ring[0] - ring[k];
+    QVector3D across;
+    if (k == 1) {
+        across = ring[0] + ring[1] - 2.0 * center;
+    } else {
+        float theta = M_PI / k;
+        float lambda = 3.0 / 8.0 + cosf(theta) / 4.0;
+        float sum = 1.0 / tanf(theta / 2.0);
+        float sin1 = sinf(theta);
+        // Weights of the boundary neighbours and the centre follow from the
+        // rows of the subdivision matrix for the vertex and boundary edges
+        float boundaryWeight = (3.0 / 8.0 * sum + sin1 * (lambda - 3.0 / 4.0)) /
+                               (8.0 * (lambda - 1.0 / 2.0) * (lambda - 3.0 / 4.0) - 1.0);
+        float centerWeight = 8.0 * boundaryWeight * (lambda - 1.0 / 2.0) - sin1;
+
+        across = centerWeight * center + boundaryWeight * (ring[0] + ring[k]);
+        for (int i = 1; i < k; ++i) {
+            across += sinf(i * theta) * ring[i];
+        }
+    }
+    normal = QVector3D::crossProduct(along, across).normalized();
+}
+
+/**
+ * @brief LoopSubdivider::limitPoint Applies the limit masks to a single
+ * vertex, for callers that gather the one-ring themselves.
+ * @param center Position of the vertex.
+ * @param ring Positions of the neighbours in counterclockwise order. On the
+ * boundary, the first and last are the boundary neighbours.
+ * @param boundary Whether the vertex lies on the boundary.
+ * @param position Set to the limit position.
+ * @param normal Set to the unit limit normal.
+ */
+void LoopSubdivider::limitPoint(const QVector3D& center, const QVarLengthArray<QVector3D, 16>& ring, bool boundary,
+                                QVector3D& position, QVector3D& normal) {
+    if (boundary) {
+        boundaryLimit(center, ring, position, normal);
+    } else {
+        interiorLimit(center, ring, position, normal);
+    }
+}
+
+/**
+ * @brief vertexLimit Gathers the one-ring of a vertex and applies the limit
+ * masks to it.
+ * @param vertex The vertex.
+ * @param maxSteps Bound on the ring walks, for unvalidated meshes.
+ * @param position Set to the limit position.
+ * @param normal Set to the unit limit normal.
+ */
+static void vertexLimit(const Vertex& vertex, int maxSteps, QVector3D& position, QVector3D& normal) {
+    if (vertex.out == nullptr) {
+        position = vertex.coords;
+        normal = QVector3D();
+        return;
+    }
+
+    // Starts at the outgoing boundary half-edge, if any, so that the ring is
+    // counterclockwise
+    QVarLengthArray<HalfEdge*, 16> outgoing;
+    vertex.outgoingHalfEdges(outgoing, maxSteps);
+    bool boundary = outgoing[0]->twin == nullptr;
+
+    QVarLengthArray<QVector3D, 16> ring;
+    for (int i = 0; i < outgoing.size(); ++i) {
+        ring.append(outgoing[i]->next->origin->coords);
+    }
+
+    if (boundary) {
+        ring.append(outgoing[outgoing.size() - 1]->prev->origin->coords);
+        boundaryLimit(vertex.coords, ring, position, normal);
+    } else {
+        interiorLimit(vertex.coords, ring, position, normal);
+    }
+}
+
+/**
+ * @brief LoopSubdivider::evaluateLimit Evaluates the positions and normals of
+ * the limit surface at the vertices of the provided mesh, in a single pass
+ * over their one-rings. The mesh itself is left untouched so that it can be
+ * subdivided further; the results are stored as its limit coordinates and
+ * limit normals.
+ * @param mesh The mesh to evaluate, of any level.
+ */
+void LoopSubdivider::evaluateLimit(Mesh& mesh) const {
+    const QVector<Vertex>& vertices = mesh.vertices;
+    int numVerts = mesh.numVerts();
+    // Unvalidated meshes may have rings that do not close
+    int maxSteps = mesh.numHalfEdges();
+
+    mesh.limitCoords.resize(numVerts);
+    mesh.limitNormals.resize(numVerts);
+    QVector3D* limitCoords = mesh.limitCoords.data();
+    QVector3D* limitNormals = mesh.limitNormals.data();
+
+    #pragma omp parallel for
+    for (int v = 0; v < numVerts; v++) {
+        vertexLimit(vertices[v], maxSteps, limitCoords[v], limitNormals[v]);
+    }
+
+    mesh.limitDirty = false;
+}
+
+/**
+ * @brief LoopSubdivider::update Updates newMesh after some of the vertices of
+ * controlMesh changed, instead of subdividing controlMesh again. The topology
+ * of newMesh is reused. Only the vertex and edge points whose stencil contains
+ * a changed vertex are evaluated, so the cost is proportional to the size of
+ * the change rather than the size of the mesh. The BUTTERFLY edge points have
+ * the widest stencil, with the wings, so they grow the region the most. For an
+ * unvalidated controlMesh the candidates are found by scanning its half-edges,
+ * see Mesh::outgoingHalfEdges.
+ * @param controlMesh The mesh newMesh was subdivided from, with the changes
+ * already applied.
+ * @param newMesh The subdivided mesh. Its base normals, blended normals and
+ * limit surface are updated as well, see Mesh::updateGeometry.
+ * @param changed The vertices of controlMesh whose position or any of the
+ * attributes changed, sorted ascending.
+ * @param attributes The RefinementAttribute flags to update. Attributes that
+ * newMesh or controlMesh does not hold are skipped.
+ * @return The vertices of newMesh that were updated, sorted ascending. These
+ * are the changed vertices for the next level.
+ */
+QVector<int> LoopSubdivider::update(Mesh& controlMesh, Mesh& newMesh, const QVector<int>& changed,
+                                    int attributes) const {
+    assert(controlMesh.hasConnectivity() && newMesh.hasConnectivity());
+    attributes &= controlMesh.refinedAttributes & newMesh.refinedAttributes;
+
+    const QVector<Vertex>& vertices = controlMesh.vertices;
+    const QVector<HalfEdge>& halfEdges = controlMesh.halfEdges;
+    const QVector<int>& edgeHalfEdges = controlMesh.getEdgeHalfEdges();
+    int numVerts = controlMesh.numVerts();
+    bool checked = !controlMesh.validated;
+
+    bool geometry = attributes & REFINE_GEOMETRY;
+    bool linear = attributes & REFINE_LINEAR;
+    bool spherical = attributes & REFINE_SPHERICAL;
+    bool butterfly = attributes & REFINE_BUTTERFLY;
+    bool blend = attributes & REFINE_BLEND_WEIGHTS;
+
+    // Candidates are the corners and edges of the faces around the changed
+    // vertices. A changed vertex is a butterfly wing of the edges of the faces
+    // across the edges of those faces.
+    QVector<int> vertexCandidates = changed;
+    QVector<int> edgeCandidates;
+    QVector<int> changedFaces;
+    for (const HalfEdge* edge : controlMesh.outgoingHalfEdges(changed)) {
+        HalfEdge* opposite = edge->next;
+        vertexCandidates.append(opposite->origin->index);
+        vertexCandidates.append(edge->prev->origin->index);
+        edgeCandidates.append(edge->edgeIndex);
+        edgeCandidates.append(opposite->edgeIndex);
+        edgeCandidates.append(edge->prev->edgeIndex);
+        changedFaces.append(edge->faceIdx());
+        if (butterfly && controlMesh.validated && opposite->twin != nullptr) {
+            edgeCandidates.append(opposite->twin->next->edgeIndex);
+            edgeCandidates.append(opposite->twin->prev->edgeIndex);
+        }
+    }
+    // Without validation the twins need not be symmetric, so the faces across
+    // are the ones whose twins lie in a face around a changed vertex
+    if (butterfly && !controlMesh.validated) {
+        std::sort(changedFaces.begin(), changedFaces.end());
+        for (const HalfEdge& edge : halfEdges) {
+            if (edge.twin != nullptr &&
+                std::binary_search(changedFaces.constBegin(), changedFaces.constEnd(), edge.twin->faceIdx())) {
+                edgeCandidates.append(edge.next->edgeIndex);
+                edgeCandidates.append(edge.prev->edgeIndex);
+            }
+        }
+    }
+    std::sort(vertexCandidates.begin(), vertexCandidates.end());
+    vertexCandidates.erase(std::unique(vertexCandidates.begin(), vertexCandidates.end()), vertexCandidates.end());
+    std::sort(edgeCandidates.begin(), edgeCandidates.end());
+    edgeCandidates.erase(std::unique(edgeCandidates.begin(), edgeCandidates.end()), edgeCandidates.end());
+
+    QVector<QVector3D> empty;
+    const QVector<QVector3D>& linearNormals = linear ? controlMesh.getVertexSubdivNormals(LINEAR) : empty;
+    const QVector<QVector3D>& sphericalNormals = spherical ? controlMesh.getVertexSubdivNormals(SPHERICAL) : empty;
+    const QVector<QVector3D>& butterflyNormals = butterfly ? controlMesh.getVertexSubdivNormals(BUTTERFLY) : empty;
+    const SparseVertexWeights& weights = controlMesh.getSparseBlendWeights();
+
+    Vertex* newVertices = newMesh.vertices.data();
+    QVector3D* newLinear = linear ? newMesh.getVertexSubdivNormals(LINEAR).data() : nullptr;
+    QVector3D* newSpherical = spherical ? newMesh.getVertexSubdivNormals(SPHERICAL).data() : nullptr;
+    QVector3D* newButterfly = butterfly ? newMesh.getVertexSubdivNormals(BUTTERFLY).data() : nullptr;
+    int* sphericalIterations = spherical ? newMesh.sphericalIterations.data() : nullptr;
+
+    auto coords = [&](int v) { return vertices[v].coords; };
+    auto fetch = [](const auto& values) {
+        return [&values](int v) { return values[v]; };
+    };
+    auto fetchWeight = [&weights](int v) { return weights.weight(v); };
+    auto isChanged = [&changed](int v) {
+        return v >= 0 && std::binary_search(changed.constBegin(), changed.constEnd(), v);
+    };
+
+    QVector<const VertexAttribute*> custom;
+    QVector<float*> newCustom;
+    if (attributes & REFINE_CUSTOM) {
+        QMap<QString, VertexAttribute>& controlAttributes = controlMesh.getVertexAttributes();
+        QMap<QString, VertexAttribute>& newAttributes = newMesh.getVertexAttributes();
+        for (const QString& name : controlAttributes.keys()) {
+            if (newAttributes.contains(name)) {
+                custom.append(&controlAttributes[name]);
+                newCustom.append(newAttributes[name].values.data());
+            }
+        }
+    }
+
+    // Every candidate is evaluated only if its stencil contains a changed
+    // vertex, the others keep their values
+    int numVertexCandidates = vertexCandidates.size();
+    int numCandidates = numVertexCandidates + edgeCandidates.size();
+    QVector<int> updatedPoints(numCandidates, -1);
+    QVector<float> newWeights(numCandidates);
+    int* updatedData = updatedPoints.data();
+    float* newWeightData = newWeights.data();
+
+    #pragma omp parallel for
+    for (int i = 0; i < numCandidates; i++) {
+        if (i < numVertexCandidates) {
+            VertexNeighborhood neighborhood(vertices[vertexCandidates[i]], checked);
+            int v = neighborhood.center;
+            bool affected = isChanged(v);
+            for (int r = 0; r < neighborhood.ring.size(); ++r) {
+                affected |= isChanged(neighborhood.ring[r]);
+            }
+            if (!affected) {
+                continue;
+            }
+            updatedData[i] = v;
+
+            if (geometry) {
+                newVertices[v].coords = neighborhood.loop(coords);
+            }
+            if (linear) {
+                newLinear[v] = LoopScheme::vertex(neighborhood, fetch(linearNormals)).normalized();
+            }
+            if (spherical) {
+                QVector3D sphericalNormal = LoopScheme::vertex(neighborhood, fetch(sphericalNormals)).normalized();
+                newSpherical[v] = subdivisionShaderLoop.sphericalAveragingVertex(neighborhood, sphericalNormal,
+                                                                                 sphericalNormals, sphericalIterations[v]);
+            }
+            if (butterfly) {
+                newButterfly[v] = ButterflyScheme::vertex(neighborhood, fetch(butterflyNormals)).normalized();
+            }
+            if (blend) {
+                newWeightData[i] = LoopScheme::vertex(neighborhood, fetchWeight);
+            }
+            for (int a = 0; a < custom.size(); ++a) {
+                int channels = custom[a]->channels;
+                refineVertexChannels<float, LoopScheme>(neighborhood, custom[a]->values.constData(), channels,
+                                                        newCustom[a] + v * channels);
+            }
+        } else {
+            int e = edgeCandidates[i - numVertexCandidates];
+            EdgeNeighborhood neighborhood(halfEdges[edgeHalfEdges[e]]);
+            int v = numVerts + e;
+            bool affected = false;
+            for (int p = 0; p < (butterfly ? 8 : 4); ++p) {
+                affected |= isChanged(neighborhood.points[p]);
+            }
+            if (!affected) {
+                continue;
+            }
+            updatedData[i] = v;
+
+            if (geometry) {
+                newVertices[v].coords = neighborhood.loop(coords);
+            }
+            if (linear) {
+                newLinear[v] = LoopScheme::edge(neighborhood, fetch(linearNormals)).normalized();
+            }
+            if (spherical) {
+                QVector3D sphericalNormal = LoopScheme::edge(neighborhood, fetch(sphericalNormals)).normalized();
+                newSpherical[v] = subdivisionShaderLoop.sphericalAveragingEdge(neighborhood, sphericalNormal,
+                                                                               sphericalNormals, sphericalIterations[v]);
+            }
+            if (butterfly) {
+                // Same order of operations as ButterflyStencilTable::apply
+                int index[ButterflyStencilTable::size];
+                float weight[ButterflyStencilTable::size];
+                ButterflyStencilTable::edgeStencil(neighborhood, index, weight);
+                QVector3D value = weight[0] * butterflyNormals[index[0]];
+                for (int p = 1; p < ButterflyStencilTable::size; ++p) {
+                    value += weight[p] * butterflyNormals[index[p]];
+                }
+                newButterfly[v] = value.normalized();
+            }
+            if (blend) {
+                newWeightData[i] = LoopScheme::edge(neighborhood, fetchWeight);
+            }
+            for (int a = 0; a < custom.size(); ++a) {
+                int channels = custom[a]->channels;
+                refineEdgeChannels<float, LoopScheme>(neighborhood, custom[a]->values.constData(), channels,
+                                                      newCustom[a] + v * channels);
+            }
+        }
+    }
+
+    // Vertex points precede edge points and both candidate lists are sorted,
+    // so the updated points are sorted as well
+    QVector<int> updated;
+    QVector<float> updatedWeights;
+    for (int i = 0; i < numCandidates; i++) {
+        if (updatedPoints[i] >= 0) {
+            updated.append(updatedPoints[i]);
+            updatedWeights.append(newWeights[i]);
+        }
+    }
+
+    if (blend) {
+        newMesh.updateBlendWeights(updated, updatedWeights);
+    }
+    if (geometry) {
+        newMesh.updateGeometry(updated);
+        updateLimit(newMesh, updated);
+    } else {
+        newMesh.updateBlendedNormals(updated);
+    }
+    return updated;
+}
+
+/**
+ * @brief LoopSubdivider::updateLimit Re-evaluates the limit surface around
+ * vertices that moved: the limit of a vertex depends on its one-ring, so the
+ * moved vertices and their neighbours are evaluated again. Nothing happens if
+ * the mesh has no up-to-date limit surface.
+ * @param mesh The mesh whose vertices moved.
+ * @param moved The vertices that moved.
+ */
+void LoopSubdivider::updateLimit(Mesh& mesh, const QVector<int>& moved) const {
+    if (!mesh.hasLimitSurface() || mesh.limitCoords.size() != mesh.numVerts()) {
+        return;
+    }
+    const QVector<Vertex>& vertices = mesh.vertices;
+    int maxSteps = mesh.numHalfEdges();
+
+    QVector<int> affected = moved;
+    for (const HalfEdge* edge : mesh.outgoingHalfEdges(moved)) {
+        affected.append(edge->next->origin->index);
+        affected.append(edge->prev->origin->index);
+    }
+    std::sort(affected.begin(), affected.end());
+    affected.erase(std::unique(affected.begin(), affected.end()), affected.end());
+
+    QVector3D* limitCoords = mesh.limitCoords.data();
+    QVector3D* limitNormals = mesh.limitNormals.data();
+    const int* affectedData = affected.constData();
+
+    #pragma omp parallel for
+    for (int i = 0; i < affected.size(); i++) {
+        int v = affectedData[i];
+        vertexLimit(vertices[v], maxSteps, limitCoords[v], limitNormals[v]);
+    }
+}
+
+/**
+ * @brief LoopSubdivider::updateLevels Propagates moved vertices of the base
+ * mesh through every subdivided level, see update. The changed region grows
+ * by the stencil radius with every level, so edits stay local. The viewer has
+ * no way to move vertices, so this is for callers that edit the base mesh
+ * themselves; MainWindow subdivides again after every change.
+ * @param levels The base mesh followed by its subdivided levels, all holding
+ * their connectivity. The vertices of the base mesh have already been moved.
+ * @param moved The vertices of the base mesh that moved, sorted ascending.
+ */
+void LoopSubdivider::updateLevels(QVector<Mesh>& levels, const QVector<int>& moved) const {
+    if (levels.isEmpty()) {
+        return;
+    }
+    QVector<int> changed = levels[0].updateGeometry(moved);
+    updateLimit(levels[0], moved);
+
+    for (int k = 1; k < levels.size() && !changed.isEmpty(); ++k) {
+        changed = update(levels[k - 1], levels[k], changed, levels[k].refinedAttributes);
+    }
+}
+
+/**
+ * @brief LoopSubdivider::setSphericalConvergence Configures the early exit of
+ * the spherical averaging of the SPHERICAL normals.
+ * @param tolerance Rotation angle in radians below which the averaging of a
+ * vertex counts as converged.
+ * @param maxIterations Maximum number of iterations per vertex.
+ */
+void LoopSubdivider::setSphericalConvergence(float tolerance, int maxIterations) {
+    subdivisionShaderLoop.setConvergence(tolerance, maxIterations);
+}
+
+/**
+ * @brief LoopSubdivider::setSphericalAccuracy Selects exact or approximate
+ * kernels for the spherical averaging of the SPHERICAL normals.
+ * @param accuracy The accuracy, see sphericalkernels.h for the error bounds.
+ */
+void LoopSubdivider::setSphericalAccuracy(SphericalAccuracy accuracy) {
+    subdivisionShaderLoop.setAccuracy(accuracy);
+}
+
 /**
  * @brief LoopSubdivider::reserveSizes Resizes the vertex, half-edge and face
  * vectors. Aslo recalculates the edge count.
@@ -46,101 +516,261 @@ void LoopSubdivider::reserveSizes(Mesh& controlMesh, Mesh& newMesh) const {
     newMesh.getHalfEdges().resize(newNumHalfEdges);
     newMesh.getFaces().resize(newNumFaces);
 
-    for (int subdivType = LINEAR; subdivType <= BUTTERFLY; ++subdivType) {
-        newMesh.getVertexSubdivNormals(static_cast<SubdivisionShaderType>(subdivType)).resize(newNumVerts);
-    }
-
     newMesh.edgeCount = newNumEdges;
 }
 
 /**
- * @brief LoopSubdivider::geometryRefinement Performs the geometry refinement.
- * In other words, it calculates the coordinates of the vertex and edge points.
+ * @brief LoopSubdivider::levelRefinement Performs the geometry refinement and
+ * the refinement of the requested shading attributes in a single pass over
+ * the vertices and a single pass over the edges of the control mesh. The
+ * neighbourhood of every vertex and edge is gathered once and shared by the
+ * position, the LINEAR, SPHERICAL and BUTTERFLY normals and the custom vertex
+ * attributes. The blend weights are sparse and refined separately, see
+ * refineBlendWeights.
  * @param controlMesh The control mesh.
  * @param newMesh The new mesh. At the start of this function, the only
  * guarantee you have of this newMesh is that the vertex, half-edge and face
  * vectors have the correct sizes.
+ * @param attributes The RefinementAttribute flags to produce.
  */
-void LoopSubdivider::geometryRefinement(Mesh& controlMesh,
-                                        Mesh& newMesh) const {
-    QVector<Vertex>& newVertices = newMesh.getVertices();
-    QVector<Vertex>& vertices = controlMesh.getVertices();
+void LoopSubdivider::levelRefinement(Mesh& controlMesh, Mesh& newMesh,
+                                     int attributes) const {
+    // Read-only access, so that the shared arrays are never detached from within the parallel loops
+    const QVector<Vertex>& vertices = controlMesh.vertices;
+    const QVector<HalfEdge>& halfEdges = controlMesh.halfEdges;
+    const QVector<int>& edgeHalfEdges = controlMesh.getEdgeHalfEdges();
+
+    bool geometry = attributes & REFINE_GEOMETRY;
+    bool linear = attributes & REFINE_LINEAR;
+    bool spherical = attributes & REFINE_SPHERICAL;
+    bool butterfly = attributes & REFINE_BUTTERFLY;
+    bool blend = attributes & REFINE_BLEND_WEIGHTS;
+    // Meshes that did not pass MeshValidator get bounded ring walks
+    bool checked = !controlMesh.validated;
+
+    // Only touch the arrays that are requested, so that they are not allocated
+    // for attributes that are never shown.
+    QVector<QVector3D> empty;
+    const QVector<QVector3D>& linearNormals = linear ? controlMesh.getVertexSubdivNormals(LINEAR) : empty;
+    const QVector<QVector3D>& sphericalNormals = spherical ? controlMesh.getVertexSubdivNormals(SPHERICAL) : empty;
+    const QVector<QVector3D>& butterflyNormals = butterfly ? controlMesh.getVertexSubdivNormals(BUTTERFLY) : empty;
+
+    QVector<QVector3D>& newLinearNormals = linear ? newMesh.getVertexSubdivNormals(LINEAR) : empty;
+    QVector<QVector3D>& newSphericalNormals = spherical ? newMesh.getVertexSubdivNormals(SPHERICAL) : empty;
+    QVector<QVector3D>& newButterflyNormals = butterfly ? newMesh.getVertexSubdivNormals(BUTTERFLY) : empty;
+
+    int newNumVerts = newMesh.numVerts();
+    if (linear) newLinearNormals.resize(newNumVerts);
+    if (spherical) {
+        newSphericalNormals.resize(newNumVerts);
+        newMesh.sphericalIterations.resize(newNumVerts);
+    }
+    if (butterfly) newButterflyNormals.resize(newNumVerts);
+
+    Vertex* newVertices = newMesh.vertices.data();
+    QVector3D* newLinear = newLinearNormals.data();
+    QVector3D* newSpherical = newSphericalNormals.data();
+    QVector3D* newButterfly = newButterflyNormals.data();
+    int* sphericalIterations = newMesh.sphericalIterations.data();
+
+    auto coords = [&](int v) { return vertices[v].coords; };
+    auto fetch = [](const auto& values) {
+        return [&values](int v) { return values[v]; };
+    };
+
+    // Custom attributes are refined with Loop's stencils as well
+    QVector<const VertexAttribute*> custom;
+    QVector<float*> newCustom;
+    if (attributes & REFINE_CUSTOM) {
+        QMap<QString, VertexAttribute>& controlAttributes = controlMesh.getVertexAttributes();
+        for (const QString& name : controlAttributes.keys()) {
+            const VertexAttribute* attribute = &controlAttributes[name];
+            VertexAttribute* newAttribute = &newMesh.getVertexAttributes()[name];
+            newAttribute->channels = attribute->channels;
+            newAttribute->values.resize(newNumVerts * attribute->channels);
+            custom.append(attribute);
+            newCustom.append(newAttribute->values.data());
+        }
+    }
 
-    // Vertex Points
+    // Vertex points
+    #pragma omp parallel for
     for (int v = 0; v < controlMesh.numVerts(); v++) {
-        QVector3D coords = vertexPoint(vertices[v]);
-        Vertex vertPoint(coords, nullptr, vertices[v].valence, v);
-        newVertices[v] = vertPoint;
+        VertexNeighborhood neighborhood(vertices[v], checked);
+
+        if (geometry) {
+            Vertex* vertPoint = &newVertices[v];
+            vertPoint->coords = neighborhood.loop(coords);
+            vertPoint->valence = vertices[v].valence;
+            vertPoint->index = v;
+        }
+
+        if (linear) {
+            newLinear[v] = LoopScheme::vertex(neighborhood, fetch(linearNormals)).normalized();
+        }
+        if (spherical) {
+            QVector3D sphericalNormal = LoopScheme::vertex(neighborhood, fetch(sphericalNormals)).normalized();
+            newSpherical[v] = subdivisionShaderLoop.sphericalAveragingVertex(neighborhood, sphericalNormal, sphericalNormals,
+                                                                             sphericalIterations[v]);
+        }
+        if (butterfly) {
+            newButterfly[v] = ButterflyScheme::vertex(neighborhood, fetch(butterflyNormals)).normalized();
+        }
+        for (int a = 0; a < custom.size(); ++a) {
+            int channels = custom[a]->channels;
+            refineVertexChannels<float, LoopScheme>(neighborhood, custom[a]->values.constData(), channels,
+                                                    newCustom[a] + v * channels);
+        }
     }
 
-    // Edge Points
-    QVector<HalfEdge>& halfEdges = controlMesh.getHalfEdges();
-    for (int h = 0; h < controlMesh.numHalfEdges(); h++) {
-        HalfEdge currentEdge = halfEdges[h];
-        // Only create a new vertex per set of halfEdges (i.e. once per undirected
-        // edge)
-        if (h > currentEdge.twinIdx()) {
-            QVector3D coords = edgePoint(currentEdge);
-            int v = controlMesh.numVerts() + currentEdge.edgeIdx();
-            int valence = currentEdge.isBoundaryEdge() ? 4 : 6;
-            Vertex edgePointVert = Vertex(coords, nullptr, valence, v);
-            newVertices[v] = edgePointVert;
+    // Edge points, one per undirected edge
+    #pragma omp parallel for
+    for (int e = 0; e < controlMesh.numEdges(); e++) {
+        EdgeNeighborhood neighborhood(halfEdges[edgeHalfEdges[e]]);
+        int v = controlMesh.numVerts() + e;
+
+        if (geometry) {
+            Vertex* edgePoint = &newVertices[v];
+            edgePoint->coords = neighborhood.loop(coords);
+            edgePoint->valence = neighborhood.boundary ? 4 : 6;
+            edgePoint->index = v;
+        }
+
+        if (linear) {
+            newLinear[v] = LoopScheme::edge(neighborhood, fetch(linearNormals)).normalized();
+        }
+        if (spherical) {
+            QVector3D sphericalNormal = LoopScheme::edge(neighborhood, fetch(sphericalNormals)).normalized();
+            newSpherical[v] = subdivisionShaderLoop.sphericalAveragingEdge(neighborhood, sphericalNormal, sphericalNormals,
+                                                                           sphericalIterations[v]);
+        }
+        for (int a = 0; a < custom.size(); ++a) {
+            int channels = custom[a]->channels;
+            refineEdgeChannels<float, LoopScheme>(neighborhood, custom[a]->values.constData(), channels,
+                                                  newCustom[a] + v * channels);
         }
     }
+
+    // The BUTTERFLY edge points are a weighted gather over a precomputed table
+    if (butterfly) {
+        ButterflyStencilTable stencils(controlMesh);
+        QVector3D* edgePoints = newButterfly + controlMesh.numVerts();
+        stencils.apply(butterflyNormals, edgePoints);
+
+        #pragma omp parallel for
+        for (int e = 0; e < stencils.numEdges(); e++) {
+            edgePoints[e].normalize();
+        }
+    }
+
+    if (blend) {
+        refineBlendWeights(controlMesh, newMesh);
+    }
+
+    newMesh.refinedAttributes |= attributes;
+    newMesh.invalidateBlendedNormals(attributes);
 }
 
 /**
- * @brief LoopSubdivider::vertexPoint Calculates the new position of the
- * provided vertex.
- * @param vertex The vertex to calculate the new position of. Note that this
- * vertex is the vertex from the control mesh.
- * @return The coordinates of the new vertex point.
+ * @brief LoopSubdivider::refineBlendWeights Refines the sparse blend weights.
+ * A vertex or edge point can only get a non-zero weight if its stencil
+ * contains a vertex of the support. These are the vertex points of the support
+ * and its neighbours, and the edge points of the edges incident and opposite
+ * to the support. Only those points are evaluated, so the cost scales with the
+ * size of the support rather than the size of the mesh.
+ * @param controlMesh The control mesh.
+ * @param newMesh The new mesh.
  */
-QVector3D LoopSubdivider::vertexPoint(const Vertex& vertex) const {
-    QVector3D coords;
-    HalfEdge* halfedge;
+void LoopSubdivider::refineBlendWeights(Mesh& controlMesh, Mesh& newMesh) const {
+    const SparseVertexWeights& weights = controlMesh.getSparseBlendWeights();
+    const QVector<Vertex>& vertices = controlMesh.vertices;
+    const QVector<HalfEdge>& halfEdges = controlMesh.halfEdges;
+    bool checked = !controlMesh.validated;
 
-    float beta;
-    if (vertex.isBoundaryVertex()) {
-        return (vertex.prevBoundaryHalfEdge()->origin->coords + 6 * vertex.coords + vertex.nextBoundaryHalfEdge()->next->origin->coords) / 8;
-    }
+    // Candidate vertices, and edges by the half-edge the edge pass uses for them
+    QVector<int> vertexCandidates;
+    QVector<int> edgeCandidates;
+    auto addEdge = [&](const HalfEdge* edge) {
+        edgeCandidates.append(qMax(edge->index, edge->twinIdx()));
+    };
 
-    if (vertex.valence == 6) {
-        // We use beta to do normalized weighting immediately
-        beta = 1.0 / (10.0 + vertex.valence);
-        // Weight mid vertex
-        coords = vertex.coords * 10.0 * beta;
+    // The walks over the rings of the support are only safe on validated
+    // meshes, other meshes evaluate every point instead
+    if (checked) {
+        vertexCandidates.resize(controlMesh.numVerts());
+        std::iota(vertexCandidates.begin(), vertexCandidates.end(), 0);
+        for (int h : controlMesh.getEdgeHalfEdges()) {
+            if (h >= 0) {
+                edgeCandidates.append(h);
+            }
+        }
     } else {
-        beta = vertex.valence == 3.0 ? 3.0/16.0 : 3.0/(8.0*vertex.valence);
-        coords = vertex.coords * (1.0 - vertex.valence * beta);
+        for (int s : weights.indices) {
+            const Vertex& vertex = vertices[s];
+            bool boundary = vertex.isBoundaryVertex();
+            vertexCandidates.append(s);
+
+            HalfEdge* start = boundary ? vertex.nextBoundaryHalfEdge() : vertex.out;
+            HalfEdge* edge = start;
+            do {
+                vertexCandidates.append(edge->next->origin->index);
+                addEdge(edge);
+                addEdge(edge->next);
+                edge = edge->prev->twin;
+            } while (edge != nullptr && edge != start);
+
+            if (boundary) {
+                HalfEdge* incoming = vertex.prevBoundaryHalfEdge();
+                vertexCandidates.append(incoming->origin->index);
+                addEdge(incoming);
+            }
+        }
     }
 
-    halfedge = vertex.out->twin;
-    do {
-        coords += halfedge->origin->coords * beta;
-        halfedge = halfedge->next->twin;
-    } while (halfedge != vertex.out->twin);
+    std::sort(vertexCandidates.begin(), vertexCandidates.end());
+    vertexCandidates.erase(std::unique(vertexCandidates.begin(), vertexCandidates.end()), vertexCandidates.end());
+    std::sort(edgeCandidates.begin(), edgeCandidates.end());
+    edgeCandidates.erase(std::unique(edgeCandidates.begin(), edgeCandidates.end()), edgeCandidates.end());
 
-    return coords;
-}
+    int numVertexCandidates = vertexCandidates.size();
+    int numCandidates = numVertexCandidates + edgeCandidates.size();
+    QVector<int> indices(numCandidates);
+    QVector<float> values(numCandidates);
+    int* indexData = indices.data();
+    float* valueData = values.data();
+    auto fetch = [&weights](int v) { return weights.weight(v); };
 
-/**
- * @brief LoopSubdivider::edgePoint Calculates the position of the edge point.
- * @param edge One of the half-edges that lives on the edge to calculate
- * the edge point. Note that this half-edge is the half-edge from the control
- * mesh.
- * @return The coordinates of the new edge point.
- */
-QVector3D LoopSubdivider::edgePoint(const HalfEdge& edge) const {
-    if (edge.isBoundaryEdge()) {
-        return edge.origin->coords / 2.0 + edge.next->origin->coords / 2.0;
+    #pragma omp parallel for
+    for (int i = 0; i < numCandidates; i++) {
+        if (i < numVertexCandidates) {
+            int v = vertexCandidates[i];
+            indexData[i] = v;
+            valueData[i] = LoopScheme::vertex(VertexNeighborhood(vertices[v], checked), fetch);
+        } else {
+            const HalfEdge& edge = halfEdges[edgeCandidates[i - numVertexCandidates]];
+            indexData[i] = controlMesh.numVerts() + edge.edgeIdx();
+            valueData[i] = LoopScheme::edge(EdgeNeighborhood(edge), fetch);
+        }
     }
 
-    QVector3D edgePt = edge.origin->coords * 6.0;
-    edgePt += edge.next->origin->coords * 6.0;
-    edgePt += edge.next->next->origin->coords * 2.0;
-    edgePt += edge.twin->next->next->origin->coords * 2.0;
-    return edgePt /= 16.0;
+    // Vertex points precede edge points, so only the edge points need sorting
+    QVector<int> order(numCandidates);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin() + numVertexCandidates, order.end(),
+                     [&indices](int a, int b) { return indices[a] < indices[b]; });
+
+    SparseVertexWeights newWeights;
+    for (int o = 0; o < numCandidates; o++) {
+        int i = order[o];
+        // On non-manifold edges several half-edges map to the same edge point,
+        // keep the last one like the edge pass does
+        bool overwritten = o + 1 < numCandidates && indices[order[o + 1]] == indices[i];
+        if (!overwritten && values[i] != 0.0f) {
+            newWeights.indices.append(indices[i]);
+            newWeights.values.append(values[i]);
+        }
+    }
+    newMesh.setSparseBlendWeights(newWeights);
 }
 
 /**
@@ -152,15 +782,25 @@ QVector3D LoopSubdivider::edgePoint(const HalfEdge& edge) const {
  */
 void LoopSubdivider::topologyRefinement(Mesh& controlMesh,
                                         Mesh& newMesh) const {
+    const QVector<Vertex>& vertices = controlMesh.vertices;
+    const QVector<HalfEdge>& halfEdges = controlMesh.halfEdges;
+    const QVector<int>& edgeHalfEdges = controlMesh.getEdgeHalfEdges();
+    Vertex* newVertices = newMesh.vertices.data();
+    HalfEdge* newHalfEdges = newMesh.halfEdges.data();
+    Face* newFaces = newMesh.faces.data();
+
+    #pragma omp parallel for
     for (int f = 0; f < newMesh.numFaces(); ++f) {
-        newMesh.faces[f].index = f;
+        newFaces[f].index = f;
         // Loop subdivision generates only triangles
-        newMesh.faces[f].valence = 3;
+        newFaces[f].valence = 3;
+        newFaces[f].side = &newHalfEdges[3 * f + 2];
     }
 
     // Split halfedges
+    #pragma omp parallel for
     for (int h = 0; h < controlMesh.numHalfEdges(); ++h) {
-        HalfEdge* edge = &controlMesh.halfEdges[h];
+        const HalfEdge* edge = &halfEdges[h];
 
         int h1 = 3 * h;
         int h2 = 3 * h + 1;
@@ -188,11 +828,28 @@ void LoopSubdivider::topologyRefinement(Mesh& controlMesh,
         setHalfEdgeData(newMesh, h3, edgeIdx3, vertIdx3, twinIdx3);
         setHalfEdgeData(newMesh, h4, edgeIdx4, vertIdx4, twinIdx4);
     }
+
+    // Outgoing half-edges: the first child of the old outgoing half-edge for
+    // vertex points, the half-edge leaving the edge point along the edge for
+    // edge points.
+    #pragma omp parallel for
+    for (int v = 0; v < controlMesh.numVerts(); ++v) {
+        HalfEdge* out = vertices[v].out;
+        newVertices[v].out = out == nullptr ? nullptr : &newHalfEdges[3 * out->index];
+        newVertices[v].index = v;
+    }
+    #pragma omp parallel for
+    for (int e = 0; e < controlMesh.numEdges(); ++e) {
+        int v = controlMesh.numVerts() + e;
+        newVertices[v].out = &newHalfEdges[3 * edgeHalfEdges[e] + 1];
+        newVertices[v].index = v;
+    }
 }
 
 /**
- * @brief LoopSubdivider::setHalfEdgeData Sets the data of a single half-edge
- * (and the corresponding vertex and face)
+ * @brief LoopSubdivider::setHalfEdgeData Sets the data of a single half-edge.
+ * Only writes to the half-edge itself, so that half-edges can be set in
+ * parallel.
  * @param newMesh The new mesh this half-edge will live in.
  * @param h Index of the half-edge.
  * @param edgeIdx Index of the (undirected) edge this half-edge will belong to.
@@ -211,8 +868,4 @@ void LoopSubdivider::setHalfEdgeData(Mesh& newMesh, int h, int edgeIdx,
     halfEdge->next = &newMesh.halfEdges[halfEdge->nextIdx()];
     halfEdge->prev = &newMesh.halfEdges[halfEdge->prevIdx()];
     halfEdge->twin = twinIdx < 0 ? nullptr : &newMesh.halfEdges[twinIdx];
-
-    halfEdge->origin->out = halfEdge;
-    halfEdge->origin->index = vertIdx;
-    halfEdge->face->side = halfEdge;
 }
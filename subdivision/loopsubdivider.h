@@ -1,10 +1,11 @@
 #ifndef LOOP_SUBDIVIDER_H
 #define LOOP_SUBDIVIDER_H
 
+#include <QVarLengthArray>
+
 #include "mesh/mesh.h"
 #include "subdivider.h"
 #include "subdivision/shading/loopsubdivisionshader.h"
-#include "subdivision/shading/butterflysubdivisionshader.h"
 
 /**
  * @brief The LoopSubdivider class is a subdivider class that performs Loop
@@ -13,21 +14,31 @@
 class LoopSubdivider : public Subdivider {
 public:
     LoopSubdivider();
-    Mesh subdivide(Mesh& controlMesh) const override;
+    Mesh subdivide(Mesh& controlMesh, int attributes = REFINE_ALL) const override;
+    void refineAttributes(Mesh& controlMesh, Mesh& newMesh, int attributes) const override;
+    void evaluateLimit(Mesh& mesh) const override;
+
+    QVector<int> update(Mesh& controlMesh, Mesh& newMesh, const QVector<int>& changed,
+                        int attributes = REFINE_ALL) const;
+    void updateLimit(Mesh& mesh, const QVector<int>& moved) const;
+    void updateLevels(QVector<Mesh>& levels, const QVector<int>& moved) const;
+
+    void setSphericalConvergence(float tolerance, int maxIterations);
+    void setSphericalAccuracy(SphericalAccuracy accuracy);
+
+    static void limitPoint(const QVector3D& center, const QVarLengthArray<QVector3D, 16>& ring, bool boundary,
+                           QVector3D& position, QVector3D& normal);
 
 private:
     LoopSubdivisionShader subdivisionShaderLoop;
-    ButterflySubdivisionShader subdivisionShaderButterfly;
 
     void reserveSizes(Mesh& controlMesh, Mesh& newMesh) const;
-    void geometryRefinement(Mesh& controlMesh, Mesh& newMesh) const;
+    void levelRefinement(Mesh& controlMesh, Mesh& newMesh, int attributes) const;
+    void refineBlendWeights(Mesh& controlMesh, Mesh& newMesh) const;
     void topologyRefinement(Mesh& controlMesh, Mesh& newMesh) const;
 
     void setHalfEdgeData(Mesh& newMesh, int h, int edgeIdx, int vertIdx,
                          int twinIdx) const;
-
-    QVector3D vertexPoint(const Vertex& vertex) const;
-    QVector3D edgePoint(const HalfEdge& edge) const;
 };
 
 #endif  // LOOP_SUBDIVIDER_H
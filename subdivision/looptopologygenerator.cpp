@@ -0,0 +1,309 @@
+#include "looptopologygenerator.h"
+
+#include <QVarLengthArray>
+
+#include <algorithm>
+#include <cassert>
+
+/**
+ * @brief LoopTopologyGenerator::LoopTopologyGenerator Prepares the generation
+ * of the connectivity of the provided level.
+ * @param baseMesh A triangle mesh.
+ * @param level The number of subdivision steps.
+ */
+LoopTopologyGenerator::LoopTopologyGenerator(Mesh& baseMesh, int level) {
+    counts.append({baseMesh.numVerts(), baseMesh.numEdges(), baseMesh.numFaces()});
+    for (int l = 0; l < level; ++l) {
+        const LevelCounts& coarse = counts.last();
+        counts.append({coarse.verts + coarse.edges, 2 * coarse.edges + 3 * coarse.faces, 4 * coarse.faces});
+    }
+
+    const QVector<HalfEdge>& halfEdges = baseMesh.getHalfEdges();
+    baseHalfEdges.resize(halfEdges.size());
+    baseNext.resize(halfEdges.size());
+    HalfEdgeData* baseData = baseHalfEdges.data();
+    int* nextData = baseNext.data();
+
+    #pragma omp parallel for
+    for (int h = 0; h < halfEdges.size(); ++h) {
+        const HalfEdge& edge = halfEdges[h];
+        baseData[h] = {edge.origin->index, edge.edgeIndex, edge.twinIdx()};
+        nextData[h] = edge.nextIdx();
+    }
+
+    const QVector<Vertex>& vertices = baseMesh.getVertices();
+    baseOut.resize(vertices.size());
+    baseValences.resize(vertices.size());
+    for (int v = 0; v < vertices.size(); ++v) {
+        baseOut[v] = vertices[v].out == nullptr ? -1 : vertices[v].out->index;
+        baseValences[v] = vertices[v].valence;
+    }
+    baseEdgeHalfEdges = baseMesh.getEdgeHalfEdges();
+}
+
+/**
+ * @brief LoopTopologyGenerator::nextHalfEdge Retrieves the index of the
+ * half-edge following the provided half-edge. Below the base mesh, the
+ * half-edges of face f are 3f, 3f + 1 and 3f + 2.
+ * @param level The level of the half-edge.
+ * @param h Index of the half-edge.
+ * @return The index of the next half-edge.
+ */
+int LoopTopologyGenerator::nextHalfEdge(int level, int h) const {
+    if (level == 0) {
+        return baseNext[h];
+    }
+    return h - h % 3 + (h + 1) % 3;
+}
+
+/**
+ * @brief LoopTopologyGenerator::refineFace Derives the half-edges of a child
+ * face from the half-edges of its parent face, following the rules of
+ * LoopSubdivider::topologyRefinement.
+ * @param level The level of the parent face.
+ * @param f Index of the parent face.
+ * @param child 0, 1 or 2 for the child face at that corner (face 3f + child),
+ * 3 for the middle face (face 3F + f, with F the number of parent faces).
+ * @param parent The three half-edges of the parent face.
+ * @param result Set to the three half-edges of the child face.
+ */
+void LoopTopologyGenerator::refineFace(int level, int f, int child, const HalfEdgeData* parent,
+                                       HalfEdgeData* result) const {
+    const LevelCounts& coarse = counts[level];
+    int numHalfEdges = 3 * coarse.faces;
+
+    if (child == 3) {
+        for (int j = 0; j < 3; ++j) {
+            int h = 3 * f + j;
+            const HalfEdgeData& prev = parent[(j + 2) % 3];
+            result[j] = {coarse.verts + prev.edge, 2 * coarse.edges + h, 3 * h + 1};
+        }
+        return;
+    }
+
+    int h = 3 * f + child;
+    int p = 3 * f + (child + 2) % 3;
+    const HalfEdgeData& edge = parent[child];
+    const HalfEdgeData& prev = parent[(child + 2) % 3];
+
+    result[0] = {edge.origin, 2 * edge.edge + (h > edge.twin ? 0 : 1),
+                 edge.twin < 0 ? -1 : 3 * nextHalfEdge(level, edge.twin) + 2};
+    result[1] = {coarse.verts + edge.edge, 2 * coarse.edges + h, 3 * numHalfEdges + h};
+    result[2] = {coarse.verts + prev.edge, 2 * prev.edge + (p > prev.twin ? 1 : 0),
+                 prev.twin < 0 ? -1 : 3 * prev.twin};
+}
+
+/**
+ * @brief LoopTopologyGenerator::faceHalfEdges Derives the half-edges of a face
+ * of any level by refining its ancestor face in the base mesh.
+ * @param level The level of the face, at most numLevels().
+ * @param face Index of the face.
+ * @param data Set to the three half-edges of the face.
+ */
+void LoopTopologyGenerator::faceHalfEdges(int level, int face, HalfEdgeData* data) const {
+    QVarLengthArray<int, 16> ancestors(level);
+    QVarLengthArray<int, 16> children(level);
+
+    // Walk up to the base mesh
+    int f = face;
+    for (int l = level - 1; l >= 0; --l) {
+        int cornerFaces = 3 * counts[l].faces;
+        children[l] = f < cornerFaces ? f % 3 : 3;
+        f = f < cornerFaces ? f / 3 : f - cornerFaces;
+        ancestors[l] = f;
+    }
+
+    HalfEdgeData refined[3];
+    for (int j = 0; j < 3; ++j) {
+        data[j] = baseHalfEdges[3 * f + j];
+    }
+    for (int l = 0; l < level; ++l) {
+        refineFace(l, ancestors[l], children[l], data, refined);
+        std::copy(refined, refined + 3, data);
+    }
+}
+
+/**
+ * @brief LoopTopologyGenerator::edgeHalfEdge Retrieves the half-edge an edge
+ * is evaluated from, as in Mesh::getEdgeHalfEdges: the half-edge of the edge
+ * with the larger index. An edge of level l + 1 is either one of the two halves
+ * of a split edge, or lies inside a parent face.
+ * @param level The level of the edge.
+ * @param e Index of the edge.
+ * @return The index of the half-edge.
+ */
+int LoopTopologyGenerator::edgeHalfEdge(int level, int e) const {
+    if (level == 0) {
+        return baseEdgeHalfEdges[e];
+    }
+
+    const LevelCounts& coarse = counts[level - 1];
+    if (e >= 2 * coarse.edges) {
+        // The edge between the middle face 3F + f and a corner face
+        return 9 * coarse.faces + e - 2 * coarse.edges;
+    }
+
+    // Child half-edges 3h and 3 next(h) + 2 of the split edge. Since h has the
+    // larger index of its pair, they lie on edges 2e and 2e + 1, while those of
+    // the twin lie on edges 2e + 1 and 2e.
+    int h = edgeHalfEdge(level - 1, e / 2);
+    HalfEdgeData data[3];
+    faceHalfEdges(level - 1, h / 3, data);
+    int twin = data[h % 3].twin;
+
+    int first = 3 * h;
+    int second = 3 * nextHalfEdge(level - 1, h) + 2;
+    if (twin < 0) {
+        return e % 2 == 0 ? first : second;
+    }
+    int twinFirst = 3 * twin;
+    int twinSecond = 3 * nextHalfEdge(level - 1, twin) + 2;
+    return e % 2 == 0 ? qMax(first, twinSecond) : qMax(second, twinFirst);
+}
+
+/**
+ * @brief LoopTopologyGenerator::vertexData Derives the outgoing half-edge and
+ * valence of a vertex of a level from the level it was created in. Vertex
+ * points keep the valence of their parent and the first child of its outgoing
+ * half-edge. Edge points go out along the second child of their edge half-edge
+ * and have valence 6, or 4 on the boundary.
+ * @param level The level of the vertex, at most numLevels().
+ * @param v Index of the vertex.
+ * @param out Set to the index of the outgoing half-edge, -1 if there is none.
+ * @param valence Set to the valence of the vertex.
+ */
+void LoopTopologyGenerator::vertexData(int level, int v, int& out, int& valence) const {
+    int factor = 1;
+    while (level > 0 && v < counts[level - 1].verts) {
+        factor *= 3;
+        --level;
+    }
+
+    if (level == 0) {
+        out = baseOut[v] < 0 ? -1 : factor * baseOut[v];
+        valence = baseValences[v];
+        return;
+    }
+
+    int h = edgeHalfEdge(level - 1, v - counts[level - 1].verts);
+    HalfEdgeData data[3];
+    faceHalfEdges(level - 1, h / 3, data);
+    out = factor * (3 * h + 1);
+    valence = data[h % 3].twin < 0 ? 4 : 6;
+}
+
+/**
+ * @brief LoopTopologyGenerator::restore Rebuilds the half-edges and faces of a
+ * mesh of the final level whose connectivity was released, see
+ * Mesh::releaseConnectivity. The result matches the connectivity
+ * LoopSubdivider would have produced.
+ * @param mesh The mesh, holding the vertices of level numLevels() >= 1.
+ */
+void LoopTopologyGenerator::restore(Mesh& mesh) const {
+    assert(numLevels() > 0 && mesh.numVerts() == numVerts());
+    QVector<unsigned int> indices(numHalfEdges());
+    QVector<int> twins(numHalfEdges());
+    QVector<int> edges(numHalfEdges());
+    unsigned int* indexData = indices.data();
+    int* twinData = twins.data();
+    int* edgeData = edges.data();
+
+    const int chunkSize = 1024;
+    int faces = numFaces();
+    #pragma omp parallel for
+    for (int chunk = 0; chunk < (faces + chunkSize - 1) / chunkSize; ++chunk) {
+        int begin = chunk * chunkSize;
+        int end = qMin(begin + chunkSize, faces);
+        generate(begin, end, indexData + 3 * begin, twinData + 3 * begin, edgeData + 3 * begin);
+    }
+
+    mesh.halfEdges.resize(numHalfEdges());
+    mesh.faces.resize(faces);
+    mesh.edgeCount = numEdges();
+    Vertex* vertices = mesh.vertices.data();
+    HalfEdge* halfEdges = mesh.halfEdges.data();
+    Face* faceData = mesh.faces.data();
+
+    #pragma omp parallel for
+    for (int h = 0; h < numHalfEdges(); ++h) {
+        HalfEdge& edge = halfEdges[h];
+        int f = h / 3;
+        edge.origin = &vertices[indexData[h]];
+        edge.next = &halfEdges[3 * f + (h + 1) % 3];
+        edge.prev = &halfEdges[3 * f + (h + 2) % 3];
+        edge.twin = twinData[h] < 0 ? nullptr : &halfEdges[twinData[h]];
+        edge.face = &faceData[f];
+        edge.index = h;
+        edge.edgeIndex = edgeData[h];
+    }
+
+    #pragma omp parallel for
+    for (int f = 0; f < faces; ++f) {
+        faceData[f].side = &halfEdges[3 * f + 2];
+        faceData[f].valence = 3;
+        faceData[f].index = f;
+        faceData[f].recalculateNormal();
+    }
+
+    #pragma omp parallel for
+    for (int v = 0; v < numVerts(); ++v) {
+        int out;
+        vertexData(numLevels(), v, out, vertices[v].valence);
+        vertices[v].out = out < 0 ? nullptr : &halfEdges[out];
+        vertices[v].index = v;
+    }
+
+    mesh.buffersDirty = true;
+    mesh.edgeHalfEdgesDirty = true;
+    mesh.connectivityReleased = false;
+}
+
+/**
+ * @brief LoopTopologyGenerator::generate Generates a range of faces of the
+ * final level. Different ranges can be generated concurrently.
+ * @param faceBegin The first face.
+ * @param faceEnd One past the last face.
+ * @param indices Receives the three vertex indices of every face.
+ * @param twins Receives the twin of every half-edge of the faces, -1 on the
+ * boundary. Half-edge j of face f has index 3f + j.
+ * @param edges Optionally receives the edge index of every half-edge.
+ */
+void LoopTopologyGenerator::generate(int faceBegin, int faceEnd, unsigned int* indices, int* twins,
+                                     int* edges) const {
+    int level = numLevels();
+    for (int face = faceBegin; face < faceEnd; ++face) {
+        HalfEdgeData data[3];
+        faceHalfEdges(level, face, data);
+
+        int i = face - faceBegin;
+        for (int j = 0; j < 3; ++j) {
+            indices[3 * i + j] = data[j].origin;
+            twins[3 * i + j] = data[j].twin;
+            if (edges != nullptr) {
+                edges[3 * i + j] = data[j].edge;
+            }
+        }
+    }
+}
+
+/**
+ * @brief LoopTopologyGenerator::generate Generates all faces of the final
+ * level in parallel.
+ * @param indices Set to the three vertex indices of every face.
+ * @param twins Set to the twin of every half-edge, -1 on the boundary.
+ */
+void LoopTopologyGenerator::generate(QVector<unsigned int>& indices, QVector<int>& twins) const {
+    const int chunkSize = 1024;
+    int faces = numFaces();
+    indices.resize(3 * faces);
+    twins.resize(3 * faces);
+    unsigned int* indexData = indices.data();
+    int* twinData = twins.data();
+
+    #pragma omp parallel for
+    for (int chunk = 0; chunk < (faces + chunkSize - 1) / chunkSize; ++chunk) {
+        int begin = chunk * chunkSize;
+        int end = qMin(begin + chunkSize, faces);
+        generate(begin, end, indexData + 3 * begin, twinData + 3 * begin);
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef LOOP_TOPOLOGY_GENERATOR_H
+#define LOOP_TOPOLOGY_GENERATOR_H
+
+#include <QVector>
+
+#include "mesh/mesh.h"
+
+/**
+ * @brief The LoopTopologyGenerator class produces the connectivity of a level
+ * k Loop subdivision of a triangle mesh directly from the base mesh, without
+ * building the levels in between. It composes the indexing rules of
+ * LoopSubdivider::topologyRefinement: the data of a half-edge of level l + 1
+ * only depends on its parent half-edge and the previous half-edge of the
+ * parent, so every face of level k follows from its ancestor face in the base
+ * mesh in k steps. Faces can therefore be generated in any order, and any
+ * range of faces can be generated on its own.
+ */
+class LoopTopologyGenerator {
+public:
+    LoopTopologyGenerator(Mesh& baseMesh, int level);
+
+    inline int numLevels() const { return counts.size() - 1; }
+    inline int numVerts() const { return counts.last().verts; }
+    inline int numEdges() const { return counts.last().edges; }
+    inline int numFaces() const { return counts.last().faces; }
+    inline int numHalfEdges() const { return 3 * counts.last().faces; }
+
+    void generate(int faceBegin, int faceEnd, unsigned int* indices, int* twins, int* edges = nullptr) const;
+    void generate(QVector<unsigned int>& indices, QVector<int>& twins) const;
+    void restore(Mesh& mesh) const;
+
+private:
+    // Element counts of a level
+    struct LevelCounts {
+        int verts;
+        int edges;
+        int faces;
+    };
+
+    // The data of a half-edge that its children depend on. Twin is -1 on the
+    // boundary.
+    struct HalfEdgeData {
+        int origin;
+        int edge;
+        int twin;
+    };
+
+    void refineFace(int level, int f, int child, const HalfEdgeData* parent, HalfEdgeData* result) const;
+    void faceHalfEdges(int level, int face, HalfEdgeData* data) const;
+    int nextHalfEdge(int level, int h) const;
+    int edgeHalfEdge(int level, int e) const;
+    void vertexData(int level, int v, int& out, int& valence) const;
+
+    QVector<LevelCounts> counts;
+    QVector<HalfEdgeData> baseHalfEdges;
+    // Index of the next half-edge of every half-edge of the base mesh
+    QVector<int> baseNext;
+    // Outgoing half-edge (-1 if none) and valence of every base vertex
+    QVector<int> baseOut;
+    QVector<int> baseValences;
+    QVector<int> baseEdgeHalfEdges;
+
+    // Queries single faces and vertices of the intermediate levels
+    friend class ViewDependentRefiner;
+};
+
+#endif  // LOOP_TOPOLOGY_GENERATOR_H
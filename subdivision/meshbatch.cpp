@@ -0,0 +1,382 @@
+#include "meshbatch.h"
+
+#include <QPair>
+
+#include <algorithm>
+
+#include "mesh/meshvalidator.h"
+
+/**
+ * @brief The RangeMap class maps between the indices of the batch and the
+ * local indices of a single mesh, which number the ranges of its view
+ * consecutively.
+ */
+class RangeMap {
+public:
+    RangeMap(const QVector<IndexRange>& ranges) : ranges(ranges) {
+        int offset = 0;
+        for (int r = 0; r < ranges.size(); ++r) {
+            offsets.append(offset);
+            offset += ranges[r].end - ranges[r].begin;
+            byBegin.append(r);
+        }
+        total = offset;
+        std::sort(byBegin.begin(), byBegin.end(),
+                  [&ranges](int a, int b) { return ranges[a].begin < ranges[b].begin; });
+    }
+
+    inline int size() const { return total; }
+
+    /**
+     * @brief global Converts a local index to an index in the batch.
+     */
+    int global(int local) const {
+        int r = std::upper_bound(offsets.constBegin(), offsets.constEnd(), local) - offsets.constBegin() - 1;
+        return ranges[r].begin + local - offsets[r];
+    }
+
+    /**
+     * @brief local Converts an index in the batch to a local index.
+     * @return The local index, -1 if the element does not belong to the mesh.
+     */
+    int local(int global) const {
+        auto it = std::upper_bound(byBegin.constBegin(), byBegin.constEnd(), global,
+                                   [this](int g, int r) { return g < ranges[r].begin; });
+        if (it == byBegin.constBegin()) {
+            return -1;
+        }
+        int r = *(it - 1);
+        return global < ranges[r].end ? offsets[r] + global - ranges[r].begin : -1;
+    }
+
+private:
+    QVector<IndexRange> ranges;
+    QVector<int> offsets;
+    QVector<int> byBegin;
+    int total;
+};
+
+/**
+ * @brief appendRange Appends a range, merging it with the last range if they
+ * are adjacent.
+ */
+static void appendRange(QVector<IndexRange>& ranges, int begin, int end) {
+    if (!ranges.isEmpty() && ranges.last().end == begin) {
+        ranges.last().end = end;
+    } else {
+        ranges.append({begin, end});
+    }
+}
+
+/**
+ * @brief MeshBatch::MeshBatch Packs the provided meshes into a single mesh.
+ * Only the attributes that every mesh holds are carried over.
+ * @param meshes Triangle meshes, e.g. base meshes or meshes of any level.
+ */
+MeshBatch::MeshBatch(QVector<Mesh>& meshes) {
+    int numVerts = 0;
+    int numHalfEdges = 0;
+    int numFaces = 0;
+    int numEdges = 0;
+    int attributes = REFINE_ALL;
+    bool validated = true;
+
+    views.resize(meshes.size());
+    for (int i = 0; i < meshes.size(); ++i) {
+        const Mesh& control = meshes.at(i);
+        MeshView& view = views[i];
+        view.vertices.append({numVerts, numVerts + control.vertices.size()});
+        view.halfEdges.append({numHalfEdges, numHalfEdges + control.halfEdges.size()});
+        view.faces.append({numFaces, numFaces + control.faces.size()});
+        view.edges.append({numEdges, numEdges + control.edgeCount});
+
+        numVerts += control.vertices.size();
+        numHalfEdges += control.halfEdges.size();
+        numFaces += control.faces.size();
+        numEdges += control.edgeCount;
+        attributes &= control.refinedAttributes;
+        validated &= control.validated;
+    }
+
+    mesh.vertices.resize(numVerts);
+    mesh.halfEdges.resize(numHalfEdges);
+    mesh.faces.resize(numFaces);
+    mesh.edgeCount = numEdges;
+    mesh.refinedAttributes = attributes;
+    mesh.validated = validated;
+
+    Vertex* vertices = mesh.vertices.data();
+    HalfEdge* halfEdges = mesh.halfEdges.data();
+    Face* faces = mesh.faces.data();
+
+    QVector<SubdivisionShaderType> types;
+    QVector<QVector3D*> normals;
+    for (int type = LINEAR; type <= BUTTERFLY; ++type) {
+        if (attributes & refinementFlag(static_cast<SubdivisionShaderType>(type))) {
+            types.append(static_cast<SubdivisionShaderType>(type));
+            QVector<QVector3D>& typeNormals = mesh.vertexNormalsSubdivided[static_cast<SubdivisionShaderType>(type)];
+            typeNormals.resize(numVerts);
+            normals.append(typeNormals.data());
+        }
+    }
+
+    // Custom attributes are only kept if every mesh has them
+    QVector<QString> names;
+    QVector<float*> custom;
+    if ((attributes & REFINE_CUSTOM) && !meshes.isEmpty()) {
+        for (const QString& name : meshes.at(0).vertexAttributes.keys()) {
+            int channels = meshes.at(0).vertexAttributes.value(name).channels;
+            bool shared = true;
+            for (int i = 1; i < meshes.size(); ++i) {
+                shared = shared && meshes.at(i).vertexAttributes.contains(name) &&
+                         meshes.at(i).vertexAttributes.value(name).channels == channels;
+            }
+            if (shared) {
+                VertexAttribute& attribute = mesh.vertexAttributes[name];
+                attribute.channels = channels;
+                attribute.values.resize(numVerts * channels);
+                names.append(name);
+                custom.append(attribute.values.data());
+            }
+        }
+    }
+
+    #pragma omp parallel for
+    for (int i = 0; i < meshes.size(); ++i) {
+        const Mesh& control = meshes.at(i);
+        int vOffset = views[i].vertices[0].begin;
+        int hOffset = views[i].halfEdges[0].begin;
+        int fOffset = views[i].faces[0].begin;
+        int eOffset = views[i].edges[0].begin;
+
+        for (int v = 0; v < control.vertices.size(); ++v) {
+            const Vertex& source = control.vertices[v];
+            Vertex& vertex = vertices[vOffset + v];
+            vertex = source;
+            vertex.index = vOffset + v;
+            vertex.out = source.out == nullptr ? nullptr : &halfEdges[hOffset + source.out->index];
+        }
+
+        for (int h = 0; h < control.halfEdges.size(); ++h) {
+            const HalfEdge& source = control.halfEdges[h];
+            HalfEdge& halfEdge = halfEdges[hOffset + h];
+            halfEdge = source;
+            halfEdge.index = hOffset + h;
+            halfEdge.edgeIndex = eOffset + source.edgeIndex;
+            halfEdge.origin = &vertices[vOffset + source.origin->index];
+            halfEdge.next = &halfEdges[hOffset + source.next->index];
+            halfEdge.prev = &halfEdges[hOffset + source.prev->index];
+            halfEdge.twin = source.twin == nullptr ? nullptr : &halfEdges[hOffset + source.twin->index];
+            halfEdge.face = &faces[fOffset + source.face->index];
+        }
+
+        for (int f = 0; f < control.faces.size(); ++f) {
+            const Face& source = control.faces[f];
+            Face& face = faces[fOffset + f];
+            face = source;
+            face.index = fOffset + f;
+            face.side = &halfEdges[hOffset + source.side->index];
+        }
+
+        for (int t = 0; t < types.size(); ++t) {
+            QVector<QVector3D> typeNormals = control.vertexNormalsSubdivided.value(types[t]);
+            std::copy(typeNormals.constBegin(), typeNormals.constEnd(), normals[t] + vOffset);
+        }
+
+        for (int a = 0; a < names.size(); ++a) {
+            VertexAttribute attribute = control.vertexAttributes.value(names[a]);
+            std::copy(attribute.values.constBegin(), attribute.values.constEnd(),
+                      custom[a] + vOffset * attribute.channels);
+        }
+    }
+
+    // The meshes are packed in order, so the sparse blend weights stay sorted
+    if (attributes & REFINE_BLEND_WEIGHTS) {
+        SparseVertexWeights blendWeights;
+        for (int i = 0; i < meshes.size(); ++i) {
+            const SparseVertexWeights& weights = meshes.at(i).blendWeights;
+            for (int s = 0; s < weights.indices.size(); ++s) {
+                blendWeights.indices.append(views[i].vertices[0].begin + weights.indices[s]);
+                blendWeights.values.append(weights.values[s]);
+            }
+        }
+        mesh.setSparseBlendWeights(blendWeights);
+    }
+}
+
+/**
+ * @brief MeshBatch::subdivide Subdivides all meshes of the batch at once.
+ * @param subdivider The subdivider to use. The views are updated following
+ * the indexing rules of LoopSubdivider.
+ * @param attributes The RefinementAttribute flags to produce, see
+ * LoopSubdivider::subdivide.
+ */
+void MeshBatch::subdivide(const LoopSubdivider& subdivider, int attributes) {
+    for (int i = 0; i < views.size(); ++i) {
+        views[i] = refineView(views[i]);
+    }
+    mesh = subdivider.subdivide(mesh, attributes);
+    MeshValidator().validate(mesh);
+}
+
+/**
+ * @brief MeshBatch::refineView Determines where the elements of a mesh end up
+ * after a subdivision step of the batch. Vertex v stays at v and edge e gets
+ * vertex V + e; half-edge h splits into 3h, 3h + 1, 3h + 2 and 3H + h; face f
+ * into 3f, 3f + 1, 3f + 2 and 3F + f; edge e into 2e and 2e + 1, and the
+ * interior edges are 2E + h.
+ * @param view The view in the current batch.
+ * @return The view in the subdivided batch.
+ */
+MeshView MeshBatch::refineView(const MeshView& view) const {
+    int numVerts = mesh.vertices.size();
+    int numHalfEdges = mesh.halfEdges.size();
+    int numFaces = mesh.faces.size();
+    int numEdges = mesh.edgeCount;
+
+    MeshView refined;
+    for (const IndexRange& range : view.vertices) {
+        appendRange(refined.vertices, range.begin, range.end);
+    }
+    for (const IndexRange& range : view.edges) {
+        appendRange(refined.vertices, numVerts + range.begin, numVerts + range.end);
+    }
+
+    for (const IndexRange& range : view.halfEdges) {
+        appendRange(refined.halfEdges, 3 * range.begin, 3 * range.end);
+    }
+    for (const IndexRange& range : view.halfEdges) {
+        appendRange(refined.halfEdges, 3 * numHalfEdges + range.begin, 3 * numHalfEdges + range.end);
+    }
+
+    for (const IndexRange& range : view.faces) {
+        appendRange(refined.faces, 3 * range.begin, 3 * range.end);
+    }
+    for (const IndexRange& range : view.faces) {
+        appendRange(refined.faces, 3 * numFaces + range.begin, 3 * numFaces + range.end);
+    }
+
+    for (const IndexRange& range : view.edges) {
+        appendRange(refined.edges, 2 * range.begin, 2 * range.end);
+    }
+    for (const IndexRange& range : view.halfEdges) {
+        appendRange(refined.edges, 2 * numEdges + range.begin, 2 * numEdges + range.end);
+    }
+
+    return refined;
+}
+
+/**
+ * @brief MeshBatch::extractMesh Copies a single mesh out of the batch. Its
+ * elements are numbered in the order of the ranges of its view, which keeps
+ * the half-edges of a face consecutive.
+ * @param i The index of the mesh in the batch.
+ * @return The mesh, with the attributes the batch holds.
+ */
+Mesh MeshBatch::extractMesh(int i) {
+    const MeshView& view = views[i];
+    RangeMap vertexMap(view.vertices);
+    RangeMap halfEdgeMap(view.halfEdges);
+    RangeMap faceMap(view.faces);
+    RangeMap edgeMap(view.edges);
+
+    Mesh result;
+    result.vertices.resize(vertexMap.size());
+    result.halfEdges.resize(halfEdgeMap.size());
+    result.faces.resize(faceMap.size());
+    result.edgeCount = edgeMap.size();
+    result.refinedAttributes = mesh.refinedAttributes;
+    result.validated = mesh.validated;
+
+    const QVector<Vertex>& vertices = mesh.vertices;
+    const QVector<HalfEdge>& halfEdges = mesh.halfEdges;
+    const QVector<Face>& faces = mesh.faces;
+    Vertex* newVertices = result.vertices.data();
+    HalfEdge* newHalfEdges = result.halfEdges.data();
+    Face* newFaces = result.faces.data();
+
+    #pragma omp parallel for
+    for (int v = 0; v < vertexMap.size(); ++v) {
+        const Vertex& source = vertices[vertexMap.global(v)];
+        newVertices[v] = source;
+        newVertices[v].index = v;
+        newVertices[v].out = source.out == nullptr ? nullptr : &newHalfEdges[halfEdgeMap.local(source.out->index)];
+    }
+
+    #pragma omp parallel for
+    for (int h = 0; h < halfEdgeMap.size(); ++h) {
+        const HalfEdge& source = halfEdges[halfEdgeMap.global(h)];
+        HalfEdge& halfEdge = newHalfEdges[h];
+        halfEdge = source;
+        halfEdge.index = h;
+        halfEdge.edgeIndex = edgeMap.local(source.edgeIndex);
+        halfEdge.origin = &newVertices[vertexMap.local(source.origin->index)];
+        halfEdge.next = &newHalfEdges[halfEdgeMap.local(source.next->index)];
+        halfEdge.prev = &newHalfEdges[halfEdgeMap.local(source.prev->index)];
+        halfEdge.twin = source.twin == nullptr ? nullptr : &newHalfEdges[halfEdgeMap.local(source.twin->index)];
+        halfEdge.face = &newFaces[faceMap.local(source.face->index)];
+    }
+
+    #pragma omp parallel for
+    for (int f = 0; f < faceMap.size(); ++f) {
+        const Face& source = faces[faceMap.global(f)];
+        newFaces[f] = source;
+        newFaces[f].index = f;
+        newFaces[f].side = &newHalfEdges[halfEdgeMap.local(source.side->index)];
+    }
+
+    for (int type = LINEAR; type <= BUTTERFLY; ++type) {
+        SubdivisionShaderType shaderType = static_cast<SubdivisionShaderType>(type);
+        if (!(mesh.refinedAttributes & refinementFlag(shaderType))) {
+            continue;
+        }
+        const QVector<QVector3D>& normals = mesh.vertexNormalsSubdivided[shaderType];
+        QVector<QVector3D>& newNormals = result.vertexNormalsSubdivided[shaderType];
+        newNormals.resize(vertexMap.size());
+        for (int v = 0; v < vertexMap.size(); ++v) {
+            newNormals[v] = normals[vertexMap.global(v)];
+        }
+    }
+
+    if (mesh.sphericalIterations.size() == vertices.size()) {
+        result.sphericalIterations.resize(vertexMap.size());
+        for (int v = 0; v < vertexMap.size(); ++v) {
+            result.sphericalIterations[v] = mesh.sphericalIterations[vertexMap.global(v)];
+        }
+    }
+
+    for (const QString& name : mesh.vertexAttributes.keys()) {
+        const VertexAttribute& attribute = mesh.vertexAttributes[name];
+        VertexAttribute& newAttribute = result.vertexAttributes[name];
+        newAttribute.channels = attribute.channels;
+        newAttribute.values.resize(vertexMap.size() * attribute.channels);
+        for (int v = 0; v < vertexMap.size(); ++v) {
+            int global = vertexMap.global(v);
+            for (int c = 0; c < attribute.channels; ++c) {
+                newAttribute.values[v * attribute.channels + c] = attribute.values[global * attribute.channels + c];
+            }
+        }
+    }
+
+    if (mesh.refinedAttributes & REFINE_BLEND_WEIGHTS) {
+        // Local numbering does not preserve the order of the batch
+        QVector<QPair<int, float>> support;
+        const SparseVertexWeights& weights = mesh.blendWeights;
+        for (int s = 0; s < weights.indices.size(); ++s) {
+            int local = vertexMap.local(weights.indices[s]);
+            if (local >= 0) {
+                support.append({local, weights.values[s]});
+            }
+        }
+        std::sort(support.begin(), support.end());
+
+        SparseVertexWeights blendWeights;
+        for (const QPair<int, float>& entry : support) {
+            blendWeights.indices.append(entry.first);
+            blendWeights.values.append(entry.second);
+        }
+        result.setSparseBlendWeights(blendWeights);
+    }
+
+    return result;
+}
@@ -0,0 +1,55 @@
+#ifndef MESH_BATCH_H
+#define MESH_BATCH_H
+
+#include <QVector>
+
+#include "loopsubdivider.h"
+#include "mesh/mesh.h"
+
+/**
+ * @brief The IndexRange struct is a half-open range [begin, end) of indices.
+ */
+struct IndexRange {
+    int begin;
+    int end;
+};
+
+/**
+ * @brief The MeshView struct describes where the elements of one mesh of a
+ * MeshBatch live in the concatenated mesh. Every subdivision step splits the
+ * elements of a mesh over several ranges (e.g. its vertex points and its edge
+ * points), listed in the order of the local numbering of the mesh.
+ */
+struct MeshView {
+    QVector<IndexRange> vertices;
+    QVector<IndexRange> halfEdges;
+    QVector<IndexRange> faces;
+    QVector<IndexRange> edges;
+};
+
+/**
+ * @brief The MeshBatch class packs many (small) control meshes into a single
+ * mesh with a concatenated index space, so that they are subdivided together:
+ * every stage of the subdivision is a single parallel pass over all meshes,
+ * instead of one call with its own allocations per mesh. The individual meshes
+ * are tracked as views and can be extracted again at any level.
+ */
+class MeshBatch {
+public:
+    MeshBatch(QVector<Mesh>& meshes);
+
+    inline Mesh& getMesh() { return mesh; }
+    inline int numMeshes() const { return views.size(); }
+    inline const MeshView& getView(int i) const { return views[i]; }
+
+    void subdivide(const LoopSubdivider& subdivider, int attributes = REFINE_ALL);
+    Mesh extractMesh(int i);
+
+private:
+    MeshView refineView(const MeshView& view) const;
+
+    Mesh mesh;
+    QVector<MeshView> views;
+};
+
+#endif  // MESH_BATCH_H
@@ -0,0 +1,238 @@
+#include "neighborhood.h"
+
+#include <math.h>
+
+/**
+ * @brief VertexNeighborhood::VertexNeighborhood Gathers the one-ring of the
+ * provided vertex and the weights of Loop's vertex stencil.
+ * @param vertex The vertex of the control mesh.
+ * @param checked Whether to gather the ring without trusting the connectivity,
+ * for meshes that did not pass validation.
+ */
+VertexNeighborhood::VertexNeighborhood(const Vertex& vertex, bool checked) {
+    center = vertex.index;
+    if (checked) {
+        gatherChecked(vertex);
+        return;
+    }
+
+    boundary = vertex.isBoundaryVertex();
+
+    if (boundary) {
+        ring.append(vertex.prevBoundaryHalfEdge()->origin->index);
+        ring.append(vertex.nextBoundaryHalfEdge()->next->origin->index);
+        centerWeight = 6.0 / 8.0;
+        ringWeight = 1.0 / 8.0;
+        return;
+    }
+
+    float valence = vertex.valence;
+    ringWeight = valence == 3.0 ? 3.0 / 16.0 : 3.0 / (8.0 * valence);
+    centerWeight = 1.0 - valence * ringWeight;
+
+    HalfEdge* halfedge = vertex.out->twin;
+    do {
+        ring.append(halfedge->origin->index);
+        halfedge = halfedge->next->twin;
+    } while (halfedge != vertex.out->twin);
+}
+
+/**
+ * @brief VertexNeighborhood::gatherChecked Gathers the one-ring without
+ * trusting the connectivity: every walk is bounded and stops at missing twins,
+ * and the weights follow the gathered ring instead of the stored valence. If
+ * the ring cannot be gathered, the ring is left empty so that the vertex keeps
+ * its value.
+ * @param vertex The vertex of the control mesh.
+ */
+void VertexNeighborhood::gatherChecked(const Vertex& vertex) {
+    const int maxSteps = 1024;
+    boundary = false;
+    centerWeight = 1.0;
+    ringWeight = 0.0;
+    if (vertex.out == nullptr) {
+        return;
+    }
+
+    // Walk over the outgoing half-edges until the ring closes or ends
+    QVarLengthArray<int, 16> neighbours;
+    HalfEdge* halfedge = vertex.out;
+    HalfEdge* last = halfedge;
+    int steps = 0;
+    do {
+        neighbours.append(halfedge->next->origin->index);
+        last = halfedge;
+        halfedge = halfedge->twin == nullptr ? nullptr : halfedge->twin->next;
+    } while (halfedge != nullptr && halfedge != vertex.out && ++steps < maxSteps);
+
+    if (halfedge == vertex.out) {
+        float valence = neighbours.size();
+        ringWeight = valence == 3.0 ? 3.0 / 16.0 : 3.0 / (8.0 * valence);
+        centerWeight = 1.0 - valence * ringWeight;
+        ring = neighbours;
+        return;
+    }
+    if (halfedge != nullptr) {
+        return;
+    }
+
+    // Boundary vertex, last is the outgoing boundary half-edge. Find the
+    // incoming one by walking in the other direction.
+    HalfEdge* incoming = vertex.out->prev;
+    for (steps = 0; incoming->twin != nullptr && steps < maxSteps; ++steps) {
+        incoming = incoming->twin->prev;
+    }
+    if (incoming->twin != nullptr) {
+        return;
+    }
+
+    boundary = true;
+    ring.append(incoming->origin->index);
+    ring.append(last->next->origin->index);
+    centerWeight = 6.0 / 8.0;
+    ringWeight = 1.0 / 8.0;
+}
+
+/**
+ * @brief VertexNeighborhood::stencil Lists the vertices and weights of Loop's
+ * vertex stencil, for kernels that process the stencil as arrays.
+ * @param indices Set to the vertex indices.
+ * @param weights Set to the corresponding weights.
+ */
+void VertexNeighborhood::stencil(QVarLengthArray<int, 16>& indices,
+                                 QVarLengthArray<float, 16>& weights) const {
+    indices.clear();
+    weights.clear();
+    indices.append(center);
+    weights.append(centerWeight);
+    for (int i = 0; i < ring.size(); ++i) {
+        indices.append(ring[i]);
+        weights.append(ringWeight);
+    }
+}
+
+/**
+ * @brief VertexNeighborhood::useSqrt3Weights Replaces the weights of Loop's
+ * vertex stencil by those of the relaxation of sqrt(3) subdivision: 1 - alpha
+ * for the centre and alpha / n for every neighbour, with
+ * alpha = (4 - 2 cos(2 pi / n)) / 9. Boundary vertices keep their value, as
+ * do vertices whose ring could not be gathered. loop() and stencil() apply the
+ * new weights.
+ */
+void VertexNeighborhood::useSqrt3Weights() {
+    if (boundary || ring.isEmpty()) {
+        centerWeight = 1.0;
+        ringWeight = 0.0;
+        return;
+    }
+    float valence = ring.size();
+    float alpha = (4.0 - 2.0 * cosf(2.0 * M_PI / valence)) / 9.0;
+    centerWeight = 1.0 - alpha;
+    ringWeight = alpha / valence;
+}
+
+/**
+ * @brief EdgeNeighborhood::EdgeNeighborhood Gathers the butterfly
+ * neighbourhood of the edge the provided half-edge lives on.
+ * @param edge One of the half-edges of the edge in the control mesh.
+ */
+EdgeNeighborhood::EdgeNeighborhood(const HalfEdge& edge) {
+    boundary = edge.isBoundaryEdge();
+
+    points[0] = edge.origin->index;
+    points[1] = edge.next->origin->index;
+    for (int i = 2; i < 8; ++i) {
+        points[i] = -1;
+    }
+
+    if (boundary) {
+        return;
+    }
+
+    points[2] = edge.next->next->origin->index;
+    points[3] = edge.twin->next->next->origin->index;
+
+    // Wings, only present when the neighbouring triangles exist
+    if (edge.prev->twin != nullptr) {
+        points[4] = edge.prev->twin->prev->origin->index;
+    }
+    if (edge.twin->next->twin != nullptr) {
+        points[5] = edge.twin->next->twin->prev->origin->index;
+    }
+    if (edge.twin->prev->twin != nullptr) {
+        points[6] = edge.twin->prev->twin->prev->origin->index;
+    }
+    if (edge.next->twin != nullptr) {
+        points[7] = edge.next->twin->prev->origin->index;
+    }
+}
+
+/**
+ * @brief EdgeNeighborhood::stencil Lists the vertices and weights of Loop's
+ * edge stencil, for kernels that process the stencil as arrays.
+ * @param indices Set to the vertex indices.
+ * @param weights Set to the corresponding weights.
+ */
+void EdgeNeighborhood::stencil(QVarLengthArray<int, 16>& indices,
+                               QVarLengthArray<float, 16>& weights) const {
+    indices.clear();
+    weights.clear();
+    if (boundary) {
+        indices.append(points[0]);
+        indices.append(points[1]);
+        weights.append(1.0 / 2.0);
+        weights.append(1.0 / 2.0);
+        return;
+    }
+    const float edgeWeights[4] = {6.0 / 16.0, 6.0 / 16.0, 2.0 / 16.0, 2.0 / 16.0};
+    for (int i = 0; i < 4; ++i) {
+        indices.append(points[i]);
+        weights.append(edgeWeights[i]);
+    }
+}
+
+/**
+ * @brief FaceNeighborhood::FaceNeighborhood Gathers the neighbourhood of the
+ * provided triangle.
+ * @param face The face of the control mesh.
+ */
+FaceNeighborhood::FaceNeighborhood(const Face& face) : face(face.index) {
+    boundary = false;
+    for (int i = 3; i < 12; ++i) {
+        points[i] = -1;
+    }
+
+    const HalfEdge* edge = face.side;
+    for (int i = 0; i < 3; ++i, edge = edge->next) {
+        points[i] = edge->origin->index;
+        if (edge->twin == nullptr) {
+            boundary = true;
+            continue;
+        }
+
+        const HalfEdge* twin = edge->twin;
+        points[3 + i] = twin->prev->origin->index;
+        if (twin->next->twin != nullptr) {
+            points[6 + 2 * i] = twin->next->twin->prev->origin->index;
+        }
+        if (twin->prev->twin != nullptr) {
+            points[7 + 2 * i] = twin->prev->twin->prev->origin->index;
+        }
+    }
+}
+
+/**
+ * @brief FaceNeighborhood::stencil Lists the vertices and weights of the
+ * approximating face stencil, for kernels that process the stencil as arrays.
+ * @param indices Set to the vertex indices.
+ * @param weights Set to the corresponding weights.
+ */
+void FaceNeighborhood::stencil(QVarLengthArray<int, 16>& indices,
+                               QVarLengthArray<float, 16>& weights) const {
+    indices.clear();
+    weights.clear();
+    for (int i = 0; i < 3; ++i) {
+        indices.append(points[i]);
+        weights.append(1.0 / 3.0);
+    }
+}
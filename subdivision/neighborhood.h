@@ -0,0 +1,102 @@
+#ifndef NEIGHBORHOOD_H
+#define NEIGHBORHOOD_H
+
+#include <QVarLengthArray>
+
+#include "mesh/face.h"
+#include "mesh/halfedge.h"
+#include "mesh/vertex.h"
+
+/**
+ * @brief The VertexNeighborhood struct holds the one-ring of a control vertex,
+ * gathered once so that the position and every shading attribute of the
+ * corresponding vertex point can be evaluated without walking the ring again.
+ * For boundary vertices the ring only contains the two boundary neighbours.
+ * Unless checked is set, the connectivity is trusted (see MeshValidator): on
+ * broken rings the unchecked walks may not terminate.
+ */
+struct VertexNeighborhood {
+    VertexNeighborhood(const Vertex& vertex, bool checked = false);
+
+    /**
+     * @brief loop Applies Loop's vertex stencil to the values returned by
+     * fetch, which maps a vertex index to the value at that vertex.
+     */
+    template <typename Fetch>
+    auto loop(Fetch fetch) const -> decltype(fetch(0)) {
+        auto value = centerWeight * fetch(center);
+        for (int i = 0; i < ring.size(); ++i) {
+            value += ringWeight * fetch(ring[i]);
+        }
+        return value;
+    }
+
+    void stencil(QVarLengthArray<int, 16>& indices, QVarLengthArray<float, 16>& weights) const;
+    void useSqrt3Weights();
+
+    int center;
+    bool boundary;
+    float centerWeight;
+    float ringWeight;
+    QVarLengthArray<int, 16> ring;
+
+private:
+    void gatherChecked(const Vertex& vertex);
+};
+
+/**
+ * @brief The EdgeNeighborhood struct holds the eight-point butterfly
+ * neighbourhood of a control edge. The first four points form the Loop edge
+ * stencil, the last four are the butterfly wings. Missing points (boundary
+ * edges have only two, open meshes may miss wings) are set to -1.
+ */
+struct EdgeNeighborhood {
+    EdgeNeighborhood(const HalfEdge& edge);
+
+    /**
+     * @brief loop Applies Loop's edge stencil to the values returned by fetch.
+     */
+    template <typename Fetch>
+    auto loop(Fetch fetch) const -> decltype(fetch(0)) {
+        if (boundary) {
+            return fetch(points[0]) / 2.0 + fetch(points[1]) / 2.0;
+        }
+        return (6.0 * fetch(points[0]) + 6.0 * fetch(points[1]) +
+                2.0 * fetch(points[2]) + 2.0 * fetch(points[3])) / 16.0;
+    }
+
+    void stencil(QVarLengthArray<int, 16>& indices, QVarLengthArray<float, 16>& weights) const;
+
+    int points[8];
+    bool boundary;
+};
+
+/**
+ * @brief The FaceNeighborhood struct holds the twelve-point neighbourhood of a
+ * control face used by the face points of sqrt(3) subdivision. The first three
+ * points are the corners, the next three the opposite vertices of the
+ * neighbouring triangles (across the edge starting at corner i), the last six
+ * the opposite vertices of the triangles across the outer edges of those
+ * neighbours. Missing points are set to -1.
+ */
+struct FaceNeighborhood {
+    FaceNeighborhood(const Face& face);
+
+    /**
+     * @brief loop Applies the approximating face stencil of sqrt(3)
+     * subdivision, the centroid. Named like the stencils of the other
+     * neighbourhoods, so that the spherical averaging accepts it as well.
+     */
+    template <typename Fetch>
+    auto loop(Fetch fetch) const -> decltype(fetch(0)) {
+        return (fetch(points[0]) + fetch(points[1]) + fetch(points[2])) / 3.0;
+    }
+
+    void stencil(QVarLengthArray<int, 16>& indices, QVarLengthArray<float, 16>& weights) const;
+
+    int face;
+    int points[12];
+    bool boundary;
+};
+
+#endif  // NEIGHBORHOOD_H
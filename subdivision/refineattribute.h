@@ -0,0 +1,143 @@
+#ifndef REFINE_ATTRIBUTE_H
+#define REFINE_ATTRIBUTE_H
+
+#include "mesh/mesh.h"
+#include "neighborhood.h"
+
+/**
+ * @brief The LoopScheme struct applies Loop's approximating stencils. Schemes
+ * are selected at compile time through the template parameter of the
+ * refine*Channels helpers, so the stencils are inlined into the traversal of
+ * the subdividers.
+ */
+struct LoopScheme {
+    template <typename Fetch>
+    static auto vertex(const VertexNeighborhood& neighborhood, Fetch fetch) -> decltype(fetch(0)) {
+        return neighborhood.loop(fetch);
+    }
+
+    template <typename Fetch>
+    static auto edge(const EdgeNeighborhood& neighborhood, Fetch fetch) -> decltype(fetch(0)) {
+        return neighborhood.loop(fetch);
+    }
+};
+
+/**
+ * @brief The ButterflyScheme struct applies the interpolating (modified)
+ * Butterfly stencils with tension parameter w = 1/16. Vertex points keep their
+ * value, missing wings do not contribute.
+ */
+struct ButterflyScheme {
+    template <typename Fetch>
+    static auto vertex(const VertexNeighborhood& neighborhood, Fetch fetch) -> decltype(fetch(0)) {
+        return fetch(neighborhood.center);
+    }
+
+    template <typename Fetch>
+    static auto edge(const EdgeNeighborhood& neighborhood, Fetch fetch) -> decltype(fetch(0)) {
+        const float w = 1.0 / 16.0;
+        const int* p = neighborhood.points;
+
+        if (neighborhood.boundary) {
+            return fetch(p[0]) / 2.0 + fetch(p[1]) / 2.0;
+        }
+
+        decltype(fetch(0)) wings = decltype(fetch(0))();
+        for (int i = 4; i < 8; ++i) {
+            if (p[i] >= 0) {
+                wings += fetch(p[i]);
+            }
+        }
+
+        return (fetch(p[0]) + fetch(p[1])) / 2.0 + 2.0 * w * (fetch(p[2]) + fetch(p[3])) - w * wings;
+    }
+};
+
+/**
+ * @brief The Sqrt3Scheme struct applies the approximating stencils of sqrt(3)
+ * subdivision (Kobbelt 2000): the relaxation of the vertex points, whose
+ * weights are set by VertexNeighborhood::useSqrt3Weights, and the centroid for
+ * the face points.
+ */
+struct Sqrt3Scheme {
+    template <typename Fetch>
+    static auto vertex(const VertexNeighborhood& neighborhood, Fetch fetch) -> decltype(fetch(0)) {
+        return neighborhood.loop(fetch);
+    }
+
+    template <typename Fetch>
+    static auto face(const FaceNeighborhood& neighborhood, Fetch fetch) -> decltype(fetch(0)) {
+        return neighborhood.loop(fetch);
+    }
+};
+
+/**
+ * @brief The InterpolatingSqrt3Scheme struct applies the regular stencil of the
+ * interpolating sqrt(3) scheme of Labsik and Greiner (2000), the counterpart of
+ * ButterflyScheme: vertex points keep their value, face points weigh the
+ * corners with 32/81, the opposite vertices with -1/81 and the outer six with
+ * -2/81. Missing outer points do not contribute, faces on the boundary fall
+ * back to the centroid.
+ */
+struct InterpolatingSqrt3Scheme {
+    template <typename Fetch>
+    static auto vertex(const VertexNeighborhood& neighborhood, Fetch fetch) -> decltype(fetch(0)) {
+        return fetch(neighborhood.center);
+    }
+
+    template <typename Fetch>
+    static auto face(const FaceNeighborhood& neighborhood, Fetch fetch) -> decltype(fetch(0)) {
+        const int* p = neighborhood.points;
+
+        if (neighborhood.boundary) {
+            return neighborhood.loop(fetch);
+        }
+
+        decltype(fetch(0)) outer = decltype(fetch(0))();
+        for (int i = 6; i < 12; ++i) {
+            if (p[i] >= 0) {
+                outer += fetch(p[i]);
+            }
+        }
+
+        return (32.0 * (fetch(p[0]) + fetch(p[1]) + fetch(p[2])) - (fetch(p[3]) + fetch(p[4]) + fetch(p[5])) -
+                2.0 * outer) / 81.0;
+    }
+};
+
+/**
+ * @brief refineVertexChannels Refines all channels of a single vertex point.
+ * Values are stored interleaved, i.e. channel c of vertex v lives at
+ * values[v * channels + c].
+ */
+template <typename T, typename Scheme>
+inline void refineVertexChannels(const VertexNeighborhood& neighborhood,
+                                 const T* values, int channels, T* newValues) {
+    for (int c = 0; c < channels; ++c) {
+        newValues[c] = Scheme::vertex(neighborhood, [&](int v) { return values[v * channels + c]; });
+    }
+}
+
+/**
+ * @brief refineEdgeChannels Refines all channels of a single edge point.
+ */
+template <typename T, typename Scheme>
+inline void refineEdgeChannels(const EdgeNeighborhood& neighborhood,
+                               const T* values, int channels, T* newValues) {
+    for (int c = 0; c < channels; ++c) {
+        newValues[c] = Scheme::edge(neighborhood, [&](int v) { return values[v * channels + c]; });
+    }
+}
+
+/**
+ * @brief refineFaceChannels Refines all channels of a single face point.
+ */
+template <typename T, typename Scheme>
+inline void refineFaceChannels(const FaceNeighborhood& neighborhood,
+                               const T* values, int channels, T* newValues) {
+    for (int c = 0; c < channels; ++c) {
+        newValues[c] = Scheme::face(neighborhood, [&](int v) { return values[v * channels + c]; });
+    }
+}
+
+#endif  // REFINE_ATTRIBUTE_H
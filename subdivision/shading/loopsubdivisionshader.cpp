@@ -1,185 +1,133 @@
 #include "loopsubdivisionshader.h"
-#include <QDebug>
+
+#include "sphericalkernels.h"
 
 LoopSubdivisionShader::LoopSubdivisionShader() {}
 
 /**
- * @brief LoopSubdivisionShader::normalRefinement Refines the normals based on
- * the Loop subdivision stencils and Subdivision Shading described in the
- * 2008 paper by Marc Alexa and Tamy Boubekeur.
+ * @brief LoopSubdivisionShader::setConvergence Configures when the spherical
+ * averaging stops iterating.
+ * @param tolerance The iteration stops once n^k is rotated by at most this
+ * angle (in radians) in an iteration.
+ * @param maxIterations Upper bound on the number of iterations.
  */
-void LoopSubdivisionShader::normalRefinement(Mesh& controlMesh, Mesh& newMesh) const {
-    // Compute normals with angle-weighted average of incident faces normals.
-    newMesh.computeBaseNormals();
-
-    // Compute subdivision shading normals with Loop subdivision
-    for (int subdivType = LINEAR; subdivType <= SPHERICAL; ++subdivType) {
-        SubdivisionShaderType averagingMethod = static_cast<SubdivisionShaderType>(subdivType);
-
-        QVector<Vertex>& vertices = controlMesh.getVertices();
-        QVector<HalfEdge>& halfEdges = controlMesh.getHalfEdges();
-        QVector<QVector3D>& normals = controlMesh.getVertexSubdivNormals(averagingMethod);
-        QVector<QVector3D>& newNormals = newMesh.getVertexSubdivNormals(averagingMethod);
-
-        // Vertex normals
-        for (int v = 0; v < controlMesh.numVerts(); v++) {
-            newNormals[v] = vertexNormal(vertices[v], normals).normalized();
-
-            if (subdivType == SPHERICAL) {
-                newNormals[v] = sphericalAveragingVertex(vertices[v], newNormals[v], normals);
-            }
-        }
-
-        // Edge normals, i.e. the normals of newly created vertices
-        for (int h = 0; h < controlMesh.numHalfEdges(); h++) {
-            HalfEdge currentEdge = halfEdges[h];
-            if (h > currentEdge.twinIdx()) {
-                int v = controlMesh.numVerts() + currentEdge.edgeIdx();
-                newNormals[v] = edgeNormal(currentEdge, normals).normalized();
-
-                if (subdivType == SPHERICAL) {
-                    QVector3D temp = newNormals[v];
-                    newNormals[v] = sphericalAveragingEdge(currentEdge, newNormals[v], normals);
-                    qDebug() << temp << " " << newNormals[v];
-                }
-            }
-        }
-
-        // Write new normals to mesh
-        newMesh.setSubdividedNormals(averagingMethod, newNormals);
-    }
-}
-
-QVector3D LoopSubdivisionShader::vertexNormal(const Vertex& vertex, const QVector<QVector3D> normals) const {
-    if (vertex.isBoundaryVertex()) {
-        int v0 = vertex.index;
-        int v1 = vertex.prevBoundaryHalfEdge()->origin->index;
-        int v2 = vertex.nextBoundaryHalfEdge()->next->origin->index;
-
-        return (normals[v1] + 6.0 * normals[v0] + normals[v2]).normalized();
-    }
-
-    float valence = vertex.valence;
-    float beta = (valence == 3.0 ? 3.0 / 16.0 : 3.0 / (8.0 * valence));
-
-    int v0 = vertex.index;
-
-    QVector3D normal = normals[v0] * (1.0 - valence * beta);
-    HalfEdge* halfedge = vertex.out->twin;
-
-    do {
-        int vNext = halfedge->origin->index;
-        normal += normals[vNext] * beta;
-        halfedge = halfedge->next->twin;
-    } while (halfedge != vertex.out->twin);
-
-    return normal;
+void LoopSubdivisionShader::setConvergence(float tolerance, int maxIterations) {
+    this->tolerance = tolerance;
+    this->maxIterations = maxIterations;
 }
 
-QVector3D LoopSubdivisionShader::edgeNormal(const HalfEdge& edge, const QVector<QVector3D> normals) const {
-    if (edge.isBoundaryEdge()) {
-        int v1 = edge.origin->index;
-        int v2 = edge.next->origin->index;
-
-        QVector3D newNormal = normals[v1] / 2.0 + normals[v2] / 2.0;
-        return newNormal.normalized();
-    }
-
-    int v1 = edge.origin->index;
-    int v2 = edge.next->origin->index;
-    int v3 = edge.next->next->origin->index;
-    int v4 = edge.twin->next->next->origin->index;
-
-    return (6.0 * normals[v1] + 6.0 * normals[v2] + 2.0 * normals[v3] + 2.0 * normals[v4]);
+/**
+ * @brief LoopSubdivisionShader::setAccuracy Selects the kernels used for the
+ * exponential map and the rotation.
+ * @param accuracy SPHERICAL_EXACT for the standard library kernels, or one of
+ * the approximations described in sphericalkernels.h.
+ */
+void LoopSubdivisionShader::setAccuracy(SphericalAccuracy accuracy) {
+    this->accuracy = accuracy;
 }
 
-QVector3D LoopSubdivisionShader::sphericalAveragingVertex(const Vertex& vertex,
-                                                          QVector3D linearlyAveragedNormal,
-                                                          const QVector<QVector3D> normals) const {
-    int stopCriterion = 3;
-
-    // Compute beta of Warren's stencil
-    float valence = vertex.valence;
-    float beta = (valence == 3.0 ? 3.0 / 16.0 : 3.0 / (8.0 * valence));
-
+/**
+ * @brief LoopSubdivisionShader::sphericalAveraging Iterates the spherical
+ * average of the normals in the neighbourhood, starting from the linearly
+ * averaged normal.
+ * @param neighborhood The gathered vertex or edge neighbourhood.
+ * @param linearlyAveragedNormal The normalized result of the linear stencil.
+ * @param normals The normals of the control mesh.
+ * @param iterations Set to the number of iterations that were needed.
+ * @return The spherically averaged normal.
+ */
+template <typename Neighborhood>
+QVector3D LoopSubdivisionShader::sphericalAveraging(const Neighborhood& neighborhood,
+                                                    QVector3D linearlyAveragedNormal,
+                                                    const QVector<QVector3D>& normals,
+                                                    int& iterations) const {
     // Set nk to the result from step 1., which is the same as the linear weighted average we have done before.
     QVector3D nk = linearlyAveragedNormal;
 
-    for (int i = 0; i < stopCriterion; ++i) {
-        QVector3D nk1squiggle;
-
-        if (vertex.isBoundaryVertex()) {
-            // 2.  Map all input normals orthogonally to a plane orthogonal to n^k
-            QVector3D n0squiggle = createExponentialMap(nk, normals[vertex.index]);
-            QVector3D n1squiggle = createExponentialMap(nk, normals[vertex.prevBoundaryHalfEdge()->origin->index]);
-            QVector3D n2squiggle = createExponentialMap(nk, normals[vertex.nextBoundaryHalfEdge()->next->origin->index]);
-
-            // 3. Perform linear combination in the exponential map to obtain \~{n}^{k+1}
-            nk1squiggle = (n1squiggle + 6.0 * n0squiggle + n2squiggle) / 8.0;
-        } else {
-            // Step 2 and 3. combined
-            QVector3D nk1squiggle = (1 - valence * beta) * createExponentialMap(nk, normals[vertex.index]);
-            HalfEdge* halfedge = vertex.out->twin;
-
-            do {
-                int vNext = halfedge->origin->index;
-                nk1squiggle += beta * createExponentialMap(nk, normals[vNext]);
-                halfedge = halfedge->next->twin;
-            } while (halfedge != vertex.out->twin);
-        }
+    if (accuracy != SPHERICAL_EXACT) {
+        return sphericalAveragingBatched(neighborhood, nk, normals, iterations);
+    }
 
-        // 4. Rotate n^k around n^k x \~{n}^{k+1} with angle ||nk+1squiggle|| to obtain n^{k+1}
-        QVector3D nk1 = rotateAroundAxis(nk, nk1squiggle, nk1squiggle.length());
+    iterations = 0;
+    while (iterations < maxIterations) {
+        // 2. Map all input normals orthogonally to a plane orthogonal to n^k
+        // 3. Perform linear combination in the exponential map to obtain \~{n}^{k+1}
+        QVector3D nk1squiggle = neighborhood.loop([&](int v) { return createExponentialMap(nk, normals[v]); });
 
-        // 5. Compute the dot product between n^k and n^k+1 to check if the stop criterion has been satisfied
-        // stopCriterion = QVector3D::dotProduct(nk, nk1);
+        // 4. Rotate n^k around n^k x \~{n}^{k+1} with angle ||nk+1squiggle|| to obtain n^{k+1}
+        float angle = nk1squiggle.length();
+        nk = rotateAroundAxis(nk, nk1squiggle, angle);
+        iterations++;
 
-        // Set the result
-        nk = nk1;
+        // 5. The angle between n^k and n^k+1 is the length of the average, stop once it is small enough
+        if (angle <= tolerance) {
+            break;
+        }
     }
 
     return nk;
 }
 
-QVector3D LoopSubdivisionShader::sphericalAveragingEdge(const HalfEdge& edge,
-                                                        QVector3D linearlyAveragedNormal,
-                                                        const QVector<QVector3D> normals) const {
-    int stopCriterion = 3;
-
-    // Set nk to the result from step 1., which is the same as the linear weighted average we have done before.
-    QVector3D nk = linearlyAveragedNormal;
-
-    for (int i = 0; i < stopCriterion; ++i) {
-        QVector3D nk1squiggle;
-
-        if (edge.isBoundaryEdge()) {
-            // 2.  Map all input normals orthogonally to a plane orthogonal to n^k
-            QVector3D n1squiggle = createExponentialMap(nk, normals[edge.origin->index]);
-            QVector3D n2squiggle = createExponentialMap(nk, normals[edge.next->origin->index]);
+/**
+ * @brief LoopSubdivisionShader::sphericalAveragingBatched Same as
+ * sphericalAveraging, but gathers the stencil into arrays once and uses the
+ * batched approximate kernels of sphericalkernels.h. Assumes unit normals.
+ */
+template <typename Neighborhood>
+QVector3D LoopSubdivisionShader::sphericalAveragingBatched(const Neighborhood& neighborhood,
+                                                           QVector3D nk,
+                                                           const QVector<QVector3D>& normals,
+                                                           int& iterations) const {
+    QVarLengthArray<int, 16> indices;
+    QVarLengthArray<float, 16> weights;
+    neighborhood.stencil(indices, weights);
+
+    int count = indices.size();
+    QVarLengthArray<float, 16> x(count);
+    QVarLengthArray<float, 16> y(count);
+    QVarLengthArray<float, 16> z(count);
+    for (int i = 0; i < count; ++i) {
+        const QVector3D& normal = normals[indices[i]];
+        x[i] = normal.x();
+        y[i] = normal.y();
+        z[i] = normal.z();
+    }
 
-            // 3. Perform linear combination in the exponential map to obtain \~{n}^{k+1}
-            nk1squiggle = n1squiggle / 2.0 + n2squiggle / 2.0;
-        } else {
-            // 2.  Map all input normals orthogonally to a plane orthogonal to n^k
-            QVector3D n1squiggle = createExponentialMap(nk, normals[edge.origin->index]);
-            QVector3D n2squiggle = createExponentialMap(nk, normals[edge.next->origin->index]);
-            QVector3D n3squiggle = createExponentialMap(nk, normals[edge.next->next->origin->index]);
-            QVector3D n4squiggle = createExponentialMap(nk, normals[edge.twin->next->next->origin->index]);
+    iterations = 0;
+    while (iterations < maxIterations) {
+        QVector3D nk1squiggle = exponentialMapAverage(nk, x.constData(), y.constData(), z.constData(),
+                                                      weights.constData(), count, accuracy);
+        float angle = nk1squiggle.length();
+        nk = exponentialMapInverse(nk, nk1squiggle, angle);
+        iterations++;
 
-            nk1squiggle = (6.0 * n1squiggle + 6.0 * n2squiggle + 2.0 * n3squiggle + 2.0 * n4squiggle) / 16.0;
+        if (angle <= tolerance) {
+            break;
         }
+    }
 
-        // 4. Rotate n^k around n^k x \~{n}^{k+1} with angle ||nk+1squiggle|| to obtain n^{k+1}
-        QVector3D nk1 = rotateAroundAxis(nk, nk1squiggle, nk1squiggle.length());
+    return nk;
+}
 
-        // 5. Compute the dot product between n^k and n^k+1 to check if the stop criterion has been satisfied
-        // stopCriterion = QVector3D::dotProduct(nk, nk1);
+QVector3D LoopSubdivisionShader::sphericalAveragingVertex(const VertexNeighborhood& neighborhood,
+                                                          QVector3D linearlyAveragedNormal,
+                                                          const QVector<QVector3D>& normals,
+                                                          int& iterations) const {
+    return sphericalAveraging(neighborhood, linearlyAveragedNormal, normals, iterations);
+}
 
-        // Set the result
-        nk = nk1;
-    }
+QVector3D LoopSubdivisionShader::sphericalAveragingEdge(const EdgeNeighborhood& neighborhood,
+                                                        QVector3D linearlyAveragedNormal,
+                                                        const QVector<QVector3D>& normals,
+                                                        int& iterations) const {
+    return sphericalAveraging(neighborhood, linearlyAveragedNormal, normals, iterations);
+}
 
-    return nk;
+QVector3D LoopSubdivisionShader::sphericalAveragingFace(const FaceNeighborhood& neighborhood,
+                                                        QVector3D linearlyAveragedNormal,
+                                                        const QVector<QVector3D>& normals,
+                                                        int& iterations) const {
+    return sphericalAveraging(neighborhood, linearlyAveragedNormal, normals, iterations);
 }
 
 /**
@@ -195,8 +143,8 @@ QVector3D LoopSubdivisionShader::createExponentialMap(QVector3D nk, QVector3D ni
     QVector3D projection = ni - QVector3D::dotProduct(ni, nk) * nk;
     projection.normalize();
 
-    // Find angle between n^k and n^i
-    float angle = acos(QVector3D::dotProduct(nk.normalized(), ni.normalized())); // 180.0f / M_PI * ... to convert to degrees
+    // Find angle between n^k and n^i, clamped since rounding can push the dot product outside [-1, 1]
+    float angle = acos(qBound(-1.0f, QVector3D::dotProduct(nk.normalized(), ni.normalized()), 1.0f)); // 180.0f / M_PI * ... to convert to degrees
 
     return angle * projection;
 }
@@ -1,23 +1,42 @@
 #ifndef LOOPSUBDIVISIONSHADER_H
 #define LOOPSUBDIVISIONSHADER_H
 
-#include "subdivisionshader.h"
+#include "subdivision/neighborhood.h"
+#include "subdivisionshadertypes.h"
 
-class LoopSubdivisionShader : public SubdivisionShader
+#include <QVector>
+#include <QVector3D>
+
+/**
+ * @brief The LoopSubdivisionShader class performs the spherical averaging of
+ * Subdivision Shading. The linear stencils are applied through LoopScheme and
+ * ButterflyScheme, see refineattribute.h.
+ */
+class LoopSubdivisionShader
 {
 public:
     LoopSubdivisionShader();
 
-    virtual void normalRefinement(Mesh& controlMesh, Mesh& newMesh) const;
-
-    virtual QVector3D vertexNormal(const Vertex& vertex, const QVector<QVector3D> normals) const;
-    virtual QVector3D edgeNormal(const HalfEdge& edge, const QVector<QVector3D> normals) const;
+    void setConvergence(float tolerance, int maxIterations);
+    void setAccuracy(SphericalAccuracy accuracy);
 
-    QVector3D sphericalAveragingVertex(const Vertex& vertex, QVector3D linearlyAveragedNormal, const QVector<QVector3D> normals) const;
-    QVector3D sphericalAveragingEdge(const HalfEdge& edge, QVector3D linearlyAveragedNormal, const QVector<QVector3D> normals) const;
+    QVector3D sphericalAveragingVertex(const VertexNeighborhood& neighborhood, QVector3D linearlyAveragedNormal, const QVector<QVector3D>& normals, int& iterations) const;
+    QVector3D sphericalAveragingEdge(const EdgeNeighborhood& neighborhood, QVector3D linearlyAveragedNormal, const QVector<QVector3D>& normals, int& iterations) const;
+    QVector3D sphericalAveragingFace(const FaceNeighborhood& neighborhood, QVector3D linearlyAveragedNormal, const QVector<QVector3D>& normals, int& iterations) const;
 
     QVector3D createExponentialMap(QVector3D nk, QVector3D ni) const;
     QVector3D rotateAroundAxis(QVector3D vector, QVector3D secondVector, float angle) const;
+
+private:
+    template <typename Neighborhood>
+    QVector3D sphericalAveraging(const Neighborhood& neighborhood, QVector3D linearlyAveragedNormal, const QVector<QVector3D>& normals, int& iterations) const;
+    template <typename Neighborhood>
+    QVector3D sphericalAveragingBatched(const Neighborhood& neighborhood, QVector3D nk, const QVector<QVector3D>& normals, int& iterations) const;
+
+    // Rotation angle (radians) below which an iteration counts as converged
+    float tolerance = 1e-4;
+    int maxIterations = 3;
+    SphericalAccuracy accuracy = SPHERICAL_EXACT;
 };
 
 #endif // LOOPSUBDIVISIONSHADER_H
@@ -0,0 +1,96 @@
+#include "sphericalkernels.h"
+
+#include <math.h>
+
+#include <QVarLengthArray>
+
+/**
+ * @brief approximateAcos Polynomial approximation of acos on [-1, 1]. Uses
+ * acos(x) = sqrt(1 - |x|) * p(|x|) and acos(-x) = pi - acos(x), written
+ * without branches so that it vectorizes.
+ * @param x The cosine, clamped to [-1, 1].
+ * @param accuracy SPHERICAL_FAST or SPHERICAL_FASTEST.
+ * @return The angle in radians.
+ */
+float approximateAcos(float x, SphericalAccuracy accuracy) {
+    x = fmaxf(-1.0f, fminf(x, 1.0f));
+    float a = fabsf(x);
+    float p;
+    if (accuracy == SPHERICAL_FASTEST) {
+        p = 1.5707288f + a * (-0.2121144f + a * (0.0742610f + a * -0.0187293f));
+    } else {
+        p = 1.5707963050f + a * (-0.2145988016f + a * (0.0889789874f + a * (-0.0501743046f +
+            a * (0.0308918810f + a * (-0.0170881256f + a * (0.0066700901f + a * -0.0012624911f))))));
+    }
+    float angle = sqrtf(1.0f - a) * p;
+    return x < 0.0f ? float(M_PI) - angle : angle;
+}
+
+/**
+ * @brief exponentialMapAverage Maps unit normals into the exponential map
+ * (tangent plane) of the unit normal n^k and returns their weighted sum. Since
+ * the mapped normal n^i is (theta / sin(theta)) * (n^i - cos(theta) n^k), the
+ * sum reduces to two weighted sums over the normals, without normalizing any
+ * projection.
+ * @param nk The unit normal whose tangent plane is mapped to.
+ * @param x X components of the unit normals.
+ * @param y Y components of the unit normals.
+ * @param z Z components of the unit normals.
+ * @param weights Stencil weights of the normals.
+ * @param count Number of normals.
+ * @param accuracy SPHERICAL_FAST or SPHERICAL_FASTEST.
+ * @return The weighted average in the tangent plane of n^k.
+ */
+QVector3D exponentialMapAverage(QVector3D nk, const float* x, const float* y,
+                                const float* z, const float* weights, int count,
+                                SphericalAccuracy accuracy) {
+    const float nx = nk.x();
+    const float ny = nk.y();
+    const float nz = nk.z();
+
+    QVarLengthArray<float, 16> cosine(count);
+    QVarLengthArray<float, 16> scale(count);
+    for (int i = 0; i < count; ++i) {
+        cosine[i] = fmaxf(-1.0f, fminf(nx * x[i] + ny * y[i] + nz * z[i], 1.0f));
+        float sine = sqrtf(fmaxf(1.0f - cosine[i] * cosine[i], 1e-12f));
+        scale[i] = weights[i] * approximateAcos(cosine[i], accuracy) / sine;
+    }
+
+    float sumX = 0.0f;
+    float sumY = 0.0f;
+    float sumZ = 0.0f;
+    float sumCos = 0.0f;
+    for (int i = 0; i < count; ++i) {
+        sumX += scale[i] * x[i];
+        sumY += scale[i] * y[i];
+        sumZ += scale[i] * z[i];
+        sumCos += scale[i] * cosine[i];
+    }
+
+    return QVector3D(sumX, sumY, sumZ) - sumCos * nk;
+}
+
+/**
+ * @brief exponentialMapInverse Rotates n^k around n^k x tangent by the
+ * provided angle. Since the tangent is orthogonal to n^k, Rodrigues' formula
+ * reduces to cos(angle) n^k + (sin(angle) / angle) tangent, which needs no
+ * cross product and no normalization. Small angles use truncated Taylor
+ * series, whose error is below 1.1e-7 for angles up to 0.5 rad.
+ * @param nk The unit normal to rotate.
+ * @param tangent Vector in the tangent plane of n^k.
+ * @param angle Length of the tangent.
+ * @return The rotated unit normal.
+ */
+QVector3D exponentialMapInverse(QVector3D nk, QVector3D tangent, float angle) {
+    float cosine;
+    float sinc;
+    if (angle < 0.5f) {
+        float a2 = angle * angle;
+        cosine = 1.0f + a2 * (-1.0f / 2.0f + a2 * (1.0f / 24.0f + a2 * (-1.0f / 720.0f)));
+        sinc = 1.0f + a2 * (-1.0f / 6.0f + a2 * (1.0f / 120.0f + a2 * (-1.0f / 5040.0f)));
+    } else {
+        cosine = cosf(angle);
+        sinc = sinf(angle) / angle;
+    }
+    return cosine * nk + sinc * tangent;
+}
@@ -0,0 +1,30 @@
+#ifndef SPHERICALKERNELS_H
+#define SPHERICALKERNELS_H
+
+#include <QVector3D>
+
+#include "subdivisionshadertypes.h"
+
+/**
+ * Kernels for the spherical averaging of unit normals. Instead of mapping one
+ * normal at a time, the exponential map is evaluated for the whole stencil at
+ * once on structure-of-arrays input, without branches in the inner loop, so
+ * the compiler can vectorize it.
+ *
+ * Error bounds (in radians, on top of single precision rounding):
+ *  - SPHERICAL_FAST: acos is approximated to within 2e-8 (Abramowitz & Stegun
+ *    4.4.46), cos and sin(x)/x to within 1.1e-7 for rotations below 0.5 rad.
+ *  - SPHERICAL_FASTEST: acos is approximated to within 6.7e-5 (Abramowitz &
+ *    Stegun 4.4.45), the rotation as for SPHERICAL_FAST.
+ * Larger rotations fall back to the standard library.
+ */
+
+float approximateAcos(float x, SphericalAccuracy accuracy);
+
+QVector3D exponentialMapAverage(QVector3D nk, const float* x, const float* y,
+                                const float* z, const float* weights, int count,
+                                SphericalAccuracy accuracy);
+
+QVector3D exponentialMapInverse(QVector3D nk, QVector3D tangent, float angle);
+
+#endif  // SPHERICALKERNELS_H
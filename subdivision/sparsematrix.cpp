@@ -0,0 +1,48 @@
+#include "sparsematrix.h"
+
+#include <algorithm>
+
+/**
+ * @brief SparseMatrix::SparseMatrix Creates an empty matrix.
+ */
+SparseMatrix::SparseMatrix() : cols(0) { offsets.fill(0, 1); }
+
+/**
+ * @brief SparseMatrix::multiply Multiplies this matrix by the provided one.
+ * Row r of the product combines the rows of right that row r of this matrix
+ * refers to; its entries are sorted by column, with the weights of equal
+ * columns added up.
+ * @param right The matrix to multiply by, with numRows() equal to numCols().
+ * @return The product, with the columns of right.
+ */
+SparseMatrix SparseMatrix::multiply(const SparseMatrix& right) const {
+    const int* leftOffsets = offsets.constData();
+    const int* leftIndices = indices.constData();
+    const float* leftWeights = weights.constData();
+    const int* rightOffsets = right.offsets.constData();
+    const int* rightIndices = right.indices.constData();
+    const float* rightWeights = right.weights.constData();
+
+    SparseMatrix product;
+    product.build(numRows(), right.numCols(), [&](int row, Row& entries) {
+        for (int j = leftOffsets[row]; j < leftOffsets[row + 1]; ++j) {
+            int s = leftIndices[j];
+            for (int i = rightOffsets[s]; i < rightOffsets[s + 1]; ++i) {
+                entries.append(qMakePair(rightIndices[i], leftWeights[j] * rightWeights[i]));
+            }
+        }
+        std::sort(entries.begin(), entries.end(),
+                  [](const QPair<int, float>& a, const QPair<int, float>& b) { return a.first < b.first; });
+
+        int merged = 0;
+        for (int i = 0; i < entries.size(); ++i) {
+            if (merged > 0 && entries[merged - 1].first == entries[i].first) {
+                entries[merged - 1].second += entries[i].second;
+            } else {
+                entries[merged++] = entries[i];
+            }
+        }
+        entries.resize(merged);
+    });
+    return product;
+}
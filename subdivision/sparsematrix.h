@@ -0,0 +1,131 @@
+#ifndef SPARSE_MATRIX_H
+#define SPARSE_MATRIX_H
+
+#include <QPair>
+#include <QVarLengthArray>
+#include <QVector>
+
+#include <numeric>
+
+/**
+ * @brief The SparseMatrix class holds subdivision weights as a sparse matrix
+ * in CSR form. Row r holds the weights with which value r of the result
+ * combines the input values: entries [offsets[r], offsets[r + 1]) of indices
+ * and weights.
+ */
+class SparseMatrix {
+public:
+    SparseMatrix();
+
+    inline int numRows() const { return offsets.size() - 1; }
+    inline int numCols() const { return cols; }
+    inline int numNonZeros() const { return indices.size(); }
+
+    SparseMatrix multiply(const SparseMatrix& right) const;
+
+    /**
+     * @brief apply Evaluates every row of the matrix.
+     * @param values One value per column.
+     * @param result Receives numRows() values.
+     */
+    template <typename T>
+    void apply(const QVector<T>& values, T* result) const {
+        const T* data = values.constData();
+        const int* rowOffsets = offsets.constData();
+        const int* rowIndices = indices.constData();
+        const float* rowWeights = weights.constData();
+
+        #pragma omp parallel for
+        for (int v = 0; v < numRows(); ++v) {
+            T value = T();
+            for (int i = rowOffsets[v]; i < rowOffsets[v + 1]; ++i) {
+                value += rowWeights[i] * data[rowIndices[i]];
+            }
+            result[v] = value;
+        }
+    }
+
+    /**
+     * @brief apply Evaluates every row of the matrix for several inputs at
+     * once, so that every row is read once for all of them.
+     * @param inputs For every input, one value per column.
+     * @param results Receives, for every input, numRows() values.
+     */
+    template <typename T>
+    void apply(const QVector<QVector<T>>& inputs, QVector<QVector<T>>& results) const {
+        int numInputs = inputs.size();
+        QVector<const T*> data(numInputs);
+        QVector<T*> resultData(numInputs);
+        results.resize(numInputs);
+        for (int p = 0; p < numInputs; ++p) {
+            results[p].resize(numRows());
+            data[p] = inputs[p].constData();
+            resultData[p] = results[p].data();
+        }
+        const int* rowOffsets = offsets.constData();
+        const int* rowIndices = indices.constData();
+        const float* rowWeights = weights.constData();
+
+        #pragma omp parallel for
+        for (int v = 0; v < numRows(); ++v) {
+            for (int p = 0; p < numInputs; ++p) {
+                T value = T();
+                for (int i = rowOffsets[v]; i < rowOffsets[v + 1]; ++i) {
+                    value += rowWeights[i] * data[p][rowIndices[i]];
+                }
+                resultData[p][v] = value;
+            }
+        }
+    }
+
+    QVector<int> offsets;
+    QVector<int> indices;
+    QVector<float> weights;
+
+protected:
+    typedef QVarLengthArray<QPair<int, float>, 64> Row;
+
+    /**
+     * @brief build Fills the matrix row by row, in parallel. Every row is
+     * gathered twice: the first pass sizes the rows, the second fills them,
+     * so that no row is stored twice.
+     * @param rows The number of rows.
+     * @param columns The number of columns.
+     * @param gatherRow Called as gatherRow(row, entries), appends the column
+     * index and weight of every entry of the row to entries.
+     */
+    template <typename GatherRow>
+    void build(int rows, int columns, GatherRow gatherRow) {
+        cols = columns;
+        offsets.resize(rows + 1);
+        int* offsetData = offsets.data();
+        offsetData[0] = 0;
+
+        #pragma omp parallel for
+        for (int row = 0; row < rows; row++) {
+            Row entries;
+            gatherRow(row, entries);
+            offsetData[row + 1] = entries.size();
+        }
+
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        indices.resize(offsetData[rows]);
+        weights.resize(offsetData[rows]);
+        int* indexData = indices.data();
+        float* weightData = weights.data();
+
+        #pragma omp parallel for
+        for (int row = 0; row < rows; row++) {
+            Row entries;
+            gatherRow(row, entries);
+            for (int i = 0; i < entries.size(); ++i) {
+                indexData[offsetData[row] + i] = entries[i].first;
+                weightData[offsetData[row] + i] = entries[i].second;
+            }
+        }
+    }
+
+    int cols;
+};
+
+#endif  // SPARSE_MATRIX_H
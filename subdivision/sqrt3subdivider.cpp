@@ -0,0 +1,500 @@
+#include "sqrt3subdivider.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <numeric>
+
+#include <QVarLengthArray>
+
+#include "refineattribute.h"
+
+/**
+ * @brief Sqrt3Subdivider::Sqrt3Subdivider Creates a new empty sqrt(3)
+ * subdivider.
+ */
+Sqrt3Subdivider::Sqrt3Subdivider() {}
+
+/**
+ * @brief Sqrt3Subdivider::subdivide Subdivides the provided control mesh and
+ * returns the subdivided mesh. Performs just a single subdivision step, which
+ * turns every half-edge of the control mesh into a face.
+ * @param controlMesh The mesh to be subdivided.
+ * @param attributes The RefinementAttribute flags to produce on top of the
+ * geometry. Attributes that are left out can be added later with
+ * refineAttributes.
+ * @return The mesh resulting of applying a single subdivision step on the
+ * control mesh.
+ */
+Mesh Sqrt3Subdivider::subdivide(Mesh& controlMesh, int attributes) const {
+    Mesh newMesh;
+    reserveSizes(controlMesh, newMesh);
+    levelRefinement(controlMesh, newMesh, attributes | REFINE_GEOMETRY);
+    topologyRefinement(controlMesh, newMesh);
+
+    return newMesh;
+}
+
+/**
+ * @brief Sqrt3Subdivider::refineAttributes Refines shading attributes that were
+ * not produced when newMesh was subdivided from controlMesh. The topology and
+ * geometry of newMesh are left untouched.
+ * @param controlMesh The mesh newMesh was subdivided from. Must already have
+ * the requested attributes.
+ * @param newMesh The subdivided mesh.
+ * @param attributes The RefinementAttribute flags to produce.
+ */
+void Sqrt3Subdivider::refineAttributes(Mesh& controlMesh, Mesh& newMesh,
+                                       int attributes) const {
+    levelRefinement(controlMesh, newMesh, attributes & ~REFINE_GEOMETRY);
+}
+
+/**
+ * @brief sqrt3Alpha The relaxation weight of a vertex of valence n,
+ * alpha = (4 - 2 cos(2 pi / n)) / 9.
+ */
+static float sqrt3Alpha(int valence) {
+    return (4.0 - 2.0 * cosf(2.0 * M_PI / valence)) / 9.0;
+}
+
+/**
+ * @brief Sqrt3Subdivider::evaluateLimit Evaluates the positions and normals of
+ * the limit surface at the vertices of the provided mesh, in a single pass
+ * over their one-rings. An interior vertex and the average of its ring are
+ * mapped to the vertex point and the average of the ring of face points by a
+ * 2x2 matrix, whose left eigenvector for the eigenvalue 1 gives the limit
+ * position: the ring weighs beta = 3 alpha / (1 + 3 alpha) and the centre
+ * 1 - beta. The face points around a vertex are a rotated copy of its ring,
+ * so the tangents weigh ring vertex i with cos(2 pi i / n) and sin(2 pi i / n)
+ * as for Loop's scheme. Boundary vertices never move, their normal is the sum
+ * of the normals of the faces around them. The mesh itself is left untouched.
+ * @param mesh The mesh to evaluate, of any level.
+ */
+void Sqrt3Subdivider::evaluateLimit(Mesh& mesh) const {
+    const QVector<Vertex>& vertices = mesh.vertices;
+    int numVerts = mesh.numVerts();
+    // Unvalidated meshes may have rings that do not close
+    int maxSteps = mesh.numHalfEdges();
+
+    mesh.limitCoords.resize(numVerts);
+    mesh.limitNormals.resize(numVerts);
+    QVector3D* limitCoords = mesh.limitCoords.data();
+    QVector3D* limitNormals = mesh.limitNormals.data();
+
+    #pragma omp parallel for
+    for (int v = 0; v < numVerts; v++) {
+        const Vertex& vertex = vertices[v];
+        limitCoords[v] = vertex.coords;
+        limitNormals[v] = QVector3D();
+        if (vertex.out == nullptr) {
+            continue;
+        }
+
+        // Starts at the outgoing boundary half-edge, if any, so that the ring
+        // is counterclockwise
+        QVarLengthArray<HalfEdge*, 16> outgoing;
+        vertex.outgoingHalfEdges(outgoing, maxSteps);
+        bool boundary = outgoing[0]->twin == nullptr;
+
+        QVarLengthArray<QVector3D, 16> ring;
+        for (int i = 0; i < outgoing.size(); ++i) {
+            ring.append(outgoing[i]->next->origin->coords);
+        }
+
+        if (boundary) {
+            ring.append(outgoing[outgoing.size() - 1]->prev->origin->coords);
+            QVector3D normal;
+            for (int i = 0; i + 1 < ring.size(); ++i) {
+                normal += QVector3D::crossProduct(ring[i] - vertex.coords, ring[i + 1] - vertex.coords);
+            }
+            limitNormals[v] = normal.normalized();
+            continue;
+        }
+
+        int valence = ring.size();
+        float alpha = sqrt3Alpha(valence);
+        float beta = 3.0 * alpha / (1.0 + 3.0 * alpha);
+
+        QVector3D sum;
+        QVector3D tangent1;
+        QVector3D tangent2;
+        for (int i = 0; i < valence; ++i) {
+            float angle = 2.0 * M_PI * i / valence;
+            sum += ring[i];
+            tangent1 += cosf(angle) * ring[i];
+            tangent2 += sinf(angle) * ring[i];
+        }
+        limitCoords[v] = (1.0 - beta) * vertex.coords + beta / valence * sum;
+        limitNormals[v] = QVector3D::crossProduct(tangent1, tangent2).normalized();
+    }
+
+    mesh.limitDirty = false;
+}
+
+/**
+ * @brief Sqrt3Subdivider::setSphericalConvergence Configures the early exit of
+ * the spherical averaging of the SPHERICAL normals.
+ * @param tolerance Rotation angle in radians below which the averaging of a
+ * vertex counts as converged.
+ * @param maxIterations Maximum number of iterations per vertex.
+ */
+void Sqrt3Subdivider::setSphericalConvergence(float tolerance, int maxIterations) {
+    subdivisionShader.setConvergence(tolerance, maxIterations);
+}
+
+/**
+ * @brief Sqrt3Subdivider::setSphericalAccuracy Selects exact or approximate
+ * kernels for the spherical averaging of the SPHERICAL normals.
+ * @param accuracy The accuracy, see sphericalkernels.h for the error bounds.
+ */
+void Sqrt3Subdivider::setSphericalAccuracy(SphericalAccuracy accuracy) {
+    subdivisionShader.setAccuracy(accuracy);
+}
+
+/**
+ * @brief Sqrt3Subdivider::reserveSizes Resizes the vertex, half-edge and face
+ * vectors. Also recalculates the edge count: every face adds the three edges
+ * from its face point to its corners, every old edge is either flipped or, on
+ * the boundary, kept.
+ * @param controlMesh The control mesh.
+ * @param newMesh The new mesh. At this point, the mesh is fully empty.
+ */
+void Sqrt3Subdivider::reserveSizes(Mesh& controlMesh, Mesh& newMesh) const {
+    int newNumEdges = controlMesh.numEdges() + 3 * controlMesh.numFaces();
+    int newNumFaces = controlMesh.numHalfEdges();
+    int newNumHalfEdges = 3 * newNumFaces;
+    int newNumVerts = controlMesh.numVerts() + controlMesh.numFaces();
+
+    newMesh.getVertices().resize(newNumVerts);
+    newMesh.getHalfEdges().resize(newNumHalfEdges);
+    newMesh.getFaces().resize(newNumFaces);
+
+    newMesh.edgeCount = newNumEdges;
+}
+
+/**
+ * @brief Sqrt3Subdivider::levelRefinement Performs the geometry refinement and
+ * the refinement of the requested shading attributes in a single pass over
+ * the vertices and a single pass over the faces of the control mesh. The
+ * LINEAR and SPHERICAL normals and the custom vertex attributes follow the
+ * approximating stencils, the BUTTERFLY normals the interpolating sqrt(3)
+ * scheme.
+ * @param controlMesh The control mesh.
+ * @param newMesh The new mesh. At the start of this function, the only
+ * guarantee you have of this newMesh is that the vertex, half-edge and face
+ * vectors have the correct sizes.
+ * @param attributes The RefinementAttribute flags to produce.
+ */
+void Sqrt3Subdivider::levelRefinement(Mesh& controlMesh, Mesh& newMesh,
+                                      int attributes) const {
+    const QVector<Vertex>& vertices = controlMesh.vertices;
+    const QVector<Face>& faces = controlMesh.faces;
+
+    bool geometry = attributes & REFINE_GEOMETRY;
+    bool linear = attributes & REFINE_LINEAR;
+    bool spherical = attributes & REFINE_SPHERICAL;
+    bool butterfly = attributes & REFINE_BUTTERFLY;
+    bool blend = attributes & REFINE_BLEND_WEIGHTS;
+    // Meshes that did not pass MeshValidator get bounded ring walks
+    bool checked = !controlMesh.validated;
+
+    // Only touch the arrays that are requested, so that they are not allocated
+    // for attributes that are never shown.
+    QVector<QVector3D> empty;
+    const QVector<QVector3D>& linearNormals = linear ? controlMesh.getVertexSubdivNormals(LINEAR) : empty;
+    const QVector<QVector3D>& sphericalNormals = spherical ? controlMesh.getVertexSubdivNormals(SPHERICAL) : empty;
+    const QVector<QVector3D>& butterflyNormals = butterfly ? controlMesh.getVertexSubdivNormals(BUTTERFLY) : empty;
+
+    QVector<QVector3D>& newLinearNormals = linear ? newMesh.getVertexSubdivNormals(LINEAR) : empty;
+    QVector<QVector3D>& newSphericalNormals = spherical ? newMesh.getVertexSubdivNormals(SPHERICAL) : empty;
+    QVector<QVector3D>& newButterflyNormals = butterfly ? newMesh.getVertexSubdivNormals(BUTTERFLY) : empty;
+
+    int newNumVerts = newMesh.numVerts();
+    if (linear) newLinearNormals.resize(newNumVerts);
+    if (spherical) {
+        newSphericalNormals.resize(newNumVerts);
+        newMesh.sphericalIterations.resize(newNumVerts);
+    }
+    if (butterfly) newButterflyNormals.resize(newNumVerts);
+
+    Vertex* newVertices = newMesh.vertices.data();
+    QVector3D* newLinear = newLinearNormals.data();
+    QVector3D* newSpherical = newSphericalNormals.data();
+    QVector3D* newButterfly = newButterflyNormals.data();
+    int* sphericalIterations = newMesh.sphericalIterations.data();
+
+    auto coords = [&](int v) { return vertices[v].coords; };
+    auto fetch = [](const auto& values) {
+        return [&values](int v) { return values[v]; };
+    };
+
+    // Custom attributes are refined with the approximating stencils as well
+    QVector<const VertexAttribute*> custom;
+    QVector<float*> newCustom;
+    if (attributes & REFINE_CUSTOM) {
+        QMap<QString, VertexAttribute>& controlAttributes = controlMesh.getVertexAttributes();
+        for (const QString& name : controlAttributes.keys()) {
+            const VertexAttribute* attribute = &controlAttributes[name];
+            VertexAttribute* newAttribute = &newMesh.getVertexAttributes()[name];
+            newAttribute->channels = attribute->channels;
+            newAttribute->values.resize(newNumVerts * attribute->channels);
+            custom.append(attribute);
+            newCustom.append(newAttribute->values.data());
+        }
+    }
+
+    // Vertex points
+    #pragma omp parallel for
+    for (int v = 0; v < controlMesh.numVerts(); v++) {
+        VertexNeighborhood neighborhood(vertices[v], checked);
+        neighborhood.useSqrt3Weights();
+
+        if (geometry) {
+            Vertex* vertPoint = &newVertices[v];
+            vertPoint->coords = Sqrt3Scheme::vertex(neighborhood, coords);
+            // Boundary vertices gain the face point of the face of their
+            // incoming boundary half-edge
+            vertPoint->valence = vertices[v].valence + (neighborhood.boundary ? 1 : 0);
+            vertPoint->index = v;
+        }
+
+        if (linear) {
+            newLinear[v] = Sqrt3Scheme::vertex(neighborhood, fetch(linearNormals)).normalized();
+        }
+        if (spherical) {
+            QVector3D sphericalNormal = Sqrt3Scheme::vertex(neighborhood, fetch(sphericalNormals)).normalized();
+            newSpherical[v] = subdivisionShader.sphericalAveragingVertex(neighborhood, sphericalNormal, sphericalNormals,
+                                                                         sphericalIterations[v]);
+        }
+        if (butterfly) {
+            newButterfly[v] = InterpolatingSqrt3Scheme::vertex(neighborhood, fetch(butterflyNormals)).normalized();
+        }
+        for (int a = 0; a < custom.size(); ++a) {
+            int channels = custom[a]->channels;
+            refineVertexChannels<float, Sqrt3Scheme>(neighborhood, custom[a]->values.constData(), channels,
+                                                     newCustom[a] + v * channels);
+        }
+    }
+
+    // Face points
+    #pragma omp parallel for
+    for (int f = 0; f < controlMesh.numFaces(); f++) {
+        FaceNeighborhood neighborhood(faces[f]);
+        int v = controlMesh.numVerts() + f;
+
+        if (geometry) {
+            Vertex* facePoint = &newVertices[v];
+            facePoint->coords = Sqrt3Scheme::face(neighborhood, coords);
+            // The corners, and the face points across the flipped edges
+            facePoint->valence = 3;
+            for (int i = 3; i < 6; ++i) {
+                facePoint->valence += neighborhood.points[i] >= 0 ? 1 : 0;
+            }
+            facePoint->index = v;
+        }
+
+        if (linear) {
+            newLinear[v] = Sqrt3Scheme::face(neighborhood, fetch(linearNormals)).normalized();
+        }
+        if (spherical) {
+            QVector3D sphericalNormal = Sqrt3Scheme::face(neighborhood, fetch(sphericalNormals)).normalized();
+            newSpherical[v] = subdivisionShader.sphericalAveragingFace(neighborhood, sphericalNormal, sphericalNormals,
+                                                                       sphericalIterations[v]);
+        }
+        if (butterfly) {
+            newButterfly[v] = InterpolatingSqrt3Scheme::face(neighborhood, fetch(butterflyNormals)).normalized();
+        }
+        for (int a = 0; a < custom.size(); ++a) {
+            int channels = custom[a]->channels;
+            refineFaceChannels<float, Sqrt3Scheme>(neighborhood, custom[a]->values.constData(), channels,
+                                                   newCustom[a] + v * channels);
+        }
+    }
+
+    if (blend) {
+        refineBlendWeights(controlMesh, newMesh);
+    }
+
+    newMesh.refinedAttributes |= attributes;
+    newMesh.invalidateBlendedNormals(attributes);
+}
+
+/**
+ * @brief Sqrt3Subdivider::refineBlendWeights Refines the sparse blend weights.
+ * A vertex point can only get a non-zero weight if it belongs to the support
+ * or neighbours it, a face point if its face touches the support. Only those
+ * points are evaluated, so the cost scales with the size of the support rather
+ * than the size of the mesh.
+ * @param controlMesh The control mesh.
+ * @param newMesh The new mesh.
+ */
+void Sqrt3Subdivider::refineBlendWeights(Mesh& controlMesh, Mesh& newMesh) const {
+    const SparseVertexWeights& weights = controlMesh.getSparseBlendWeights();
+    const QVector<Vertex>& vertices = controlMesh.vertices;
+    const QVector<Face>& faces = controlMesh.faces;
+    bool checked = !controlMesh.validated;
+
+    QVector<int> vertexCandidates;
+    QVector<int> faceCandidates;
+
+    // The walks over the rings of the support are only safe on validated
+    // meshes, other meshes evaluate every point instead
+    if (checked) {
+        vertexCandidates.resize(controlMesh.numVerts());
+        std::iota(vertexCandidates.begin(), vertexCandidates.end(), 0);
+        faceCandidates.resize(controlMesh.numFaces());
+        std::iota(faceCandidates.begin(), faceCandidates.end(), 0);
+    } else {
+        for (int s : weights.indices) {
+            const Vertex& vertex = vertices[s];
+            bool boundary = vertex.isBoundaryVertex();
+            vertexCandidates.append(s);
+
+            HalfEdge* start = boundary ? vertex.nextBoundaryHalfEdge() : vertex.out;
+            HalfEdge* edge = start;
+            do {
+                vertexCandidates.append(edge->next->origin->index);
+                faceCandidates.append(edge->faceIdx());
+                edge = edge->prev->twin;
+            } while (edge != nullptr && edge != start);
+
+            if (boundary) {
+                vertexCandidates.append(vertex.prevBoundaryHalfEdge()->origin->index);
+            }
+        }
+    }
+
+    std::sort(vertexCandidates.begin(), vertexCandidates.end());
+    vertexCandidates.erase(std::unique(vertexCandidates.begin(), vertexCandidates.end()), vertexCandidates.end());
+    std::sort(faceCandidates.begin(), faceCandidates.end());
+    faceCandidates.erase(std::unique(faceCandidates.begin(), faceCandidates.end()), faceCandidates.end());
+
+    // Vertex points precede face points, so the candidates are in order
+    int numVertexCandidates = vertexCandidates.size();
+    int numCandidates = numVertexCandidates + faceCandidates.size();
+    QVector<int> indices(numCandidates);
+    QVector<float> values(numCandidates);
+    int* indexData = indices.data();
+    float* valueData = values.data();
+    auto fetch = [&weights](int v) { return weights.weight(v); };
+
+    #pragma omp parallel for
+    for (int i = 0; i < numCandidates; i++) {
+        if (i < numVertexCandidates) {
+            int v = vertexCandidates[i];
+            VertexNeighborhood neighborhood(vertices[v], checked);
+            neighborhood.useSqrt3Weights();
+            indexData[i] = v;
+            valueData[i] = Sqrt3Scheme::vertex(neighborhood, fetch);
+        } else {
+            int f = faceCandidates[i - numVertexCandidates];
+            indexData[i] = controlMesh.numVerts() + f;
+            valueData[i] = Sqrt3Scheme::face(FaceNeighborhood(faces[f]), fetch);
+        }
+    }
+
+    SparseVertexWeights newWeights;
+    for (int i = 0; i < numCandidates; i++) {
+        if (values[i] != 0.0f) {
+            newWeights.indices.append(indices[i]);
+            newWeights.values.append(values[i]);
+        }
+    }
+    newMesh.setSparseBlendWeights(newWeights);
+}
+
+/**
+ * @brief Sqrt3Subdivider::topologyRefinement Performs the topology refinement.
+ * Half-edge h from a to b in face f becomes face h. If h has a twin in face g,
+ * the edge is flipped and the face is (a, q_g, q_f), with q the face points;
+ * on the boundary the edge is kept and the face is (a, b, q_f). Every
+ * half-edge of the new mesh then finds its twin through the neighbours of h
+ * in the control mesh.
+ * @param controlMesh The control mesh.
+ * @param newMesh The new mesh.
+ */
+void Sqrt3Subdivider::topologyRefinement(Mesh& controlMesh,
+                                         Mesh& newMesh) const {
+    const QVector<Vertex>& vertices = controlMesh.vertices;
+    const QVector<HalfEdge>& halfEdges = controlMesh.halfEdges;
+    Vertex* newVertices = newMesh.vertices.data();
+    HalfEdge* newHalfEdges = newMesh.halfEdges.data();
+    Face* newFaces = newMesh.faces.data();
+    int numVerts = controlMesh.numVerts();
+    int numEdges = controlMesh.numEdges();
+
+    #pragma omp parallel for
+    for (int f = 0; f < newMesh.numFaces(); ++f) {
+        newFaces[f].index = f;
+        // sqrt(3) subdivision generates only triangles
+        newFaces[f].valence = 3;
+        newFaces[f].side = &newHalfEdges[3 * f + 2];
+    }
+
+    #pragma omp parallel for
+    for (int h = 0; h < controlMesh.numHalfEdges(); ++h) {
+        const HalfEdge* edge = &halfEdges[h];
+        const HalfEdge* prev = edge->prev;
+
+        int h1 = 3 * h;
+        int h2 = 3 * h + 1;
+        int h3 = 3 * h + 2;
+
+        // The edge from the face point back to a, shared with the face of
+        // the half-edge that enters a in the same control face
+        int vertIdx3 = numVerts + edge->faceIdx();
+        int edgeIdx3 = numEdges + h;
+        int twinIdx3 = prev->twin == nullptr ? 3 * prev->index + 1 : 3 * prev->twin->index;
+        setHalfEdgeData(newMesh, h3, edgeIdx3, vertIdx3, twinIdx3);
+
+        if (edge->twin == nullptr) {
+            setHalfEdgeData(newMesh, h1, edge->edgeIndex, edge->origin->index, -1);
+            setHalfEdgeData(newMesh, h2, numEdges + edge->next->index, edge->next->origin->index,
+                            3 * edge->next->index + 2);
+        } else {
+            const HalfEdge* twinNext = edge->twin->next;
+            setHalfEdgeData(newMesh, h1, numEdges + twinNext->index, edge->origin->index, 3 * twinNext->index + 2);
+            setHalfEdgeData(newMesh, h2, edge->edgeIndex, numVerts + edge->twin->faceIdx(), 3 * edge->twin->index + 1);
+        }
+    }
+
+    // Outgoing half-edges: the first half-edge of the face of the old
+    // outgoing half-edge for vertex points, the half-edge towards the first
+    // corner for face points.
+    #pragma omp parallel for
+    for (int v = 0; v < controlMesh.numVerts(); ++v) {
+        HalfEdge* out = vertices[v].out;
+        newVertices[v].out = out == nullptr ? nullptr : &newHalfEdges[3 * out->index];
+        newVertices[v].index = v;
+    }
+    #pragma omp parallel for
+    for (int f = 0; f < controlMesh.numFaces(); ++f) {
+        int v = numVerts + f;
+        newVertices[v].out = &newHalfEdges[3 * (3 * f) + 2];
+        newVertices[v].index = v;
+    }
+}
+
+/**
+ * @brief Sqrt3Subdivider::setHalfEdgeData Sets the data of a single half-edge.
+ * Only writes to the half-edge itself, so that half-edges can be set in
+ * parallel.
+ * @param newMesh The new mesh this half-edge will live in.
+ * @param h Index of the half-edge.
+ * @param edgeIdx Index of the (undirected) edge this half-edge will belong to.
+ * @param vertIdx Index of the vertex that this half-edge will originate from.
+ * @param twinIdx Index of the twin of this half-edge. -1 if the half-edge lies
+ * on a boundary.
+ */
+void Sqrt3Subdivider::setHalfEdgeData(Mesh& newMesh, int h, int edgeIdx,
+                                      int vertIdx, int twinIdx) const {
+    HalfEdge* halfEdge = &newMesh.halfEdges[h];
+
+    halfEdge->edgeIndex = edgeIdx;
+    halfEdge->index = h;
+    halfEdge->origin = &newMesh.vertices[vertIdx];
+    halfEdge->face = &newMesh.faces[halfEdge->faceIdx()];
+    halfEdge->next = &newMesh.halfEdges[halfEdge->nextIdx()];
+    halfEdge->prev = &newMesh.halfEdges[halfEdge->prevIdx()];
+    halfEdge->twin = twinIdx < 0 ? nullptr : &newMesh.halfEdges[twinIdx];
+}
@@ -0,0 +1,41 @@
+#ifndef SQRT3_SUBDIVIDER_H
+#define SQRT3_SUBDIVIDER_H
+
+#include "mesh/mesh.h"
+#include "subdivider.h"
+#include "subdivision/shading/loopsubdivisionshader.h"
+
+/**
+ * @brief The Sqrt3Subdivider class is a subdivider class that performs sqrt(3)
+ * subdivision (Kobbelt 2000) on triangle meshes. Every step inserts a vertex
+ * at the centroid of every face, relaxes the old vertices and flips the old
+ * edges, so that the number of faces triples instead of quadrupling as with
+ * Loop subdivision. Boundary edges are not flipped and boundary vertices keep
+ * their position, so that every step triples the faces of open meshes as well.
+ *
+ * Half-edge h of the control mesh becomes face h of the subdivided mesh, the
+ * vertex points come first, followed by one face point per face.
+ */
+class Sqrt3Subdivider : public Subdivider {
+public:
+    Sqrt3Subdivider();
+    Mesh subdivide(Mesh& controlMesh, int attributes = REFINE_ALL) const override;
+    void refineAttributes(Mesh& controlMesh, Mesh& newMesh, int attributes) const override;
+    void evaluateLimit(Mesh& mesh) const override;
+
+    void setSphericalConvergence(float tolerance, int maxIterations);
+    void setSphericalAccuracy(SphericalAccuracy accuracy);
+
+private:
+    LoopSubdivisionShader subdivisionShader;
+
+    void reserveSizes(Mesh& controlMesh, Mesh& newMesh) const;
+    void levelRefinement(Mesh& controlMesh, Mesh& newMesh, int attributes) const;
+    void refineBlendWeights(Mesh& controlMesh, Mesh& newMesh) const;
+    void topologyRefinement(Mesh& controlMesh, Mesh& newMesh) const;
+
+    void setHalfEdgeData(Mesh& newMesh, int h, int edgeIdx, int vertIdx,
+                         int twinIdx) const;
+};
+
+#endif  // SQRT3_SUBDIVIDER_H
@@ -10,7 +10,10 @@
 class Subdivider {
  public:
   virtual ~Subdivider();
-  virtual Mesh subdivide(Mesh& mesh) const = 0;
+  virtual Mesh subdivide(Mesh& mesh, int attributes) const = 0;
+  virtual void refineAttributes(Mesh& controlMesh, Mesh& newMesh,
+                                int attributes) const = 0;
+  virtual void evaluateLimit(Mesh& mesh) const = 0;
 };
 
 #endif  // SUBDIVIDER_H
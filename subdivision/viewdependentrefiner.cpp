@@ -0,0 +1,404 @@
+#include "viewdependentrefiner.h"
+
+#include <math.h>
+
+#include <limits>
+
+#include <QVector4D>
+
+#include "adaptiveloopsubdivider.h"
+#include "initialization/meshinitializer.h"
+#include "loopsubdivider.h"
+
+// Bound on the ring walks, for base meshes with broken connectivity
+static const int maxRingSteps = 1024;
+
+/**
+ * @brief supportedLevel Limits the level so that the half-edges of the
+ * uniformly subdivided level can still be indexed.
+ * @param baseMesh The base mesh.
+ * @param maxLevel The requested maximum level.
+ * @return The largest level up to maxLevel whose indices fit in an int.
+ */
+static int supportedLevel(Mesh& baseMesh, int maxLevel) {
+    double halfEdges = baseMesh.numHalfEdges();
+    int level = 0;
+    while (level < maxLevel && 4.0 * halfEdges < std::numeric_limits<int>::max()) {
+        halfEdges *= 4.0;
+        ++level;
+    }
+    return level;
+}
+
+/**
+ * @brief ViewDependentRefiner::ViewDependentRefiner Prepares the view-dependent
+ * refinement of the provided mesh. Nothing is refined until the first update.
+ * @param baseMesh The triangle mesh to refine.
+ * @param maxLevel The level the finest faces are refined to.
+ */
+ViewDependentRefiner::ViewDependentRefiner(Mesh& baseMesh, int maxLevel)
+    : generator(baseMesh, supportedLevel(baseMesh, maxLevel)), maxLevel(supportedLevel(baseMesh, maxLevel)) {
+    const QVector<Vertex>& vertices = baseMesh.getVertices();
+    baseCoords.resize(vertices.size());
+    for (int v = 0; v < vertices.size(); ++v) {
+        baseCoords[v] = vertices[v].coords;
+    }
+    positions.resize(this->maxLevel + 1);
+    refined.resize(this->maxLevel);
+}
+
+/**
+ * @brief ViewDependentRefiner::setPixelTolerance Sets the screen-space error
+ * below which faces are not refined.
+ * @param pixels The tolerance in pixels.
+ */
+void ViewDependentRefiner::setPixelTolerance(float pixels) {
+    pixelTolerance = pixels;
+}
+
+/**
+ * @brief ViewDependentRefiner::parentFace Retrieves the face a face was
+ * created from: face 3f + i and face 3F + f of level l are children of face f
+ * of level l - 1, with F the number of faces of level l - 1.
+ * @param level The level of the face, at least 1.
+ * @param f Index of the face.
+ * @return The index of the parent face.
+ */
+int ViewDependentRefiner::parentFace(int level, int f) const {
+    int cornerFaces = 3 * generator.counts[level - 1].faces;
+    return f < cornerFaces ? f / 3 : f - cornerFaces;
+}
+
+/**
+ * @brief ViewDependentRefiner::gatherRing Gathers the neighbours of a vertex
+ * of a level in counterclockwise order, in the order LoopSubdivider's limit
+ * masks expect. On the boundary, the first and last neighbours are the
+ * boundary neighbours.
+ * @param level The level of the vertex.
+ * @param v Index of the vertex.
+ * @param ring Set to the neighbours.
+ * @return True if the vertex lies on the boundary.
+ */
+bool ViewDependentRefiner::gatherRing(int level, int v, QVarLengthArray<int, 16>& ring) const {
+    LoopTopologyGenerator::HalfEdgeData data[3];
+    int out;
+    int valence;
+    ring.clear();
+    generator.vertexData(level, v, out, valence);
+    if (out < 0) {
+        return false;
+    }
+
+    // Start at the outgoing boundary half-edge, if any
+    int start = out;
+    for (int steps = 0; steps < maxRingSteps; ++steps) {
+        generator.faceHalfEdges(level, start / 3, data);
+        int twin = data[start % 3].twin;
+        if (twin < 0 || generator.nextHalfEdge(level, twin) == out) {
+            break;
+        }
+        start = generator.nextHalfEdge(level, twin);
+    }
+    generator.faceHalfEdges(level, start / 3, data);
+    bool boundary = data[start % 3].twin < 0;
+    if (!boundary) {
+        start = out;
+    }
+
+    int edge = start;
+    for (int steps = 0; steps < maxRingSteps; ++steps) {
+        generator.faceHalfEdges(level, edge / 3, data);
+        int j = edge % 3;
+        ring.append(data[(j + 1) % 3].origin);
+        edge = data[(j + 2) % 3].twin;
+        if (edge < 0) {
+            ring.append(data[(j + 2) % 3].origin);
+            break;
+        }
+        if (edge == start) {
+            break;
+        }
+    }
+    return boundary;
+}
+
+/**
+ * @brief ViewDependentRefiner::position Evaluates the position of a vertex of
+ * a level with Loop's stencils, evaluating the positions it depends on in the
+ * level above first. The results are cached.
+ * @param level The level of the vertex.
+ * @param v Index of the vertex.
+ * @return The position of the vertex on that level.
+ */
+QVector3D ViewDependentRefiner::position(int level, int v) {
+    if (level == 0) {
+        return baseCoords[v];
+    }
+    QHash<int, QVector3D>& cache = positions[level];
+    if (cache.contains(v)) {
+        return cache.value(v);
+    }
+
+    int coarseVerts = generator.counts[level - 1].verts;
+    QVector3D coords;
+    if (v < coarseVerts) {
+        // Vertex point
+        QVarLengthArray<int, 16> ring;
+        bool boundary = gatherRing(level - 1, v, ring);
+        coords = position(level - 1, v);
+        if (boundary) {
+            coords = 6.0 / 8.0 * coords + (position(level - 1, ring[0]) + position(level - 1, ring[ring.size() - 1])) / 8.0;
+        } else if (!ring.isEmpty()) {
+            float valence = ring.size();
+            float ringWeight = valence == 3.0 ? 3.0 / 16.0 : 3.0 / (8.0 * valence);
+            coords *= 1.0 - valence * ringWeight;
+            for (int neighbour : ring) {
+                coords += ringWeight * position(level - 1, neighbour);
+            }
+        }
+    } else {
+        // Edge point, from the endpoints and the opposite vertices
+        LoopTopologyGenerator::HalfEdgeData data[3];
+        int h = generator.edgeHalfEdge(level - 1, v - coarseVerts);
+        generator.faceHalfEdges(level - 1, h / 3, data);
+        int j = h % 3;
+        coords = position(level - 1, data[j].origin) + position(level - 1, data[(j + 1) % 3].origin);
+        int twin = data[j].twin;
+        if (twin < 0) {
+            coords /= 2.0;
+        } else {
+            QVector3D opposite = position(level - 1, data[(j + 2) % 3].origin);
+            generator.faceHalfEdges(level - 1, twin / 3, data);
+            opposite += position(level - 1, data[(twin % 3 + 2) % 3].origin);
+            coords = (6.0 * coords + 2.0 * opposite) / 16.0;
+        }
+    }
+    cache.insert(v, coords);
+    return coords;
+}
+
+/**
+ * @brief ViewDependentRefiner::limitPoint Evaluates the limit position and
+ * normal of a vertex on the level it was created in. The results are cached.
+ * @param v Index of the vertex.
+ * @return The limit point of the vertex.
+ */
+ViewDependentRefiner::LimitPoint ViewDependentRefiner::limitPoint(int v) {
+    if (limitPoints.contains(v)) {
+        return limitPoints.value(v);
+    }
+
+    int level = 0;
+    while (v >= generator.counts[level].verts) {
+        ++level;
+    }
+    QVarLengthArray<int, 16> ring;
+    bool boundary = gatherRing(level, v, ring);
+
+    LimitPoint point;
+    point.position = position(level, v);
+    if (!ring.isEmpty()) {
+        QVarLengthArray<QVector3D, 16> ringCoords;
+        for (int neighbour : ring) {
+            ringCoords.append(position(level, neighbour));
+        }
+        LoopSubdivider::limitPoint(point.position, ringCoords, boundary, point.position, point.normal);
+    }
+    limitPoints.insert(v, point);
+    return point;
+}
+
+/**
+ * @brief ViewDependentRefiner::update Refines the mesh for the provided view.
+ * Level by level, starting from the base faces, the faces in the frustum whose
+ * screen-space error exceeds the tolerance are refined, so every call visits
+ * all refined faces and their children. Faces that were refined for the
+ * previous view stay refined until their error drops below half the
+ * tolerance, so that small camera movements do not make faces flicker between
+ * levels.
+ * @param modelViewMatrix The model-view matrix.
+ * @param projectionMatrix The projection matrix.
+ * @param viewportHeight The height of the viewport in pixels.
+ * @return True if the refined faces changed, in which case the whole mesh was
+ * rebuilt.
+ */
+bool ViewDependentRefiner::update(const QMatrix4x4& modelViewMatrix, const QMatrix4x4& projectionMatrix,
+                                  int viewportHeight) {
+    // The planes of the frustum in model space (Gribb and Hartmann)
+    QMatrix4x4 modelViewProjection = projectionMatrix * modelViewMatrix;
+    QVector4D planes[6];
+    for (int i = 0; i < 3; ++i) {
+        planes[2 * i] = modelViewProjection.row(3) + modelViewProjection.row(i);
+        planes[2 * i + 1] = modelViewProjection.row(3) - modelViewProjection.row(i);
+    }
+    for (QVector4D& plane : planes) {
+        plane /= plane.toVector3D().length();
+    }
+    // Pixels covered by a unit length at unit depth, and the scale of the view
+    float pixelScale = 0.5 * viewportHeight * projectionMatrix(1, 1);
+    float viewScale = modelViewMatrix.column(0).toVector3D().length();
+
+    QVector<QSet<int>> nextRefined(maxLevel);
+    QVector<int> faces(generator.counts[0].faces);
+    for (int f = 0; f < faces.size(); ++f) {
+        faces[f] = f;
+    }
+
+    for (int l = 0; l < maxLevel && !faces.isEmpty(); ++l) {
+        // Gather the corners and neighbours first, since the positions are
+        // evaluated on demand
+        int numFaces = faces.size();
+        QVector<LimitPoint> corners(3 * numFaces);
+        QVector<int> neighbours(3 * numFaces);
+        for (int i = 0; i < numFaces; ++i) {
+            LoopTopologyGenerator::HalfEdgeData data[3];
+            generator.faceHalfEdges(l, faces[i], data);
+            for (int c = 0; c < 3; ++c) {
+                corners[3 * i + c] = limitPoint(data[c].origin);
+                neighbours[3 * i + c] = data[c].twin < 0 ? -1 : data[c].twin / 3;
+            }
+        }
+
+        const LimitPoint* cornerData = corners.constData();
+        const int* neighbourData = neighbours.constData();
+        const int* faceData = faces.constData();
+        const QSet<int>& previous = refined[l];
+        const QSet<int>* parents = l == 0 ? nullptr : &nextRefined[l - 1];
+        QVector<bool> refine(numFaces, false);
+        bool* refineData = refine.data();
+
+        #pragma omp parallel for
+        for (int i = 0; i < numFaces; ++i) {
+            // Only refine faces whose edge neighbours exist on this level
+            bool balanced = true;
+            for (int c = 0; c < 3; ++c) {
+                int neighbour = neighbourData[3 * i + c];
+                balanced &= parents == nullptr || neighbour < 0 || parents->contains(parentFace(l, neighbour));
+            }
+            if (!balanced) {
+                continue;
+            }
+
+            // Distance between the face and the limit surface, estimated from
+            // the tangent planes at the corners
+            const LimitPoint* points = cornerData + 3 * i;
+            float error = 0.0;
+            QVector3D center = (points[0].position + points[1].position + points[2].position) / 3.0;
+            float radius = 0.0;
+            for (int a = 0; a < 3; ++a) {
+                radius = qMax(radius, (points[a].position - center).length());
+                for (int b = 0; b < 3; ++b) {
+                    QVector3D offset = points[b].position - points[a].position;
+                    error = qMax(error, fabsf(QVector3D::dotProduct(points[a].normal, offset)) / 4.0f);
+                }
+            }
+            radius += error;
+
+            bool visible = true;
+            for (const QVector4D& plane : planes) {
+                visible &= QVector3D::dotProduct(plane.toVector3D(), center) + plane.w() > -radius;
+            }
+            if (!visible) {
+                continue;
+            }
+
+            float depth = -modelViewMatrix.map(center).z();
+            float tolerance = previous.contains(faceData[i]) ? pixelTolerance / 2.0 : pixelTolerance;
+            if (depth <= viewScale * radius) {
+                // The camera is inside the bounds of the face
+                refineData[i] = error > 0.0;
+            } else {
+                refineData[i] = error * viewScale * pixelScale / depth > tolerance;
+            }
+        }
+
+        // The children of the refined faces form the next level
+        int faceCount = generator.counts[l].faces;
+        QVector<int> nextFaces;
+        for (int i = 0; i < numFaces; ++i) {
+            if (refine[i]) {
+                int f = faces[i];
+                nextRefined[l].insert(f);
+                for (int child = 0; child < 3; ++child) {
+                    nextFaces.append(3 * f + child);
+                }
+                nextFaces.append(3 * faceCount + f);
+            }
+        }
+        faces = nextFaces;
+    }
+
+    bool changed = nextRefined != refined || mesh.numFaces() == 0;
+    refined = nextRefined;
+    if (changed) {
+        buildMesh();
+    }
+    return changed;
+}
+
+/**
+ * @brief ViewDependentRefiner::buildMesh Rebuilds the whole mesh from the
+ * faces that are not refined. Their edges shared with refined faces carry the
+ * edge points of the next level. Only the limit points come from the cache.
+ */
+void ViewDependentRefiner::buildMesh() {
+    QHash<int, int> ids;
+    QVector<QVector3D> coords;
+    QVector<QVector3D> normals;
+    QVector<QVector<int>> faceIndices;
+
+    auto vertexId = [&](int v) {
+        int id = ids.value(v, -1);
+        if (id >= 0) {
+            return id;
+        }
+        LimitPoint point = limitPoint(v);
+        id = coords.size();
+        coords.append(point.position);
+        normals.append(point.normal);
+        ids.insert(v, id);
+        return id;
+    };
+
+    QVector<int> faces(generator.counts[0].faces);
+    for (int f = 0; f < faces.size(); ++f) {
+        faces[f] = f;
+    }
+    for (int l = 0; !faces.isEmpty(); ++l) {
+        const QSet<int>* refinedFaces = l < maxLevel ? &refined[l] : nullptr;
+        int faceCount = generator.counts[l].faces;
+        QVector<int> nextFaces;
+        for (int f : faces) {
+            if (refinedFaces != nullptr && refinedFaces->contains(f)) {
+                for (int child = 0; child < 3; ++child) {
+                    nextFaces.append(3 * f + child);
+                }
+                nextFaces.append(3 * faceCount + f);
+                continue;
+            }
+
+            LoopTopologyGenerator::HalfEdgeData data[3];
+            generator.faceHalfEdges(l, f, data);
+            int corners[3];
+            int edgePoints[3];
+            for (int c = 0; c < 3; ++c) {
+                corners[c] = vertexId(data[c].origin);
+                edgePoints[c] = -1;
+                if (refinedFaces != nullptr && data[c].twin >= 0 && refinedFaces->contains(data[c].twin / 3)) {
+                    edgePoints[c] = vertexId(generator.counts[l].verts + data[c].edge);
+                }
+            }
+            AdaptiveLoopSubdivider::triangulateLeaf(corners, edgePoints, faceIndices);
+        }
+        faces = nextFaces;
+    }
+
+    mesh = MeshInitializer().constructHalfEdgeMesh(coords, faceIndices);
+    mesh.limitCoords = coords;
+    mesh.limitNormals = normals;
+    mesh.limitDirty = false;
+    // Subdivision shading converges to the limit normals
+    mesh.setSubdividedNormals(LINEAR, normals);
+    mesh.setSubdividedNormals(SPHERICAL, normals);
+    mesh.setSubdividedNormals(BUTTERFLY, normals);
+}
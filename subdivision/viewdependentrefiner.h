@@ -0,0 +1,73 @@
+#ifndef VIEW_DEPENDENT_REFINER_H
+#define VIEW_DEPENDENT_REFINER_H
+
+#include <QHash>
+#include <QMatrix4x4>
+#include <QSet>
+#include <QVarLengthArray>
+#include <QVector>
+#include <QVector3D>
+
+#include "looptopologygenerator.h"
+#include "mesh/mesh.h"
+
+/**
+ * @brief The ViewDependentRefiner class refines a triangle mesh with Loop
+ * subdivision only where the current view needs it. A face is refined while it
+ * lies in the view frustum and its screen-space error, the distance between
+ * the face and the limit surface projected to pixels, exceeds a tolerance.
+ *
+ * Faces and vertices are identified by their indices in the uniformly
+ * subdivided levels (see LoopTopologyGenerator), so the refinement is sparse:
+ * the positions of a level are only evaluated for the vertices that are
+ * needed. Only this evaluation is incremental. Positions and limit points are
+ * cached for as long as the base mesh does not change, so after the camera
+ * moves only the vertices that were never needed before are evaluated, and
+ * faces that are coarsened keep their vertices in the cache. The refinement
+ * itself is redone on every update, walking down from the base faces. When
+ * the set of refined faces changes, the whole mesh is rebuilt and has to be
+ * uploaded again.
+ *
+ * As in AdaptiveLoopSubdivider, a face is only refined if its edge neighbours
+ * exist on the same level, and faces next to refined faces are split at the
+ * shared edge points, so the result is crack-free. Every vertex is placed on
+ * the limit surface.
+ */
+class ViewDependentRefiner {
+public:
+    ViewDependentRefiner(Mesh& baseMesh, int maxLevel = 6);
+
+    void setPixelTolerance(float pixels);
+    bool update(const QMatrix4x4& modelViewMatrix, const QMatrix4x4& projectionMatrix, int viewportHeight);
+
+    inline Mesh& getMesh() { return mesh; }
+    inline int numLevels() const { return maxLevel; }
+
+private:
+    // Limit position and normal of a vertex, the same on every level
+    struct LimitPoint {
+        QVector3D position;
+        QVector3D normal;
+    };
+
+    bool gatherRing(int level, int v, QVarLengthArray<int, 16>& ring) const;
+    QVector3D position(int level, int v);
+    LimitPoint limitPoint(int v);
+    int parentFace(int level, int f) const;
+    void buildMesh();
+
+    LoopTopologyGenerator generator;
+    QVector<QVector3D> baseCoords;
+    int maxLevel;
+    // Maximum screen-space error in pixels
+    float pixelTolerance = 1.0;
+
+    // The positions of every level evaluated so far, by vertex index
+    QVector<QHash<int, QVector3D>> positions;
+    QHash<int, LimitPoint> limitPoints;
+    // The faces of every level that are refined in the current view
+    QVector<QSet<int>> refined;
+    Mesh mesh;
+};
+
+#endif  // VIEW_DEPENDENT_REFINER_H
@@ -3,4 +3,28 @@
 
 enum SubdivisionShaderType { LINEAR, SPHERICAL, BUTTERFLY };
 
+/**
+ * @brief Flags selecting which attributes a subdivision step produces. The
+ * normal flags line up with SubdivisionShaderType, see refinementFlag.
+ */
+enum RefinementAttribute {
+    REFINE_LINEAR = 1 << LINEAR,
+    REFINE_SPHERICAL = 1 << SPHERICAL,
+    REFINE_BUTTERFLY = 1 << BUTTERFLY,
+    REFINE_BLEND_WEIGHTS = 1 << 3,
+    REFINE_GEOMETRY = 1 << 4,
+    REFINE_CUSTOM = 1 << 5,
+    REFINE_ALL = REFINE_LINEAR | REFINE_SPHERICAL | REFINE_BUTTERFLY |
+                 REFINE_BLEND_WEIGHTS | REFINE_GEOMETRY | REFINE_CUSTOM
+};
+
+/**
+ * @brief Accuracy of the kernels used by spherical averaging. SPHERICAL_EXACT
+ * uses the standard library, the others polynomial approximations, see
+ * sphericalkernels.h for their error bounds.
+ */
+enum SphericalAccuracy { SPHERICAL_EXACT, SPHERICAL_FAST, SPHERICAL_FASTEST };
+
+inline int refinementFlag(SubdivisionShaderType type) { return 1 << type; }
+
 #endif // SUBDIVISIONSHADERTYPES_H
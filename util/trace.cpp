@@ -0,0 +1,170 @@
+#include "trace.h"
+
+#ifdef SUBDIVISION_TRACE
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <QDebug>
+#include <QMutex>
+#include <QVector>
+
+#include <chrono>
+
+std::atomic<int> traceLevel(TRACE_DEBUG);
+std::atomic<int> traceCategories(TRACE_ALL);
+
+/**
+ * @brief The TraceEntry struct holds a single recorded message.
+ */
+struct TraceEntry {
+  TraceLevel level;
+  TraceCategory category;
+  qint64 time;
+  char message[120];
+};
+
+/**
+ * @brief The TraceBuffer class is the ring buffer of a single thread. Only the
+ * owning thread writes, publishing each entry by advancing head. Readers keep
+ * their position in tail and hold the registry lock. When the writer laps the
+ * reader, the oldest entries are dropped.
+ */
+class TraceBuffer {
+ public:
+  TraceBuffer();
+  ~TraceBuffer();
+
+  void record(TraceLevel level, TraceCategory category, const char* format, va_list args);
+  void flush();
+
+ private:
+  static const int capacity = 1024;
+
+  TraceEntry entries[capacity];
+  std::atomic<quint64> head{0};
+  quint64 tail = 0;
+};
+
+// Buffers of all live threads, the lock is only taken when threads start or
+// exit and when flushing
+static QMutex registryLock;
+static QVector<TraceBuffer*> registry;
+
+static thread_local TraceBuffer threadBuffer;
+
+/**
+ * @brief TraceBuffer::TraceBuffer Registers the buffer of a new thread.
+ */
+TraceBuffer::TraceBuffer() {
+  QMutexLocker locker(&registryLock);
+  registry.append(this);
+}
+
+/**
+ * @brief TraceBuffer::~TraceBuffer Prints what is left and unregisters the
+ * buffer of an exiting thread.
+ */
+TraceBuffer::~TraceBuffer() {
+  QMutexLocker locker(&registryLock);
+  flush();
+  registry.removeOne(this);
+}
+
+/**
+ * @brief TraceBuffer::record Formats a message into the next entry.
+ * @param level The level of the message.
+ * @param category The category of the message.
+ * @param format printf-style format.
+ * @param args The arguments of the format.
+ */
+void TraceBuffer::record(TraceLevel level, TraceCategory category,
+                         const char* format, va_list args) {
+  quint64 index = head.load(std::memory_order_relaxed);
+  TraceEntry& entry = entries[index % capacity];
+  entry.level = level;
+  entry.category = category;
+  entry.time = std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+                   .count();
+  vsnprintf(entry.message, sizeof(entry.message), format, args);
+  head.store(index + 1, std::memory_order_release);
+}
+
+/**
+ * @brief categoryName Retrieves the name of the provided category.
+ * @param category The category.
+ * @return The name printed with each message.
+ */
+static const char* categoryName(TraceCategory category) {
+  switch (category) {
+    case TRACE_IO:
+      return "io";
+    case TRACE_RENDER:
+      return "render";
+    case TRACE_MESH:
+      return "mesh";
+    case TRACE_SUBDIVISION:
+      return "subdivision";
+    default:
+      return "";
+  }
+}
+
+/**
+ * @brief TraceBuffer::flush Prints the entries recorded since the last flush.
+ * Must be called with the registry lock held. Entries that the owning thread
+ * overwrites while they are printed may come out garbled, so flush while the
+ * worker threads are idle.
+ */
+void TraceBuffer::flush() {
+  static const char* levels[] = {"E", "W", "I", "D"};
+  quint64 end = head.load(std::memory_order_acquire);
+  if (end - tail > quint64(capacity)) {
+    qDebug() << "..." << end - tail - capacity << "trace entries dropped";
+    tail = end - capacity;
+  }
+  for (; tail < end; ++tail) {
+    const TraceEntry& entry = entries[tail % capacity];
+    qDebug().noquote() << levels[entry.level] << entry.time
+                       << categoryName(entry.category) << entry.message;
+  }
+}
+
+/**
+ * @brief setTraceFilter Sets which messages are recorded.
+ * @param level The most verbose level to record.
+ * @param categories The TraceCategory flags to record.
+ */
+void setTraceFilter(TraceLevel level, int categories) {
+  traceLevel.store(level, std::memory_order_relaxed);
+  traceCategories.store(categories, std::memory_order_relaxed);
+}
+
+/**
+ * @brief traceRecord Records a message in the buffer of the calling thread.
+ * Use the TRACE macro instead, which skips the call when the message is
+ * filtered out.
+ * @param level The level of the message.
+ * @param category The category of the message.
+ * @param format printf-style format, messages are cut off at 119 characters.
+ */
+void traceRecord(TraceLevel level, TraceCategory category, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  threadBuffer.record(level, category, format, args);
+  va_end(args);
+}
+
+/**
+ * @brief traceFlush Prints the messages recorded by all threads since the
+ * last flush.
+ */
+void traceFlush() {
+  QMutexLocker locker(&registryLock);
+  for (TraceBuffer* buffer : registry) {
+    buffer->flush();
+  }
+}
+
+#endif  // SUBDIVISION_TRACE
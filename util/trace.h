@@ -0,0 +1,62 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/**
+ * Leveled, category-based tracing. Messages are only recorded when the build
+ * defines SUBDIVISION_TRACE; otherwise TRACE compiles to nothing, including
+ * its arguments. Recording formats the message into a ring buffer owned by the
+ * calling thread, without taking locks. TRACE_FLUSH prints the recorded
+ * messages of all threads through qDebug.
+ */
+
+enum TraceLevel { TRACE_ERROR, TRACE_WARNING, TRACE_INFO, TRACE_DEBUG };
+
+enum TraceCategory {
+  TRACE_IO = 1 << 0,
+  TRACE_RENDER = 1 << 1,
+  TRACE_MESH = 1 << 2,
+  TRACE_SUBDIVISION = 1 << 3,
+  TRACE_ALL = TRACE_IO | TRACE_RENDER | TRACE_MESH | TRACE_SUBDIVISION
+};
+
+#ifdef SUBDIVISION_TRACE
+
+#include <QtGlobal>
+
+#include <atomic>
+
+extern std::atomic<int> traceLevel;
+extern std::atomic<int> traceCategories;
+
+void setTraceFilter(TraceLevel level, int categories);
+void traceRecord(TraceLevel level, TraceCategory category, const char* format, ...)
+    Q_ATTRIBUTE_FORMAT_PRINTF(3, 4);
+void traceFlush();
+
+inline bool traceEnabled(TraceLevel level, TraceCategory category) {
+  return level <= traceLevel.load(std::memory_order_relaxed) &&
+         (category & traceCategories.load(std::memory_order_relaxed));
+}
+
+#define TRACE(level, category, ...)                  \
+  do {                                               \
+    if (traceEnabled(level, category)) {             \
+      traceRecord(level, category, __VA_ARGS__);     \
+    }                                                \
+  } while (0)
+#define TRACE_FLUSH() traceFlush()
+
+#else
+
+inline void setTraceFilter(TraceLevel, int) {}
+
+#define TRACE(level, category, ...) \
+  do {                              \
+  } while (0)
+#define TRACE_FLUSH() \
+  do {                \
+  } while (0)
+
+#endif  // SUBDIVISION_TRACE
+
+#endif  // TRACE_H
@@ -2,6 +2,8 @@
 
 #include <QDebug>
 
+#include <limits>
+
 /**
  * @brief calcBoundingBoxScale Calculates the scale with which to scale the
  * provided coordinates for all of them to fit inside a bounding box(cube) of
@@ -29,3 +31,28 @@ float calcBoundingBoxScale(const QVector<QVector3D> coords,
   QVector3D dims = maxCoord - minCoord;
   return desiredScale / std::min(dims.x(), dims.y());
 }
+
+/**
+ * @brief projectedLength Estimates the length in pixels of a segment of an
+ * object, drawn at the point of its bounding sphere closest to the camera.
+ * @param modelViewMatrix The model-view matrix.
+ * @param projectionMatrix The perspective projection matrix.
+ * @param viewportHeight The height of the viewport in pixels.
+ * @param center The centre of the bounding sphere, in model space.
+ * @param radius The radius of the bounding sphere, in model space.
+ * @param length The length of the segment, in model space.
+ * @return The projected length in pixels. Infinite if the camera lies inside
+ * the bounding sphere.
+ */
+float projectedLength(const QMatrix4x4& modelViewMatrix,
+                      const QMatrix4x4& projectionMatrix, int viewportHeight,
+                      const QVector3D& center, float radius, float length) {
+  // The model-view matrix scales uniformly
+  float viewScale = modelViewMatrix.column(0).toVector3D().length();
+  float depth = -modelViewMatrix.map(center).z() - viewScale * radius;
+  if (depth <= 0.0f) {
+    return std::numeric_limits<float>::infinity();
+  }
+  float pixelScale = 0.5f * viewportHeight * projectionMatrix(1, 1);
+  return length * viewScale * pixelScale / depth;
+}
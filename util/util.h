@@ -1,10 +1,14 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <QMatrix4x4>
 #include <QVector3D>
 #include <QVector>
 
 float calcBoundingBoxScale(const QVector<QVector3D> coords,
                            const float desiredScale = 1.0f);
+float projectedLength(const QMatrix4x4& modelViewMatrix,
+                      const QMatrix4x4& projectionMatrix, int viewportHeight,
+                      const QVector3D& center, float radius, float length);
 
 #endif  // UTIL_H